@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Small helpers shared by the benchmarks: a median timer and an allocation counter. Every
+// benchmark is one program that prints a table, run them all with "make bench".
+namespace bench {
+
+inline std::atomic<size_t> allocations{0};
+
+// Median time of one call to work in microseconds, over enough runs to fill about 200 ms
+template <typename F>
+double medianMicros(F&& work, int minRuns = 5) {
+    std::vector<double> samples;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+    while (samples.size() < static_cast<size_t>(minRuns) || std::chrono::steady_clock::now() < deadline) {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        if (samples.size() >= 10000) break;
+    }
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+
+// Heap allocations made by one call to work
+template <typename F>
+size_t countAllocations(F&& work) {
+    size_t before = allocations.load();
+    work();
+    return allocations.load() - before;
+}
+
+// Keeps the optimizer from dropping a result nobody reads
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+} // namespace bench
+
+// Counting operator new for countAllocations, each benchmark is a single translation unit.
+// They are kept out of line, inlined GCC sees malloc() and free() and warns about mismatches.
+__attribute__((noinline)) void* operator new(size_t size) {
+    bench::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { std::free(p); }
\ No newline at end of file
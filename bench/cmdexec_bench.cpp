@@ -0,0 +1,40 @@
+// CommandExecutor::run (posix_spawn, poll on one pipe) against the popen and 128-byte fgets
+// loop it replaced, for short commands where process startup dominates and for a large output.
+#include <cstdio>
+#include <memory>
+#include "bench.hpp"
+#include "cmdexec.hpp"
+
+namespace {
+
+// What every tool call did before: a shell in between and fgets into a small buffer
+std::string viaPopen(const std::string& command) {
+    std::string result;
+    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"), pclose);
+    char buffer[128];
+    while (fgets(buffer, sizeof buffer, pipe.get()) != nullptr) {
+        result += buffer;
+    }
+    return result;
+}
+
+} // namespace
+
+int main() {
+    spdlog::set_level(spdlog::level::warn);
+    commandOptions unlimited;
+    unlimited.maxOutput = 64 << 20;
+
+    std::printf("%-28s %12s %12s %16s\n", "command", "popen us", "spawn us", "spawn via sh us");
+    for (const std::vector<std::string>& argv : std::vector<std::vector<std::string>>{
+             {"true"}, {"echo", "hello", "world"}, {"git", "--version"}, {"seq", "1", "700000"}}) {
+        std::string line;
+        for (const auto& word : argv) line += (line.empty() ? "" : " ") + word;
+        double popenTime = bench::medianMicros([&] { bench::keep(viaPopen(line)); });
+        double spawnTime = bench::medianMicros([&] { bench::keep(CommandExecutor::run(argv, unlimited)); });
+        double shellTime = bench::medianMicros([&] {
+            bench::keep(CommandExecutor::run({"/bin/sh", "-c", line}, unlimited));
+        });
+        std::printf("%-28s %12.0f %12.0f %16.0f\n", line.c_str(), popenTime, spawnTime, shellTime);
+    }
+}
\ No newline at end of file
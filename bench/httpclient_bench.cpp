@@ -0,0 +1,112 @@
+// HttpClient's pooled handles against a fresh curl handle per request, which is what every
+// request did before the pool. The stand-in server answers on loopback with a small JSON body
+// and keeps connections open, so the difference is connection setup and handle creation.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <thread>
+#include "bench.hpp"
+#include "httpclient.hpp"
+
+namespace {
+
+// Reads requests off one connection and answers each until the client closes it
+void serve(int fd) {
+    const std::string body = R"({"models":[{"name":"stand-in"}]})";
+    const std::string reply = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                              std::to_string(body.size()) + "\r\n\r\n" + body;
+    std::string pending;
+    char buffer[65536];
+    while (true) {
+        size_t headerEnd = pending.find("\r\n\r\n");
+        if (headerEnd == std::string::npos) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) break;
+            pending.append(buffer, n);
+            continue;
+        }
+        size_t length = 0;
+        size_t field = pending.find("Content-Length:");
+        if (field != std::string::npos && field < headerEnd) length = std::strtoul(pending.c_str() + field + 15, nullptr, 10);
+        while (pending.size() < headerEnd + 4 + length) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) break;
+            pending.append(buffer, n);
+        }
+        pending.erase(0, headerEnd + 4 + length);
+        if (send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) < 0) break;
+    }
+    close(fd);
+}
+
+int listenOnLoopback(int& port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), size) != 0 || listen(fd, 64) != 0) return -1;
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &size);
+    port = ntohs(address.sin_port);
+    return fd;
+}
+
+class benchClient : public HttpClient {
+public:
+    using HttpClient::makeRequest;
+};
+
+size_t discard(void*, size_t size, size_t nmemb, void*) {
+    return size * nmemb;
+}
+
+} // namespace
+
+int main() {
+    int port = 0;
+    int listener = listenOnLoopback(port);
+    if (listener < 0) {
+        std::perror("listen");
+        return 1;
+    }
+    std::thread([listener] {
+        while (true) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) break;
+            int yes = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+            std::thread(serve, fd).detach();
+        }
+    }).detach();
+    spdlog::set_level(spdlog::level::warn);
+
+    std::string base = "http://127.0.0.1:" + std::to_string(port);
+    benchClient client;
+    std::string payload = nlohmann::json{{"model", "stand-in"}, {"prompt", std::string(2000, 'x')}}.dump();
+    auto pooledGet = [&] { bench::keep(client.makeRequest(base + "/api/tags", std::string(), "", false)); };
+    auto pooledPost = [&] { bench::keep(client.makeRequest(base + "/api/chat", payload)); };
+    auto fresh = [&](bool post) {
+        CURL* curl = curl_easy_init();
+        std::string url = base + (post ? "/api/chat" : "/api/tags");
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        if (post) {
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)payload.size());
+        }
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+        curl_easy_perform(curl);
+        curl_easy_cleanup(curl);
+    };
+
+    std::printf("%-36s %12s\n", "request on loopback", "median us");
+    std::printf("%-36s %12.1f\n", "GET, fresh handle each time", bench::medianMicros([&] { fresh(false); }));
+    std::printf("%-36s %12.1f\n", "GET, pooled handle", bench::medianMicros(pooledGet));
+    std::printf("%-36s %12.1f\n", "POST 2 KB, fresh handle each time", bench::medianMicros([&] { fresh(true); }));
+    std::printf("%-36s %12.1f\n", "POST 2 KB, pooled handle", bench::medianMicros(pooledPost));
+    close(listener);
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+// lenientJson::toolCalls on the regression corpus in tests/jsonrepair and on a 70 KB write call,
+// strict, wrapped in prose, and with the trailing comma that makes the strict parse fail.
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "bench.hpp"
+#include "jsonrepair.hpp"
+
+int main() {
+    std::vector<std::string> answers;
+    for (const auto& entry : std::filesystem::directory_iterator("tests/jsonrepair")) {
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string text = buffer.str();
+        answers.push_back(text.substr(0, text.rfind("\n--- expected ---\n")));
+    }
+
+    std::string content;
+    while (content.size() < 70 * 1024) {
+        content += "int f" + std::to_string(content.size()) + "(int x) {\n    if (x > 0) { return x * 2; }\n    return 0;\n}\n";
+    }
+    std::string call = nlohmann::json{{"tool_name", "Write to File"},
+                                       {"parameters", {{"file_path", "big.cpp"}, {"content", content}}}}.dump();
+    std::string withProse = "Here is the whole file:\n" + call + "\nLet me know if it builds.";
+    std::string trailingComma = call.substr(0, call.size() - 1) + ",}";
+
+    size_t found = 0;
+    auto corpus = [&] {
+        for (const auto& answer : answers) found += lenientJson::toolCalls(answer).size();
+    };
+    std::printf("%-32s %10s %8s\n", "input", "time us", "allocs");
+    std::printf("%-32s %10.1f %8zu\n", ("corpus, " + std::to_string(answers.size()) + " answers").c_str(),
+                bench::medianMicros(corpus), bench::countAllocations(corpus));
+    for (auto [name, text] : {std::pair{"70 KB call, strict", &call}, std::pair{"70 KB call in prose", &withProse},
+                              std::pair{"70 KB call, trailing comma", &trailingComma}}) {
+        auto parse = [&] { found += lenientJson::toolCalls(*text).size(); };
+        std::printf("%-32s %10.1f %8zu\n", name, bench::medianMicros(parse), bench::countAllocations(parse));
+    }
+    bench::keep(found);
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+// Chat request bodies built as a JSON document every turn, as before, against requestBody's
+// cached per-message fragments, for growing histories. Also the first build after compact()
+// has copied the messages into a new arena, where every hit is checked byte by byte.
+#include "bench.hpp"
+#include "requestbody.hpp"
+
+namespace {
+
+nlohmann::json toJson(const chatMessage& msg) {
+    nlohmann::json msgJson = {{"role", roleName(msg.role)}, {"content", msg.content}};
+    if (!msg.toolCalls.empty()) msgJson["tool_calls"] = msg.toolCallsJson();
+    if (!msg.toolName.empty()) msgJson["tool_name"] = msg.toolName;
+    return msgJson;
+}
+
+std::string domBody(const nlohmann::json& head, const std::string& systemPrompt, const messageList& messages) {
+    nlohmann::json payload = head;
+    payload["messages"] = nlohmann::json::array();
+    payload["messages"].push_back({{"role", "system"}, {"content", systemPrompt}});
+    for (const auto& msg : messages) payload["messages"].push_back(toJson(msg));
+    return payload.dump();
+}
+
+} // namespace
+
+int main() {
+    std::string systemPrompt = std::string(6000, 's') + " \"quoted\"\n\ttab";
+    nlohmann::json head = {{"model", "qwen3"}, {"stream", true}, {"keep_alive", "30m"},
+                           {"options", {{"temperature", 0.7}, {"top_k", 20}}},
+                           {"tools", nlohmann::json::array({{{"type", "function"}, {"function", {{"name", "Read File"}}}}})}};
+
+    std::printf("%8s %9s %12s %10s %12s %10s %14s\n", "messages", "body KB", "DOM us", "allocs", "cached us", "allocs",
+                "recopied us");
+    for (size_t count : {10, 100, 1000}) {
+        messageStore history;
+        for (size_t i = 0; i < count; ++i) {
+            std::string content = std::string(2000 + i % 500, 'a' + i % 26) + "\n\"x\"\\ \xc3\xa9";
+            std::string callId = "c";
+            callId += std::to_string((i + 1) / 2); // a tool message answers the call before it
+            if (i % 2) {
+                nlohmann::json calls = nlohmann::json::array(
+                    {{{"id", callId}, {"function", {{"name", "Read File"}, {"arguments", {{"file_path", "a.cpp"}}}}}}});
+                history.append(messageRole::assistant, content, calls);
+            } else {
+                history.append(messageRole::tool, content, nlohmann::json::array(), callId, "Read File");
+            }
+        }
+        messageList messages = history.snapshot();
+        requestBody builder(toJson);
+        if (nlohmann::json::parse(builder.build(head, systemPrompt, messages)) !=
+            nlohmann::json::parse(domBody(head, systemPrompt, messages))) {
+            std::printf("bodies differ for %zu messages\n", count);
+            return 1;
+        }
+        auto dom = [&] { bench::keep(domBody(head, systemPrompt, messages)); };
+        auto cached = [&] { bench::keep(builder.build(head, systemPrompt, messages)); };
+        // Two copies of the history in their own arenas take turns, as right after compact()
+        messageStore copy;
+        for (const auto& msg : history) copy.append(msg);
+        messageList copied = copy.snapshot();
+        bool flip = false;
+        auto recopied = [&] { bench::keep(builder.build(head, systemPrompt, (flip = !flip) ? copied : messages)); };
+
+        std::printf("%8zu %9zu %12.1f %10zu %12.1f %10zu %14.1f\n", count, builder.build(head, systemPrompt, messages).size() / 1024,
+                    bench::medianMicros(dom), bench::countAllocations(dom), bench::medianMicros(cached),
+                    bench::countAllocations(cached), bench::medianMicros(recopied));
+    }
+}
\ No newline at end of file
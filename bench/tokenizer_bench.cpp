@@ -0,0 +1,135 @@
+// tokenCounter on a history of about 100k tokens: the estimate, byte-level BPE with a cold piece
+// cache, and what a step costs now that only the newest message is counted. Pass a HuggingFace
+// tokenizer.json to time a real vocabulary, otherwise a small one is trained on the history.
+#include <filesystem>
+#include <map>
+#include "bench.hpp"
+#include "tokenizer.hpp"
+
+namespace {
+
+// Prose, code and tool output in the proportions of a coding session
+std::vector<std::string> makeHistory() {
+    std::vector<std::string> messages;
+    tokenCounter estimate;
+    unsigned int tokens = 0;
+    for (int turn = 0; tokens < 100000; ++turn) {
+        std::string prose = "Let me look at how the request " + std::to_string(turn) +
+                            " is handled. The function doesn't check the return value, so I'll read the caller first "
+                            "and then fix both places. It's probably the same issue we've seen before.\n";
+        std::string code;
+        for (int line = 0; line < 40; ++line) {
+            code += "    int value_" + std::to_string(turn * 40 + line) + " = compute(x, y) + " + std::to_string(line * 37) +
+                    "; // adjust for offset\n";
+        }
+        std::string toolOutput = nlohmann::json{{"file_path", "src/module" + std::to_string(turn) + ".cpp"},
+                                                {"lines", turn * 13 % 400}, {"content", code}}.dump();
+        for (auto* message : {&prose, &code, &toolOutput}) {
+            tokens += estimate.count(*message);
+            messages.push_back(std::move(*message));
+        }
+    }
+    return messages;
+}
+
+// GPT-2's byte to printable character mapping, vocab entries are spelled with these
+std::array<std::string, 256> byteSymbols() {
+    std::array<std::string, 256> symbols;
+    int next = 256;
+    for (int b = 0; b < 256; ++b) {
+        bool printable = (b >= '!' && b <= '~') || (b >= 0xA1 && b <= 0xAC) || (b >= 0xAE && b <= 0xFF);
+        int codepoint = printable ? b : next++;
+        std::string utf8;
+        if (codepoint < 0x80) {
+            utf8 += static_cast<char>(codepoint);
+        } else {
+            utf8 += static_cast<char>(0xC0 | (codepoint >> 6));
+            utf8 += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+        symbols[b] = utf8;
+    }
+    return symbols;
+}
+
+// Learns a few thousand merges from the history's pieces and writes them as a tokenizer.json
+std::string trainTokenizer(const std::vector<std::string>& messages, int mergeCount) {
+    auto bytes = byteSymbols();
+    std::map<std::string, int> pieceCounts;
+    for (const auto& message : messages) {
+        tokenCounter::splitPieces(message, [&](std::string_view piece) { ++pieceCounts[std::string(piece)]; });
+    }
+    std::vector<std::pair<std::vector<std::string>, int>> words;
+    for (const auto& [piece, count] : pieceCounts) {
+        std::vector<std::string> symbols;
+        for (unsigned char c : piece) symbols.push_back(bytes[c]);
+        words.emplace_back(std::move(symbols), count);
+    }
+
+    nlohmann::json vocab = nlohmann::json::object();
+    for (const auto& symbol : bytes) vocab[symbol] = vocab.size();
+    nlohmann::json merges = nlohmann::json::array();
+    for (int m = 0; m < mergeCount; ++m) {
+        std::map<std::pair<std::string, std::string>, int> pairs;
+        for (const auto& [symbols, count] : words) {
+            for (size_t i = 0; i + 1 < symbols.size(); ++i) pairs[{symbols[i], symbols[i + 1]}] += count;
+        }
+        if (pairs.empty()) break;
+        auto best = std::max_element(pairs.begin(), pairs.end(),
+                                     [](const auto& a, const auto& b) { return a.second < b.second; })->first;
+        merges.push_back(best.first + " " + best.second);
+        vocab[best.first + best.second] = vocab.size();
+        for (auto& [symbols, count] : words) {
+            for (size_t i = 0; i + 1 < symbols.size(); ++i) {
+                if (symbols[i] == best.first && symbols[i + 1] == best.second) {
+                    symbols[i] += symbols[i + 1];
+                    symbols.erase(symbols.begin() + i + 1);
+                }
+            }
+        }
+    }
+    auto path = std::filesystem::temp_directory_path() / "vibecpp-bench-tokenizer.json";
+    std::ofstream(path) << nlohmann::json{{"model", {{"type", "BPE"}, {"vocab", vocab}, {"merges", merges}}}}.dump();
+    return path.string();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    spdlog::set_level(spdlog::level::warn);
+    auto messages = makeHistory();
+    size_t bytes = 0;
+    for (const auto& message : messages) bytes += message.size();
+    std::string path = argc > 1 ? argv[1] : trainTokenizer(messages, 2000);
+    const std::string& newest = messages[messages.size() - 2];
+
+    auto countAll = [&](tokenCounter& counter) {
+        unsigned int total = 0;
+        for (const auto& message : messages) total += counter.count(message);
+        return total;
+    };
+    tokenCounter estimator;
+    unsigned int estimated = countAll(estimator);
+    tokenCounter bpe;
+    if (!bpe.loadTokenizer(path)) return 1;
+    unsigned int encoded = countAll(bpe);
+
+    std::printf("history: %zu messages, %zu KB, %u tokens estimated, %u with BPE (%s)\n\n", messages.size(),
+                bytes / 1024, estimated, encoded, argc > 1 ? path.c_str() : "2000 merges trained on it");
+    std::printf("%-40s %12s\n", "count", "median us");
+    std::printf("%-40s %12.0f\n", "whole history, estimate", bench::medianMicros([&] {
+        tokenCounter counter;
+        bench::keep(countAll(counter));
+    }));
+    std::printf("%-40s %12.0f\n", "whole history, BPE, cold piece cache", bench::medianMicros([&] {
+        tokenCounter counter;
+        counter.loadTokenizer(path);
+        bench::keep(countAll(counter));
+    }) - bench::medianMicros([&] {
+        tokenCounter counter;
+        counter.loadTokenizer(path);
+    }));
+    std::printf("%-40s %12.0f\n", "whole history, BPE, warm piece cache", bench::medianMicros([&] { bench::keep(countAll(bpe)); }));
+    std::printf("%-40s %12.1f\n", ("one step, newest message (" + std::to_string(newest.size() / 1024) + " KB)").c_str(),
+                bench::medianMicros([&] { bench::keep(bpe.count(newest)); }));
+    if (argc == 1) std::filesystem::remove(path);
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <chrono>
+
+// States of one user task. Every model answer is one step: Request asks the model,
+// Dispatch acts on the answer (runs tools) and either goes back to Prepare or ends the task.
+enum class agentState {
+    Prepare,  // keep the context within limits, queue pending input
+    Request,  // get the next answer
+    Dispatch, // run requested tools or show the final answer
+    Done
+};
+
+struct agentStep {
+    unsigned int index = 0;
+    std::string completion;
+    size_t toolCalls = 0;
+    unsigned int contextTokens = 0;
+    double prefixReuse = 0.0; // share of the request identical to the previous one
+    std::chrono::milliseconds requestTime{0};
+    std::chrono::milliseconds toolTime{0};
+};
+
+// Zero means unlimited
+struct agentLimits {
+    unsigned int maxSteps = 100;
+    std::chrono::seconds maxDuration{0};
+};
+
+class agentTask {
+private:
+    agentLimits limits;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    unsigned int steps = 0;
+
+public:
+    explicit agentTask(const agentLimits& taskLimits) : limits(taskLimits) {}
+
+    unsigned int nextStep() {
+        return ++steps;
+    }
+
+    unsigned int stepCount() const {
+        return steps;
+    }
+
+    bool stepBudgetExhausted() const {
+        return limits.maxSteps > 0 && steps >= limits.maxSteps;
+    }
+
+    bool deadlinePassed() const {
+        return limits.maxDuration.count() > 0 && std::chrono::steady_clock::now() - started >= limits.maxDuration;
+    }
+
+    std::chrono::milliseconds elapsed() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    }
+};
\ No newline at end of file
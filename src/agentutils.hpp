@@ -2,9 +2,15 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <future>
+#include <optional>
 #include <nlohmann/json.hpp>
 #include "tool.hpp"
 #include "customtool.hpp"
+#include "stringutils.hpp"
+#include "workerpool.hpp"
+#include "resultcache.hpp"
+#include "jsonrepair.hpp"
 
 namespace agentUtils
 {
@@ -100,6 +106,150 @@ namespace agentUtils
         return targetTool->execute(params);
     }
 
+    // Like executeToolCall, but failures become an output the model can read
+    static std::string executeCheckedToolCall(const nlohmann::json &jsonToolCall,
+                                              const std::vector<std::unique_ptr<agentTool>> &availableTools)
+    {
+        if (!isValidToolCall(jsonToolCall, availableTools))
+        {
+            spdlog::warn("Tool calling request is invalid: {}", jsonToolCall.dump());
+            return "Unfortunately, I was not able to process this tool call. Tool does not exist or parameters are not an object.";
+        }
+        try
+        {
+            return executeToolCall(jsonToolCall, availableTools);
+        }
+        catch (const std::exception &e)
+        {
+            return "Tool call failed: " + std::string(e.what());
+        }
+    }
+
+    // Turns a native tool call ({"function": {"name", "arguments"}}) into the
+    // {"tool_name", "parameters"} form the rest of the tool handling works with.
+    static nlohmann::json fromNativeToolCall(const nlohmann::json &nativeCall,
+                                             const std::vector<std::unique_ptr<agentTool>> &availableTools)
+    {
+        std::string functionName = nativeCall["function"]["name"];
+        std::string toolName = functionName;
+        for (const auto &tool : availableTools)
+        {
+            if (tool->getFunctionName() == functionName)
+            {
+                toolName = tool->getName();
+                break;
+            }
+        }
+        return {{"tool_name", toolName}, {"parameters", nativeCall["function"]["arguments"]}};
+    }
+
+    // All {"tool_name", "parameters"} calls in a text answer: a single object, an array of them,
+    // or objects mixed with text, code fences included. Broken JSON is repaired where it can be
+    // (see lenientJson), so a call with a stray trailing comma doesn't cost another round trip.
+    static std::vector<nlohmann::json> extractToolCalls(const std::string &text)
+    {
+        return lenientJson::toolCalls(text);
+    }
+
+    static bool isReadOnlyCall(const nlohmann::json &jsonToolCall,
+                               const std::vector<std::unique_ptr<agentTool>> &availableTools)
+    {
+        for (const auto &tool : availableTools)
+        {
+            if (tool->getName() == jsonToolCall["tool_name"])
+            {
+                return tool->isReadOnly();
+            }
+        }
+        return false;
+    }
+
+    // What a read-only call's output depends on, nothing when it must not be reused
+    static std::optional<toolResultCache::dependencies> cacheableCall(const nlohmann::json &jsonToolCall,
+                                                                      const std::vector<std::unique_ptr<agentTool>> &availableTools)
+    {
+        for (const auto &tool : availableTools)
+        {
+            if (tool->getName() == jsonToolCall["tool_name"])
+            {
+                try
+                {
+                    return toolResultCache::snapshot(tool->resultDependencies(jsonToolCall["parameters"]));
+                }
+                catch (const std::exception &)
+                {
+                    return std::nullopt; // malformed parameters, the call reports it
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    static bool isFailedOutput(const std::string &output)
+    {
+        return output.starts_with("Error") || output.starts_with("Tool call failed") || output.starts_with("Unfortunately");
+    }
+
+    // Runs a batch of calls and returns their outputs in the same order. Consecutive read-only
+    // calls run concurrently on the pool, any other call waits for everything before it and
+    // runs alone, so writes keep their order relative to the reads around them. With a cache,
+    // read-only calls repeated while their inputs are unchanged are answered from it.
+    static std::vector<std::string> executeToolCalls(const std::vector<nlohmann::json> &calls,
+                                                     const std::vector<std::unique_ptr<agentTool>> &availableTools,
+                                                     workerPool &pool, toolResultCache *cache = nullptr,
+                                                     unsigned int historyGeneration = 0)
+    {
+        std::vector<std::string> outputs(calls.size());
+        size_t i = 0;
+        while (i < calls.size())
+        {
+            if (!isValidToolCall(calls[i], availableTools) || !isReadOnlyCall(calls[i], availableTools))
+            {
+                outputs[i] = executeCheckedToolCall(calls[i], availableTools);
+                i++;
+                continue;
+            }
+
+            std::vector<std::pair<size_t, std::future<std::string>>> running;
+            std::vector<std::pair<size_t, toolResultCache::dependencies>> storable;
+            while (i < calls.size() && isValidToolCall(calls[i], availableTools) && isReadOnlyCall(calls[i], availableTools))
+            {
+                const nlohmann::json &call = calls[i];
+                if (cache)
+                {
+                    std::string key = toolResultCache::key(call["tool_name"], call["parameters"]);
+                    if (auto cached = cache->lookup(key, historyGeneration))
+                    {
+                        spdlog::info("Tool call answered from cache: {}", stringUtils::truncateString(key, 80));
+                        outputs[i++] = std::move(*cached);
+                        continue;
+                    }
+                    if (auto stamps = cacheableCall(call, availableTools))
+                    {
+                        storable.emplace_back(i, std::move(*stamps));
+                    }
+                }
+                running.emplace_back(i, pool.submit([&call, &availableTools]() {
+                    return executeCheckedToolCall(call, availableTools);
+                }));
+                i++;
+            }
+            for (auto &[index, output] : running)
+            {
+                outputs[index] = output.get();
+            }
+            for (auto &[index, stamps] : storable)
+            {
+                if (!isFailedOutput(outputs[index]))
+                {
+                    cache->store(toolResultCache::key(calls[index]["tool_name"], calls[index]["parameters"]),
+                                 outputs[index], std::move(stamps), historyGeneration);
+                }
+            }
+        }
+        return outputs;
+    }
+
     std::string getHomeDirectory()
     {
         const char *homeDir = std::getenv("HOME");
@@ -109,4 +259,10 @@ namespace agentUtils
         }
         return std::string(homeDir) + "/";
     }
+
+    // Runtime data (response cache, ...) lives next to the config file, ~/.vibecpp itself is the config
+    std::string getDataDirectory()
+    {
+        return getHomeDirectory() + ".vibecpp.d/";
+    }
 };
\ No newline at end of file
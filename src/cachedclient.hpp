@@ -0,0 +1,199 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+#include <openssl/evp.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include "llmclient.hpp"
+
+// Stores responses on disk, keyed by a hash of everything that determines them: model, client
+// options, tools, system prompt and messages. Wraps another client.
+//   readwrite - answer from the cache when possible, store new responses
+//   record    - always ask the server, store the responses
+//   replay    - only answer from the cache, a miss is an error (deterministic, network-free runs)
+// Least recently used entries are evicted once the cache grows past its size limit.
+class CachedLLMClient : public LLMClient {
+public:
+    enum class cacheMode { readWrite, record, replay };
+
+private:
+    std::unique_ptr<LLMClient> inner;
+    std::filesystem::path directory;
+    cacheMode mode;
+    uintmax_t maxBytes;
+    uintmax_t totalBytes = 0;
+    std::mutex cacheMutex;
+
+    static std::string sha256Hex(const std::string& data) {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        EVP_Digest(data.data(), data.size(), digest, &length, EVP_sha256(), nullptr);
+        static const char* hex = "0123456789abcdef";
+        std::string out;
+        for (unsigned int i = 0; i < length; ++i) {
+            out += hex[digest[i] >> 4];
+            out += hex[digest[i] & 0xF];
+        }
+        return out;
+    }
+
+    std::string makeKey(const messageList& messages, const std::string& systemPrompt,
+                        const chatOptions& options) {
+        nlohmann::json keyData = {
+            {"model", inner->getModel()},
+            {"options", inner->getRequestOptions()},
+            {"tools", options.tools},
+            {"system", systemPrompt},
+            {"messages", nlohmann::json::array()}
+        };
+        for (const auto& msg : messages) {
+            keyData["messages"].push_back({
+                {"role", roleName(msg.role)},
+                {"content", msg.content},
+                {"tool_calls", msg.toolCallsJson()},
+                {"tool_call_id", msg.toolCallId},
+                {"tool_name", msg.toolName}
+            });
+        }
+        return sha256Hex(keyData.dump());
+    }
+
+    std::filesystem::path entryPath(const std::string& key) const {
+        return directory / (key + ".json");
+    }
+
+    bool load(const std::string& key, std::string& response) {
+        std::error_code ec;
+        auto path = entryPath(key);
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        response = buffer.str();
+        // Touching the entry makes its mtime the last use time for LRU eviction
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        return true;
+    }
+
+    void store(const std::string& key, const std::string& response) {
+        std::error_code ec;
+        auto path = entryPath(key);
+        auto temp = path;
+        temp += ".tmp";
+        {
+            std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                spdlog::warn("Could not write response cache entry {}", temp.string());
+                return;
+            }
+            file << response;
+        }
+        uintmax_t previous = std::filesystem::exists(path, ec) ? std::filesystem::file_size(path, ec) : 0;
+        std::filesystem::rename(temp, path, ec);
+        if (ec) {
+            spdlog::warn("Could not store response cache entry {}: {}", path.string(), ec.message());
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        totalBytes += response.size() - std::min<uintmax_t>(previous, totalBytes);
+        if (totalBytes > maxBytes) {
+            evict();
+        }
+    }
+
+    // Drops the least recently used entries until the cache is below 90% of its limit
+    void evict() {
+        std::error_code ec;
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+        totalBytes = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            if (entry.path().extension() != ".json") continue;
+            entries.emplace_back(entry.last_write_time(ec), entry.path());
+            totalBytes += entry.file_size(ec);
+        }
+        std::sort(entries.begin(), entries.end());
+        for (const auto& [time, path] : entries) {
+            if (totalBytes <= maxBytes * 9 / 10) break;
+            uintmax_t size = std::filesystem::file_size(path, ec);
+            if (std::filesystem::remove(path, ec)) {
+                totalBytes -= std::min(size, totalBytes);
+            }
+        }
+        spdlog::debug("Response cache evicted down to {} bytes", totalBytes);
+    }
+
+public:
+    CachedLLMClient(std::unique_ptr<LLMClient> client, const std::string& cacheDirectory,
+                    cacheMode cacheMode = cacheMode::readWrite, uintmax_t maxCacheBytes = 256ull << 20)
+        : inner(std::move(client)), directory(cacheDirectory), mode(cacheMode), maxBytes(maxCacheBytes) {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            if (entry.path().extension() == ".json") {
+                totalBytes += entry.file_size(ec);
+            }
+        }
+        setModel(inner->getModel());
+    }
+
+    static cacheMode parseMode(const std::string& name) {
+        if (name == "readwrite") return cacheMode::readWrite;
+        if (name == "record") return cacheMode::record;
+        if (name == "replay") return cacheMode::replay;
+        throw std::invalid_argument("Unknown cache mode: " + name + " (supported: readwrite, record, replay)");
+    }
+
+    std::string chat(const messageList& messages,
+                     const std::string& systemPrompt = "",
+                     const chatOptions& options = {}) override {
+        std::string key = makeKey(messages, systemPrompt, options);
+
+        std::string response;
+        if (mode != cacheMode::record && load(key, response)) {
+            spdlog::info("Response cache hit: {}", key);
+            if (options.onToken) {
+                auto json = nlohmann::json::parse(response, nullptr, false);
+                if (!json.is_discarded() && json.contains("message") && json["message"]["content"].is_string()) {
+                    std::string content = json["message"]["content"];
+                    if (!content.empty()) {
+                        options.onToken(content);
+                    }
+                }
+            }
+            return response;
+        }
+        if (mode == cacheMode::replay) {
+            throw std::runtime_error("Response cache miss in replay mode (key " + key + ")");
+        }
+
+        // Answers the caller stopped from onToken are kept, replayed they stop at the same place.
+        // Cancelled requests are not what this request would normally return.
+        response = inner->chat(messages, systemPrompt, options);
+
+        bool cancelled = options.cancel && options.cancel->load();
+        auto json = nlohmann::json::parse(response, nullptr, false);
+        if (!cancelled && !json.is_discarded() && json.contains("message") && !json.contains("error")) {
+            store(key, response);
+        }
+        return response;
+    }
+
+    nlohmann::json getRequestOptions() const override {
+        return inner->getRequestOptions();
+    }
+
+    std::vector<std::string> listModels() override {
+        return inner->listModels();
+    }
+};
\ No newline at end of file
@@ -2,90 +2,257 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <cstdio>
-#include <memory>
-#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <spdlog/spdlog.h>
 
+extern char** environ;
+
+struct commandOptions {
+    std::chrono::milliseconds timeout{120000}; // the process group is killed after this long
+    size_t maxOutput = 1 << 20;                // or once it has written this many bytes
+};
+
+struct commandResult {
+    std::string output;   // stdout and stderr, interleaved as they arrived
+    int exitCode = 0;     // 128 + signal number when the process was killed
+    bool timedOut = false;
+    bool truncated = false;
+
+    // The output with a note on anything that went wrong, what tools return to the model
+    std::string describe(const commandOptions& options) const {
+        std::string result = output;
+        auto note = [&](const std::string& text) {
+            if (!result.empty() && result.back() != '\n') result += "\n";
+            result += "[" + text + "]";
+        };
+        if (truncated) note("output cut off at " + std::to_string(options.maxOutput / 1024) + " KB, process killed");
+        if (timedOut) note(fmt::format("timed out after {:g} s, process killed", options.timeout.count() / 1000.0));
+        if (!timedOut && !truncated && exitCode != 0) note("exit code " + std::to_string(exitCode));
+        return result;
+    }
+};
+
+// Runs commands without a shell in between: posix_spawn of the argv, both output pipes
+// drained with poll, and a deadline and size cap that kill the whole process group.
+// Command lines that use shell syntax (pipes, redirections, globs, variables) still go
+// through /bin/sh, with the same limits.
 class CommandExecutor {
 public:
+    static commandOptions& defaults() {
+        static commandOptions options;
+        return options;
+    }
+
     static std::string executeSingleArg(const std::string& command, std::string arg = {}) {
-        std::string fullCommand = command + " " + arg;
-        return executeRaw(fullCommand);
+        std::string fullCommand = arg.empty() ? command : command + " " + arg;
+        return runCommandLine(fullCommand).describe(defaults());
     }
+
     static std::string execute(const std::string& command, const std::vector<std::string>& args = {}) {
-        // Build the complete command string
-        std::ostringstream cmdStream;
-        cmdStream << command;
-        
-        for (const auto& arg : args) {
-            // Escape spaces and special characters in arguments
-            std::string escapedArg = escapeArgument(arg);
-            cmdStream << " " << escapedArg;
+        bool needsShell = false;
+        auto argv = splitArguments(command, needsShell);
+        if (needsShell) {
+            // Only the command part can use shell syntax, the arguments are passed as they are
+            std::string fullCommand = command;
+            for (const auto& arg : args) {
+                fullCommand += " " + quoteArgument(arg);
+            }
+            return runCommandLine(fullCommand).describe(defaults());
         }
-        spdlog::info("Executing: {}", cmdStream.str());
-        std::string fullCommand = cmdStream.str();
-        return executeRaw(fullCommand);
+        argv.insert(argv.end(), args.begin(), args.end());
+        return run(argv).describe(defaults());
     }
-    
+
     static std::vector<std::string> executeLines(const std::string& command, const std::vector<std::string>& args = {}) {
-        std::ostringstream cmdStream;
-        cmdStream << command;
-        
+        std::string fullCommand = command;
         for (const auto& arg : args) {
-            std::string escapedArg = escapeArgument(arg);
-            cmdStream << " " << escapedArg;
+            fullCommand += " " + quoteArgument(arg);
+        }
+        std::string output = runCommandLine(fullCommand).output;
+        std::vector<std::string> lines;
+        size_t start = 0;
+        while (start < output.size()) {
+            size_t end = output.find('\n', start);
+            if (end == std::string::npos) end = output.size();
+            lines.push_back(output.substr(start, end - start));
+            start = end + 1;
         }
-        
-        std::string fullCommand = cmdStream.str();
-        return executeLinesRaw(fullCommand);
+        return lines;
     }
 
-private:
-    static std::string executeRaw(const std::string& command) {
-        spdlog::info("Executing: {}", command);
-
-        std::string result;
-        std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"), pclose);
-        
-        if (!pipe) {
-            throw std::runtime_error("popen() failed!");
+    // Splits a command line the way sh would, without expanding anything. needsShell is set
+    // when it relies on the shell: pipes, redirections, globs, variables, subshells.
+    static std::vector<std::string> splitArguments(const std::string& commandLine, bool& needsShell) {
+        std::vector<std::string> argv;
+        std::string current;
+        bool inWord = false;
+        needsShell = false;
+        for (size_t i = 0; i < commandLine.size(); ++i) {
+            char c = commandLine[i];
+            if (c == '\'') {
+                size_t end = commandLine.find('\'', i + 1);
+                if (end == std::string::npos) {
+                    needsShell = true; // let sh report the error
+                    end = commandLine.size();
+                }
+                current += commandLine.substr(i + 1, end - i - 1);
+                inWord = true;
+                i = end;
+            } else if (c == '"') {
+                inWord = true;
+                for (++i; i < commandLine.size() && commandLine[i] != '"'; ++i) {
+                    char inner = commandLine[i];
+                    if (inner == '$' || inner == '`') needsShell = true;
+                    if (inner == '\\' && i + 1 < commandLine.size() && std::strchr("\"\\$`\n", commandLine[i + 1])) {
+                        inner = commandLine[++i];
+                    }
+                    current += inner;
+                }
+                if (i >= commandLine.size()) needsShell = true;
+            } else if (c == '\\' && i + 1 < commandLine.size()) {
+                current += commandLine[++i];
+                inWord = true;
+            } else if (c == ' ' || c == '\t') {
+                if (inWord) argv.push_back(current);
+                current.clear();
+                inWord = false;
+            } else {
+                if (std::strchr("|&;<>()$`*?[\n", c) || ((c == '~' || c == '#') && !inWord)) needsShell = true;
+                current += c;
+                inWord = true;
+            }
         }
-        
-        char buffer[128];
-        while (fgets(buffer, sizeof buffer, pipe.get()) != nullptr) {
-            result += buffer;
+        if (inWord) argv.push_back(current);
+        return argv;
+    }
+
+    static commandResult runCommandLine(const std::string& commandLine, const commandOptions& options = defaults()) {
+        bool needsShell = false;
+        auto argv = splitArguments(commandLine, needsShell);
+        if (needsShell) {
+            return run({"/bin/sh", "-c", commandLine}, options);
         }
-        
+        return run(argv, options);
+    }
+
+    static commandResult run(const std::vector<std::string>& argv, const commandOptions& options = defaults()) {
+        commandResult result;
+        if (argv.empty()) {
+            result.exitCode = 127;
+            result.output = "Error: empty command";
+            return result;
+        }
+        spdlog::info("Executing: {}", fmt::join(argv, " "));
+
+        int outPipe[2];
+        if (pipe2(outPipe, O_CLOEXEC) != 0) {
+            throw std::runtime_error("pipe2() failed: " + std::string(std::strerror(errno)));
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDERR_FILENO);
+
+        // Own process group, so everything it starts can be killed with it
+        posix_spawnattr_t attributes;
+        posix_spawnattr_init(&attributes);
+        sigset_t noSignals, defaultSignals;
+        sigemptyset(&noSignals);
+        sigemptyset(&defaultSignals);
+        sigaddset(&defaultSignals, SIGPIPE);
+        posix_spawnattr_setsigmask(&attributes, &noSignals);
+        posix_spawnattr_setsigdefault(&attributes, &defaultSignals);
+        posix_spawnattr_setpgroup(&attributes, 0);
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+        std::vector<char*> arguments;
+        for (const auto& arg : argv) {
+            arguments.push_back(const_cast<char*>(arg.c_str()));
+        }
+        arguments.push_back(nullptr);
+
+        pid_t pid = 0;
+        int error = posix_spawnp(&pid, arguments[0], &actions, &attributes, arguments.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attributes);
+        close(outPipe[1]);
+        if (error != 0) {
+            close(outPipe[0]);
+            result.exitCode = 127;
+            result.output = "Error: could not run " + argv[0] + ": " + std::strerror(error);
+            return result;
+        }
+
+        drain(outPipe[0], pid, options, result);
+        close(outPipe[0]);
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        if (WIFEXITED(status)) result.exitCode = WEXITSTATUS(status);
+        else if (WIFSIGNALED(status)) result.exitCode = 128 + WTERMSIG(status);
         return result;
     }
-    
-    static std::vector<std::string> executeLinesRaw(const std::string& command) {
-        std::vector<std::string> lines;
-        std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"), pclose);
-        
-        if (!pipe) {
-            throw std::runtime_error("popen() failed!");
+
+    // Quotes an argument for sh when it contains anything sh would interpret
+    static std::string quoteArgument(const std::string& arg) {
+        if (!arg.empty() && arg.find_first_of(" \t\n'\"\\|&;<>()$`*?[#~") == std::string::npos) {
+            return arg;
         }
-        
-        char buffer[128];
-        while (fgets(buffer, sizeof buffer, pipe.get()) != nullptr) {
-            std::string line(buffer);
-            if (!line.empty() && line.back() == '\n') {
-                line.pop_back();
-            }
-            lines.push_back(line);
+        std::string quoted = "'";
+        for (char c : arg) {
+            quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
         }
-        
-        return lines;
+        return quoted + "'";
     }
-    
-    static std::string escapeArgument(const std::string& arg) {
-        // Simple escaping for spaces and special characters
-        if (arg.find(' ') != std::string::npos || 
-            arg.find('"') != std::string::npos ||
-            arg.find('\'') != std::string::npos) {
-            return "\"" + arg + "\"";
+
+private:
+    // Reads until the output is closed, the deadline passes or the cap is reached. A process
+    // that exits while something it started still holds the pipe is not waited for.
+    static void drain(int fd, pid_t pid, const commandOptions& options, commandResult& result) {
+        thread_local std::vector<char> buffer(64 * 1024);
+        auto deadline = std::chrono::steady_clock::now() + options.timeout;
+        bool exited = false;
+        while (true) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0) {
+                result.timedOut = true;
+                kill(-pid, SIGKILL);
+                return;
+            }
+            struct pollfd pending = {fd, POLLIN, 0};
+            int wait = static_cast<int>(std::min<long long>(remaining.count(), exited ? 50 : 200));
+            int ready = poll(&pending, 1, wait);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (ready == 0) {
+                if (exited) return;
+                // Still running, or gone while a child of it keeps the pipe open
+                siginfo_t info{};
+                exited = waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == pid;
+                continue;
+            }
+            ssize_t got = read(fd, buffer.data(), buffer.size());
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return;
+            size_t room = options.maxOutput - std::min(options.maxOutput, result.output.size());
+            result.output.append(buffer.data(), std::min(static_cast<size_t>(got), room));
+            if (static_cast<size_t>(got) > room) {
+                result.truncated = true;
+                kill(-pid, SIGKILL);
+                return;
+            }
         }
-        return arg;
     }
-};
+};
\ No newline at end of file
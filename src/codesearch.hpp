@@ -0,0 +1,349 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <regex>
+#include <optional>
+#include <functional>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "filewalker.hpp"
+#include "mappedfile.hpp"
+
+struct searchLimits {
+    size_t maxMatches = 200;       // matching lines shown in total
+    size_t maxPerFile = 20;        // matching lines shown per file
+    size_t maxLineLength = 300;    // longer lines (minified code, data) are cut
+    size_t maxFileSize = 16 << 20; // larger files are skipped
+    size_t maxCollected = 5000;    // the walk stops once this many matching lines were found
+};
+
+struct searchMatch {
+    size_t line;
+    std::string text;
+};
+
+struct searchFileResult {
+    std::string path;
+    std::vector<searchMatch> matches; // at most maxPerFile
+    size_t total = 0;                 // all matching lines in the file
+};
+
+struct searchResult {
+    std::vector<searchFileResult> files; // sorted by path
+    size_t totalMatches = 0;
+    size_t filesSearched = 0;
+    bool stoppedEarly = false;
+};
+
+// Searches file contents for a regular expression, in process and in parallel.
+// The longest literal every match must contain is located first with a SIMD scan over the
+// mapped file, the regex only confirms the lines that contain it. Plain text queries
+// never touch the regex engine.
+class codeSearch {
+private:
+    std::string query;
+    std::string literal;             // required substring of every match, may be empty
+    std::vector<std::string> otherLiterals; // further required substrings, checked before the regex
+    std::optional<std::regex> regex; // unset when the query is plain text
+    bool wholeWord;
+
+    static bool isWordChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    static bool isMeta(char c) {
+        return std::strchr(".^$|()[]{}*+?\\", c) != nullptr;
+    }
+
+    bool wordBoundaries(const char* lineBegin, const char* lineEnd, const char* matchBegin, const char* matchEnd) const {
+        if (!wholeWord) return true;
+        bool before = matchBegin == lineBegin || !isWordChar(matchBegin[-1]);
+        bool after = matchEnd == lineEnd || !isWordChar(*matchEnd);
+        return before && after;
+    }
+
+    bool lineMatches(const char* lineBegin, const char* lineEnd) const {
+        if (!regex) {
+            for (const char* hit = findLiteral(lineBegin, lineEnd, literal); hit;
+                 hit = findLiteral(hit + 1, lineEnd, literal)) {
+                if (wordBoundaries(lineBegin, lineEnd, hit, hit + literal.size())) return true;
+            }
+            return false;
+        }
+        for (const auto& other : otherLiterals) {
+            if (!findLiteral(lineBegin, lineEnd, other)) return false;
+        }
+        for (std::cregex_iterator it(lineBegin, lineEnd, *regex), end; it != end; ++it) {
+            const char* matchBegin = lineBegin + it->position(0);
+            if (wordBoundaries(lineBegin, lineEnd, matchBegin, matchBegin + it->length(0))) return true;
+            if (it->length(0) == 0) break;
+        }
+        return false;
+    }
+
+public:
+    codeSearch(const std::string& pattern, bool matchWholeWord = false) : query(pattern), wholeWord(matchWholeWord) {
+        bool plain = std::none_of(pattern.begin(), pattern.end(), isMeta);
+        if (plain) {
+            literal = pattern;
+            return;
+        }
+        try {
+            regex.emplace(pattern, std::regex::ECMAScript | std::regex::optimize);
+            otherLiterals = requiredLiterals(pattern);
+            if (!otherLiterals.empty()) {
+                literal = otherLiterals.front();
+                otherLiterals.erase(otherLiterals.begin());
+            }
+        } catch (const std::regex_error& e) {
+            // Most likely text with special characters, e.g. "foo(" - search for it as it is
+            spdlog::debug("Invalid regex '{}' ({}), searching for the text", pattern, e.what());
+            regex.reset();
+            literal = pattern;
+        }
+    }
+
+    // Runs of literal characters outside groups, classes and alternations that every match
+    // has to contain, longest first. Empty when there are none, e.g. for "a|b" or "\w+".
+    static std::vector<std::string> requiredLiterals(const std::string& pattern) {
+        std::vector<std::string> runs;
+        std::string current;
+        int depth = 0;
+        auto endRun = [&]() {
+            if (!current.empty()) runs.push_back(current);
+            current.clear();
+        };
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            char c = pattern[i];
+            if (depth == 0 && c == '|') return {};
+            if (c == '\\' && i + 1 < pattern.size()) {
+                char next = pattern[++i];
+                if (depth > 0 || std::isalnum(static_cast<unsigned char>(next))) {
+                    endRun(); // \w, \d, \b, back references...
+                } else {
+                    current += next;
+                }
+                continue;
+            }
+            if (c == '[') {
+                endRun();
+                size_t close = pattern.find(']', i + 2);
+                if (close == std::string::npos) break;
+                i = close;
+                continue;
+            }
+            if (c == '(') { endRun(); ++depth; continue; }
+            if (c == ')') { depth = std::max(0, depth - 1); continue; }
+            if (depth > 0) continue;
+            if (c == '*' || c == '?' || c == '{') {
+                // The preceding character is optional (or repeated an unknown number of times)
+                if (!current.empty()) current.pop_back();
+                endRun();
+                if (c == '{') {
+                    size_t close = pattern.find('}', i);
+                    if (close != std::string::npos) i = close;
+                }
+                continue;
+            }
+            if (c == '+' || c == '.' || c == '^' || c == '$') {
+                endRun();
+                continue;
+            }
+            current += c;
+        }
+        endRun();
+        std::stable_sort(runs.begin(), runs.end(), [](const std::string& a, const std::string& b) {
+            return a.size() > b.size();
+        });
+        return runs;
+    }
+
+    // First occurrence of needle in [begin, end). Compares the first and the last byte of the
+    // needle against 16 positions at once and only checks the rest where both agree.
+    static const char* findLiteral(const char* begin, const char* end, std::string_view needle) {
+        size_t n = needle.size();
+        if (n == 0) return begin;
+        if (begin >= end || static_cast<size_t>(end - begin) < n) return nullptr;
+        if (n == 1) return static_cast<const char*>(std::memchr(begin, needle[0], end - begin));
+#if defined(__SSE2__)
+        const __m128i first = _mm_set1_epi8(needle[0]);
+        const __m128i last = _mm_set1_epi8(needle[n - 1]);
+        const char* limit = end - n + 1; // last possible start + 1
+        const char* p = begin;
+        for (; p + 16 <= limit; p += 16) {
+            __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n - 1));
+            unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                                                                 _mm_cmpeq_epi8(last, blockLast)));
+            while (mask) {
+                int bit = __builtin_ctz(mask);
+                if (std::memcmp(p + bit + 1, needle.data() + 1, n - 2) == 0) return p + bit;
+                mask &= mask - 1;
+            }
+        }
+        for (; p < limit; ++p) {
+            if (*p == needle[0] && std::memcmp(p, needle.data(), n) == 0) return p;
+        }
+        return nullptr;
+#else
+        return static_cast<const char*>(memmem(begin, end - begin, needle.data(), n));
+#endif
+    }
+
+    // Every match contains all of these, empty when nothing is known
+    std::vector<std::string> requiredLiterals() const {
+        std::vector<std::string> literals = otherLiterals;
+        if (!literal.empty()) literals.push_back(literal);
+        return literals;
+    }
+
+    // Adds the matching lines of data to result, keeps at most maxPerFile of them
+    void searchBuffer(std::string_view data, searchFileResult& result, const searchLimits& limits) const {
+        const char* begin = data.data();
+        const char* end = begin + data.size();
+        // Binary files are skipped, like grep does for a NUL in the first block
+        if (std::memchr(begin, '\0', std::min<size_t>(data.size(), 8192))) return;
+
+        size_t lineNumber = 1;
+        const char* counted = begin;
+        const char* position = begin;
+        while (position < end) {
+            const char* lineBegin;
+            if (!literal.empty()) {
+                const char* hit = findLiteral(position, end, literal);
+                if (!hit) break;
+                lineBegin = hit;
+                while (lineBegin > position && lineBegin[-1] != '\n') --lineBegin;
+            } else {
+                lineBegin = position;
+            }
+            const char* lineEnd = static_cast<const char*>(std::memchr(lineBegin, '\n', end - lineBegin));
+            if (!lineEnd) lineEnd = end;
+
+            if (lineMatches(lineBegin, lineEnd)) {
+                lineNumber += std::count(counted, lineBegin, '\n');
+                counted = lineBegin;
+                if (result.matches.size() < limits.maxPerFile) {
+                    std::string_view text(lineBegin, lineEnd - lineBegin);
+                    if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+                    std::string shown(text.substr(0, limits.maxLineLength));
+                    if (text.size() > limits.maxLineLength) shown += "...";
+                    result.matches.push_back({lineNumber, std::move(shown)});
+                }
+                result.total++;
+            }
+            position = lineEnd + 1;
+        }
+    }
+
+    searchResult run(const std::string& root, const fileWalker& walker, const searchLimits& limits = {}) const {
+        return collect(limits, [&](const std::function<bool(const walkEntry&)>& visit) {
+            walker.walk(root, visit);
+        });
+    }
+
+    // Searches a known list of files, e.g. the candidates from an index
+    searchResult runOn(const std::vector<walkEntry>& files, const searchLimits& limits = {}) const {
+        return collect(limits, [&](const std::function<bool(const walkEntry&)>& visit) {
+            std::atomic<size_t> next{0};
+            std::atomic<bool> stopped{false};
+            auto work = [&]() {
+                for (size_t i = next++; i < files.size() && !stopped; i = next++) {
+                    if (!visit(files[i])) stopped = true;
+                }
+            };
+            std::vector<std::thread> threads;
+            unsigned int threadCount = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+            for (unsigned int i = 1; i < threadCount && i * 16 < files.size(); ++i) {
+                threads.emplace_back(work);
+            }
+            work();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        });
+    }
+
+private:
+    template <typename F>
+    searchResult collect(const searchLimits& limits, F&& forEachFile) const {
+        searchResult result;
+        std::mutex resultMutex;
+        std::atomic<size_t> collected{0};
+        std::atomic<size_t> searched{0};
+        std::atomic<bool> stoppedEarly{false};
+
+        forEachFile([&](const walkEntry& entry) {
+            mappedFile file;
+            if (!file.open(entry.absolutePath, limits.maxFileSize)) return true;
+            searched++;
+            searchFileResult fileResult;
+            fileResult.path = entry.path;
+            searchBuffer(file.view(), fileResult, limits);
+            if (fileResult.total == 0) return true;
+
+            size_t total = collected += fileResult.total;
+            {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                result.files.push_back(std::move(fileResult));
+            }
+            if (total >= limits.maxCollected) {
+                stoppedEarly = true;
+                return false;
+            }
+            return true;
+        });
+
+        std::sort(result.files.begin(), result.files.end(), [](const searchFileResult& a, const searchFileResult& b) {
+            return a.path < b.path;
+        });
+        result.totalMatches = collected;
+        result.filesSearched = searched;
+        result.stoppedEarly = stoppedEarly;
+        return result;
+    }
+
+public:
+
+    // Matches grouped by file, cut to limits.maxMatches lines in total
+    static std::string format(const searchResult& result, const searchLimits& limits = {}) {
+        if (result.files.empty()) {
+            return fmt::format("No matches found in {} files.", result.filesSearched);
+        }
+        std::string output;
+        size_t shown = 0;
+        size_t shownFiles = 0;
+        for (const auto& file : result.files) {
+            if (shown >= limits.maxMatches) break;
+            output += file.path + "\n";
+            size_t count = 0;
+            for (const auto& match : file.matches) {
+                if (shown >= limits.maxMatches) break;
+                output += fmt::format("{}: {}\n", match.line, match.text);
+                ++shown;
+                ++count;
+            }
+            if (count < file.total) {
+                output += fmt::format("... {} more matching lines in this file\n", file.total - count);
+            }
+            output += "\n";
+            ++shownFiles;
+        }
+        if (shownFiles < result.files.size() || result.stoppedEarly) {
+            output += fmt::format("Found {}{} matching lines in {}{} files, showing {} lines from {} files. "
+                "Use a more specific query or search a subdirectory to see the rest.\n",
+                result.stoppedEarly ? "at least " : "", result.totalMatches,
+                result.stoppedEarly ? "at least " : "", result.files.size(), shown, shownFiles);
+        }
+        return output;
+    }
+};
\ No newline at end of file
@@ -17,7 +17,8 @@ private:
             {"type", "ollama"},
             {"endpoint", "http://127.0.0.1:11434"},
             {"api_key", "empty"},
-            {"model", "qwen3"}
+            {"model", "qwen3"},
+            {"native_tools", true}
         }},
         {"logging", {
             {"level", "none"}
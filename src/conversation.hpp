@@ -3,14 +3,25 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <optional>
+#include <chrono>
 #include <spdlog/fmt/fmt.h>
 #include "stringutils.hpp"
 #include "llmclient.hpp"
 #include "tool.hpp"
 #include "agentutils.hpp"
+#include "workerpool.hpp"
+#include "agentloop.hpp"
+#include "tokenizer.hpp"
+#include "summarizer.hpp"
+#include "promptlayout.hpp"
+#include "sessionlog.hpp"
+#include "toolcallscanner.hpp"
 #include "greptool.hpp"
+#include "symboltool.hpp"
 #include "readtool.hpp"
 #include "writetool.hpp"
+#include "edittool.hpp"
 #include "treetool.hpp"
 #include "gittool.hpp"
 #include "rmtool.hpp"
@@ -18,37 +29,132 @@
 class ConversationLLM {
 private:
     std::unique_ptr<LLMClient> client;
-    std::vector<std::pair<std::string, std::string>> activeHistory;
+    messageStore activeHistory;
     std::string systemPrompt;
     std::vector<std::unique_ptr<agentTool>> tools;
+    nlohmann::json toolSchemas = nlohmann::json::array();
+    bool nativeTools = true; // structured tool calling, falls back to JSON in text when unsupported
+    bool nativeToolsWorked = false; // a request with native tools was answered, a 400 no longer means unsupported
     std::function<void(const std::string&)> respCallback;
+    std::function<void(const std::string&)> respStreamCallback;
+    bool answerStreamed = false; // last answer was already shown piece by piece
+    std::vector<nlohmann::json> streamedCalls; // text tool calls found while the last answer streamed in
+    std::unique_ptr<workerPool> toolWorkers = std::make_unique<workerPool>(std::min(8u, std::max(1u, std::thread::hardware_concurrency())));
+    std::shared_ptr<trigramIndex> searchIndex;
+    std::shared_ptr<symbolIndex> symbols;
+    std::unique_ptr<toolResultCache> resultCache = std::make_unique<toolResultCache>(); // repeated read-only calls
+    unsigned int readTokenBudget = 8000; // most one file read may add to the context
     unsigned int maxContext = 0;
+    agentLimits limits;
+    tokenCounter tokens;
+    int promptTokens = -1;            // system prompt and tool schemas, -1 until counted
+    unsigned int reportedTokens = 0;  // context size last reported by the server...
+    size_t reportedMessages = 0;      // ...covering this many history entries
+    std::string conversationSummary;  // replaces the oldest messages, kept as the first history entry
+    size_t droppedMessages = 0;       // messages replaced by conversationSummary
+    std::string preparedSummary;      // finished in the background, swapped in at the limit...
+    size_t preparedCut = 0;           // ...for messages before this position (see absolutePosition)
+    unsigned int historyEpoch = 0;    // bumped when messages covered by pending summaries change
+    unsigned int historyRewrites = 0; // bumped when the history changes anywhere but at its end
+    promptLayout layout;
+    double lastPrefixReuse = 0.0;
+    float summaryLowWater = 0.6f;     // fraction of maxContext at which background summaries start
+    size_t keepRecent = 8;            // newest messages that are never summarized
+    rollingSummarizer summarizer;     // declared after client, its job must finish before client goes away
+    std::vector<std::function<void(const agentStep&)>> stepHooks;
+    std::unique_ptr<sessionLog> session; // saves the conversation as it happens, null when not saved
+    std::string tokenizerPath;           // tokenizer the cached token counts were made with
 
 
 public:
     ConversationLLM()
     {
-
+        refreshSystemPrompt();
     }
 
     void loadDefaultTools()
     {
-        tools.push_back(std::make_unique<grepTool>());
-        tools.push_back(std::make_unique<readFileTool>());
+        tools.push_back(std::make_unique<grepTool>(searchIndex));
+        if (symbols)
+        {
+            tools.push_back(std::make_unique<symbolTool>(symbols));
+        }
+        tools.push_back(std::make_unique<readFileTool>(readTokenBudget, [this](std::string_view text) {
+            return tokens.scaled(tokens.count(text));
+        }));
         tools.push_back(std::make_unique<writeToFileTool>());
+        tools.push_back(std::make_unique<editFileTool>());
         tools.push_back(std::make_unique<directoryTreeTool>());
         tools.push_back(std::make_unique<gitTool>());
         tools.push_back(std::make_unique<rmTool>());
+        updateToolSchemas();
     }
 
     void loadToolsFromFile(const std::string& filename)
     {
         customTool::parseFromFile(filename, tools);
+        updateToolSchemas();
+    }
+
+    void updateToolSchemas()
+    {
+        toolSchemas = nlohmann::json::array();
+        for (const auto& tool : tools)
+        {
+            toolSchemas.push_back(tool->getSchema());
+        }
+        refreshSystemPrompt(); // also drops the cached prompt token count
+    }
+
+    // Used by the grep tool from loadDefaultTools on
+    void setSearchIndex(std::shared_ptr<trigramIndex> index)
+    {
+        searchIndex = std::move(index);
+    }
+
+    // Enables the Find Symbol tool from loadDefaultTools on
+    void setSymbolIndex(std::shared_ptr<symbolIndex> index)
+    {
+        symbols = std::move(index);
+    }
+
+    // Used by the Read File tool from loadDefaultTools on
+    void setReadTokenBudget(unsigned int budget)
+    {
+        readTokenBudget = budget;
+    }
+
+    // Number of read-only tool calls that may run at the same time
+    void setToolWorkers(unsigned int count)
+    {
+        toolWorkers = std::make_unique<workerPool>(std::max(1u, count));
+    }
+
+    void setResultCache(bool enabled)
+    {
+        resultCache = enabled ? std::make_unique<toolResultCache>() : nullptr;
+    }
+
+    void setNativeTools(bool enabled)
+    {
+        nativeTools = enabled;
+        refreshSystemPrompt();
+    }
+
+    void setLimits(const agentLimits& taskLimits)
+    {
+        limits = taskLimits;
+    }
+
+    // Called after every step of a task, e.g. for metrics
+    void addStepHook(std::function<void(const agentStep&)> hook)
+    {
+        stepHooks.push_back(hook);
     }
 
-    auto getConversation()
+    messageList getConversation() const
     {
-        return activeHistory;
+        return activeHistory.snapshot();
     }
 
     void setClient(std::unique_ptr<LLMClient> llmclient)
@@ -61,14 +167,39 @@ public:
         maxContext = newLimit;
     }
 
+    // Older messages are summarized in the background once the context passes lowWater * limit,
+    // the newest keep messages always stay verbatim
+    void setSummaryPolicy(float lowWater, size_t keep)
+    {
+        summaryLowWater = lowWater;
+        keepRecent = keep;
+    }
+
     void setSystemPrompt(const std::string& prompt) {
         systemPrompt = prompt;
+        promptTokens = -1;
+    }
+
+    // HuggingFace tokenizer.json of the model, makes context counting exact instead of estimated
+    bool loadTokenizer(const std::string& path) {
+        bool loaded = tokens.loadTokenizer(path);
+        tokenizerPath = loaded ? path : "";
+        promptTokens = -1;
+        for (auto& msg : activeHistory) {
+            msg.tokenCount = -1;
+        }
+        return loaded;
     }
 
     void setPrintCallback(std::function<void(const std::string&)> callback) {
         respCallback = callback;
     }
 
+    // Receives answer text as it is generated. Pieces are not newline terminated.
+    void setStreamCallback(std::function<void(const std::string&)> callback) {
+        respStreamCallback = callback;
+    }
+
     template <typename... Args>
     void printResponse(fmt::format_string<Args...> format_str, Args&&... args)
     {
@@ -82,26 +213,191 @@ public:
     }
 
     void addUserMessage(const std::string& message) {
-        activeHistory.push_back({"user", message});
+        logMessage(activeHistory.append(messageRole::user, message));
+    }
+
+    void addAssistantMessage(const std::string& message, const nlohmann::json& toolCalls = nlohmann::json::array()) {
+        logMessage(activeHistory.append(messageRole::assistant, message, toolCalls));
+    }
+
+    void addToolMessage(const std::string& callId, const std::string& functionName, const std::string& output) {
+        logMessage(activeHistory.append(messageRole::tool, output, nlohmann::json::array(), callId, functionName));
+    }
+
+    void logMessage(const chatMessage& msg) {
+        if (session) {
+            session->message(msg);
+        }
+    }
+
+    // Saves the conversation from now on
+    void setSession(std::unique_ptr<sessionLog> log) {
+        session = std::move(log);
+    }
+
+    const sessionLog* getSession() const {
+        return session.get();
+    }
+
+    // Continues a saved conversation, `log` goes on recording it
+    void resumeSession(std::unique_ptr<sessionLog> log, restoredSession saved) {
+        activeHistory = std::move(saved.history);
+        conversationSummary = std::move(saved.summary);
+        droppedMessages = saved.droppedMessages;
+        preparedSummary.clear();
+        historyEpoch++;
+        historyRewrites++;
+        reportedTokens = 0;
+        reportedMessages = 0;
+        if (saved.meta.value("tokenizer", "") != tokenizerPath) {
+            for (auto& msg : activeHistory) {
+                msg.tokenCount = -1; // counted with another tokenizer
+            }
+        }
+        session = std::move(log);
+    }
+
+    // Raw token count of one history entry, counted once and cached on the message
+    unsigned int countMessage(size_t index)
+    {
+        chatMessage& msg = activeHistory[index];
+        if (msg.tokenCount < 0)
+        {
+            const unsigned int messageOverhead = 4; // role and separator tokens of the chat template
+            msg.tokenCount = tokens.count(msg.content) + messageOverhead;
+            if (!msg.toolCalls.empty())
+            {
+                msg.tokenCount += tokens.count(msg.toolCalls);
+            }
+            if (session)
+            {
+                session->tokenCount(index, msg.tokenCount);
+            }
+        }
+        return msg.tokenCount;
     }
 
-    void addAssistantMessage(const std::string& message) {
-        activeHistory.push_back({"assistant", message});
+    // Raw token count of the whole request: prompt, tool schemas and history
+    unsigned int countRequest(size_t messages)
+    {
+        if (promptTokens < 0)
+        {
+            promptTokens = tokens.count(systemPrompt);
+            if (nativeTools && !toolSchemas.empty())
+            {
+                promptTokens += tokens.count(toolSchemas.dump());
+            }
+        }
+        unsigned int total = promptTokens;
+        for (size_t i = 0; i < messages && i < activeHistory.size(); ++i)
+        {
+            total += countMessage(i);
+        }
+        return total;
     }
 
+    // Only messages added since the last call are tokenized. When the server reported the
+    // real size of the context, that is the lower bound for the part it covered.
     unsigned int countContext()
     {
-        return stringUtils::countTokensAdvanced(activeHistory);
+        if (activeHistory.size() < reportedMessages)
+        {
+            reportedTokens = 0; // history was rewritten, the report no longer applies
+            reportedMessages = 0;
+        }
+        unsigned int estimate = tokens.scaled(countRequest(activeHistory.size()));
+        unsigned int sinceReport = 0;
+        for (size_t i = reportedMessages; i < activeHistory.size(); ++i)
+        {
+            sinceReport += countMessage(i);
+        }
+        return std::max(estimate, reportedTokens + tokens.scaled(sinceReport));
+    }
+
+    // Ollama reports prompt_eval_count/eval_count (OpenAI usage is mapped to the same fields)
+    void reconcileTokenCount(const nlohmann::json& envelope)
+    {
+        if (!envelope.contains("prompt_eval_count") || !envelope["prompt_eval_count"].is_number())
+        {
+            return;
+        }
+        unsigned int reported = envelope["prompt_eval_count"].get<unsigned int>() + envelope.value("eval_count", 0u);
+        tokens.calibrate(countRequest(activeHistory.size()), reported);
+        reportedTokens = reported;
+        reportedMessages = activeHistory.size();
+        spdlog::debug("Server reported {} context tokens, estimated {}", reported, tokens.scaled(countRequest(activeHistory.size())));
     }
 
     // Get full response and automatically add it to history
-    std::string getResponse() {
-        std::string response = client->chat(activeHistory, systemPrompt);
-        auto json = nlohmann::json::parse(response);
+    // A streamed answer with tools is watched for text tool calls and cut off after them.
+    std::string getResponse(bool stream = false, bool allowTools = true) {
+        chatOptions options;
+        answerStreamed = false;
+        streamedCalls.clear();
+        std::shared_ptr<toolCallScanner> scanner;
+        if (stream && allowTools && !tools.empty()) {
+            scanner = std::make_shared<toolCallScanner>();
+        }
+        if (stream && (respStreamCallback || scanner)) {
+            streamCallback printer = respStreamCallback ? makeTokenPrinter() : nullptr;
+            options.onToken = [printer, scanner](const std::string& piece) {
+                bool keepGoing = scanner ? scanner->feed(piece) : true;
+                if (printer) {
+                    printer(piece);
+                }
+                return keepGoing;
+            };
+        }
+        bool sentTools = allowTools && nativeTools && !toolSchemas.empty();
+        if (sentTools) {
+            options.tools = toolSchemas;
+        }
+
+        messageList request = activeHistory.snapshot();
+        auto reuse = layout.track(request, historyRewrites);
+        lastPrefixReuse = reuse.ratio();
+        spdlog::info("Prompt prefix reuse: {:.1f}% ({} of {} bytes, first changed message {})",
+            100.0 * reuse.ratio(), reuse.reusedBytes, reuse.totalBytes, reuse.firstChangedMessage);
+
+        std::string response = client->chat(request, systemPrompt, options);
+        if (answerStreamed) {
+            respStreamCallback("\n");
+        }
         try 
         {
-            response = json["message"]["content"];
-            addAssistantMessage(response);
+            auto json = nlohmann::json::parse(response);
+            if (json.contains("error"))
+            {
+                // Only a refusal of the tools themselves switches modes, other errors (a crashed runner,
+                // an overflowing context) would otherwise cost the prompt prefix for the rest of the session
+                bool toolsRefused = LLMClient::isToolSupportError(json) ||
+                    (!nativeToolsWorked && json.value("http_status", 0L) == 400);
+                if (sentTools && toolsRefused)
+                {
+                    spdlog::warn("Model does not take native tools ({}), falling back to text tool calls", json["error"].dump());
+                    nativeTools = false;
+                    refreshSystemPrompt();
+                    return getResponse(stream, allowTools);
+                }
+                spdlog::warn("LLMClient returned an error: {}", json["error"].dump());
+            }
+            else if (sentTools)
+            {
+                nativeToolsWorked = true;
+            }
+            const auto& message = json["message"];
+            response = message["content"].is_string() ? message["content"].get<std::string>() : "";
+            if (scanner && scanner->stopped()) {
+                spdlog::info("Stopped generation after {} tool call(s), dropping {} bytes of text after them",
+                    scanner->calls().size(), response.size() - std::min(response.size(), scanner->answer().size()));
+                response = scanner->answer();
+            }
+            if (scanner) {
+                streamedCalls = scanner->calls();
+            }
+            nlohmann::json toolCalls = message.contains("tool_calls") ? message["tool_calls"] : nlohmann::json::array();
+            addAssistantMessage(response, toolCalls);
+            reconcileTokenCount(json);
         }
         catch(...)
         {
@@ -110,25 +406,149 @@ public:
         return response;
     }
 
+    // Native tool calls requested by the last answer, empty if there were none
+    nlohmann::json lastToolCalls() const {
+        if (activeHistory.empty() || activeHistory.back().role != messageRole::assistant) {
+            return nlohmann::json::array();
+        }
+        return activeHistory.back().toolCallsJson();
+    }
+
+    // Shows plain text answers while they are generated. Answers starting with '{' are most
+    // likely tool calls, those are kept quiet and reported once parsed.
+    streamCallback makeTokenPrinter() {
+        auto leading = std::make_shared<std::string>();
+        auto decided = std::make_shared<bool>(false);
+        return [this, leading, decided](const std::string& piece) {
+            if (*decided) {
+                if (answerStreamed) {
+                    respStreamCallback(piece);
+                }
+                return true;
+            }
+            *leading += piece;
+            size_t first = leading->find_first_not_of(" \t\r\n");
+            if (first == std::string::npos) {
+                return true;
+            }
+            *decided = true;
+            if ((*leading)[first] != '{') {
+                answerStreamed = true;
+                respStreamCallback("Agent: " + leading->substr(first));
+            }
+            return true;
+        };
+    }
+
     void clearConversation() {
         activeHistory.clear();
+        conversationSummary.clear();
+        preparedSummary.clear();
+        droppedMessages = 0;
+        historyEpoch++;
+        historyRewrites++;
+        if (session) {
+            session->clear();
+        }
+    }
+
+    size_t firstMessage() const {
+        return conversationSummary.empty() ? 0 : 1;
+    }
+
+    // Summaries refer to messages by their position since the start of the conversation,
+    // so they stay valid while older summaries are swapped in
+    size_t absolutePosition(size_t index) const {
+        return droppedMessages + index - std::min(index, firstMessage());
+    }
+
+    size_t historyIndex(size_t position) const {
+        return position - droppedMessages + firstMessage();
+    }
+
+    // First history entry that is kept when everything before it is summarized, keeping at least
+    // `keep` messages. Tool results stay with the assistant message that requested them.
+    size_t summaryCut(size_t keep) const {
+        if (activeHistory.size() <= firstMessage() + keep) {
+            return firstMessage();
+        }
+        size_t cut = activeHistory.size() - keep;
+        while (cut > firstMessage() && activeHistory[cut].role == messageRole::tool) {
+            cut--;
+        }
+        return cut;
+    }
+
+    // Moves a finished background summary into preparedSummary
+    void collectSummary() {
+        if (!summarizer.ready()) {
+            return;
+        }
+        size_t cut = summarizer.coversUpTo();
+        bool current = summarizer.epoch() == historyEpoch;
+        std::string summary = summarizer.take();
+        if (current && !summary.empty()) {
+            preparedSummary = summary;
+            preparedCut = cut;
+        }
+    }
+
+    // Folds the messages between the last summary and the recent ones into a new summary
+    bool startSummary(size_t keep) {
+        if (!client || summarizer.pending()) {
+            return false;
+        }
+        size_t from = preparedSummary.empty() ? firstMessage() : historyIndex(preparedCut);
+        size_t cut = summaryCut(keep);
+        if (cut <= from) {
+            return false;
+        }
+        messageList segment = activeHistory.snapshot(from, cut);
+        const std::string& previous = preparedSummary.empty() ? conversationSummary : preparedSummary;
+        summarizer.start(*client, segment, previous, absolutePosition(cut), historyEpoch);
+        return true;
     }
 
-    void removeLastAnswer() {
-        if (!activeHistory.empty()) {
-            activeHistory.pop_back();
+    void startBackgroundSummary() {
+        collectSummary();
+        if (summarizer.pending()) {
+            return;
         }
+        startSummary(keepRecent);
     }
 
+    // Replaces the oldest messages with their summary. Uses the summary prepared in the
+    // background when there is one, otherwise waits for (or starts) a summary request.
     void compressConversation() {
         spdlog::info("Compressing conversation");
-        const static std::string compressPrompt = "Condense our conversation into a single, comprehensive text summary"
-        " that captures the core problem, solution approach, and any key technical details or constraints. Focus on the essential"
-        " programming challenge and its proposed resolution. You should absolutely skip tool calling parts too.";
-        addUserMessage(compressPrompt);
-        std::string compressedHistory = getResponse();
-        clearConversation();
-        addAssistantMessage(compressedHistory);
+        collectSummary();
+        if (preparedSummary.empty()) {
+            if (!summarizer.pending() && !startSummary(keepRecent) && !startSummary(1)) {
+                spdlog::warn("Nothing left to summarize, keeping conversation as is");
+                return;
+            }
+            spdlog::info("No summary prepared yet, waiting for it");
+            summarizer.wait();
+            collectSummary();
+            if (preparedSummary.empty()) {
+                spdlog::warn("Summarizing failed, keeping conversation as is");
+                return;
+            }
+        }
+
+        size_t cut = historyIndex(preparedCut);
+        activeHistory.compact(cut, preparedSummary);
+        if (session) {
+            session->compact(cut, preparedSummary, preparedCut);
+        }
+        spdlog::debug("History text after compressing: {} KB in use, {} KB reserved",
+            activeHistory.textBytes() / 1024, activeHistory.reservedBytes() / 1024);
+        conversationSummary = std::move(preparedSummary);
+        preparedSummary.clear();
+        droppedMessages = preparedCut;
+        historyRewrites++;
+        reportedTokens = 0;
+        reportedMessages = 0;
     }
 
     void generateAnalysisFile() {
@@ -145,28 +565,63 @@ IMPORTANT! Write it into vibecpp.md file!
         handleUserInput(prompt);
     }
 
-    void processToolCalling(nlohmann::json completionObj)
+    // Runs a batch of {"tool_name", "parameters"} calls, printing each call and its result
+    std::vector<std::string> runToolCalls(const std::vector<nlohmann::json>& calls)
     {
-        spdlog::debug("LLM requested tool calling");
-        if(agentUtils::isValidToolCall(completionObj, tools))
+        for (const auto& call : calls)
+        {
+            printResponse("Tool call: {}", call.dump());
+        }
+        if (resultCache)
+        {
+            resultCache->nextStep();
+        }
+        std::vector<std::string> outputs = agentUtils::executeToolCalls(calls, tools, *toolWorkers, resultCache.get(), historyRewrites);
+        for (const auto& output : outputs)
         {
-            spdlog::debug("Tool calling request is valid");
-            printResponse("Tool call: {}", completionObj.dump());
-            std::string output = agentUtils::executeToolCall(completionObj, tools);
             printResponse("Tool results: {}", output);
             spdlog::debug("Tool call results: {}", output);
-            spdlog::debug("Giving tool calling result back to an LLM");
-            handleUserInput(output);
         }
-        else
+        return outputs;
+    }
+
+    void processNativeToolCalls(const nlohmann::json& toolCalls)
+    {
+        spdlog::debug("LLM requested {} native tool call(s)", toolCalls.size());
+        std::vector<nlohmann::json> calls;
+        for (const auto& nativeCall : toolCalls)
+        {
+            calls.push_back(agentUtils::fromNativeToolCall(nativeCall, tools));
+        }
+        std::vector<std::string> outputs = runToolCalls(calls);
+        for (size_t i = 0; i < outputs.size(); ++i)
         {
-            spdlog::warn("Tool calling request is invalid");
-            addUserMessage("Unfortunately, I was not able to process this tool call. Incorrect syntax.");
-            handleUserInput("Try again and make sure tool exists and you need it.");
+            addToolMessage(toolCalls[i]["id"], toolCalls[i]["function"]["name"], outputs[i]);
         }
+        spdlog::debug("Giving tool calling results back to an LLM");
     }
 
-    void handleUserInput(const std::string& message) {
+    // Returns the message carrying the results back to the model
+    std::string processToolCalls(const std::vector<nlohmann::json>& calls)
+    {
+        spdlog::debug("LLM requested {} tool call(s)", calls.size());
+        std::vector<std::string> outputs = runToolCalls(calls);
+        std::string output = outputs.front();
+        if (outputs.size() > 1)
+        {
+            // All results go back in one message, numbered in the order of the calls
+            output = fmt::format("Results of {} tool calls:\n", outputs.size());
+            for (size_t i = 0; i < outputs.size(); ++i)
+            {
+                output += fmt::format("\n[{}] {}\n{}\n", i + 1, calls[i].dump(), outputs[i]);
+            }
+        }
+        spdlog::debug("Giving tool calling result back to an LLM");
+        return output;
+    }
+
+    // Compresses the conversation when it grew past the context limit
+    unsigned int prepareContext() {
         unsigned int contextLen = countContext();
         spdlog::info("Context: ~{}K tokens", (float)(contextLen / 1000.f));
 
@@ -177,6 +632,26 @@ IMPORTANT! Write it into vibecpp.md file!
             contextLen = countContext();
             spdlog::info("Context: ~{}K tokens", (float)(contextLen / 1000.f));
         }
+        else if(maxContext > 0 && contextLen > summaryLowWater * maxContext)
+        {
+            startBackgroundSummary();
+        }
+        return contextLen;
+    }
+
+    // The prompt only depends on the tools and the tool calling mode, it is rebuilt when those change
+    void refreshSystemPrompt() {
+        setSystemPrompt(buildSystemPrompt());
+        layout.setHeader(systemPrompt, nativeTools ? toolSchemas : nlohmann::json::array());
+    }
+
+    std::string buildSystemPrompt() const {
+        if (nativeTools && !toolSchemas.empty())
+        {
+            // Tools and their arguments are described by the schemas sent along with the request
+            return "You are coding AI assistant that writes code and call tools when needed. "
+                   "Use the provided tools whenever the user input requires them, otherwise respond normally.";
+        }
 
         std::string handlePrompt = R"(You are coding AI assistant that writes code and call tools when needed. You have access to the following tools:
 TOOLS:)";
@@ -189,7 +664,7 @@ TOOLS:)";
         handlePrompt += R"(
 INSTRUCTIONS:
 1. Analyze the user input carefully
-2. If the user input clearly requires using one of the provided tools, respond with EXACTLY ONE JSON object containing:
+2. If the user input clearly requires using the provided tools, respond with one JSON object per tool call, each containing:
 - "tool_name": exact name from the tool list
 - "parameters": object with required arguments
 3. If no tool is needed, respond normally without JSON
@@ -197,58 +672,132 @@ INSTRUCTIONS:
 5. THE JSON MUST START IMMEDIATELY WITH "{"
 6. DO NOT INCLUDE ANY WORDS LIKE "I'll", "Let me", "First", "I need" before the JSON
 7. DO NOT INCLUDE ANYTHING THAT ISN'T THE TOOL CALL JSON
-8. ONLY MAKE ONE TOOL CALL PER RESPONSE - NEVER MULTIPLE TOOL CALLS AT ONCE. If you need to make multiple calls start with just one first.
+8. CALLS THAT DON'T DEPEND ON EACH OTHER (e.g. reading several files) SHOULD BE MADE IN ONE RESPONSE, ONE JSON OBJECT PER LINE. Results come back together in one message.
 
 EXAMPLE TOOL CALLING RESPONSES:
 {"tool_name": "grep", "parameters": {"query": "TestClass"}}
 {"tool_name": "calculate", "parameters": {"expression": "2+2*3"}}
 
 CRITICAL: NEVER include any text, explanations, or formatting before the JSON response. The response must be pure JSON starting with "{".
-ALWAYS RESPOND WITH EXACTLY ONE TOOL CALL PER RESPONSE.
 )";
+        return handlePrompt;
+    }
 
-        setSystemPrompt(handlePrompt);
-        addUserMessage(message);
-        std::string completion = getResponse();
-        nlohmann::json completionObj = {};
-        if(agentUtils::isToolCalling(completion, completionObj))
-        {
-            processToolCalling(completionObj);
-        }
-        else
+    // Runs one user task to the end: every model answer is a step, tool results are fed back
+    // until the model answers without tool calls or the step budget / deadline is used up.
+    void handleUserInput(const std::string& message) {
+        agentTask task(limits);
+        agentStep step;
+        std::optional<std::string> pendingInput = message;
+        agentState state = agentState::Prepare;
+
+        while (state != agentState::Done)
         {
-            spdlog::info("LLM responded:\n\n{}\n\n", completion);
-            int toolsAmount = std::max(stringUtils::countSubstring(completion, R"({"tool_name":)"), 
-                stringUtils::countSubstring(completion, R"("parameters":)"));
-            if(toolsAmount)
+            switch (state)
+            {
+            case agentState::Prepare:
+                step = agentStep{};
+                step.contextTokens = prepareContext();
+                if (pendingInput)
+                {
+                    addUserMessage(*pendingInput);
+                    pendingInput.reset();
+                }
+                state = agentState::Request;
+                break;
+
+            case agentState::Request:
             {
-                if(toolsAmount > 1)
+                if (task.stepBudgetExhausted())
                 {
-                    spdlog::warn("System detected multiple tool calls in one response, reverting last answer and prompting it to retry");
-                    removeLastAnswer();
-                    handleUserInput("Please respond with only ONE tool call at a time!!!");
+                    printResponse("System: stopped after {} steps, the step limit for one task. Ask to continue if needed.", task.stepCount());
+                    state = agentState::Done;
+                    break;
                 }
-                else
+                if (task.deadlinePassed())
                 {
-                    // This is most likely text + 1 tool call
-                    if(stringUtils::extractJsonWithBraceMatching(completion, completionObj))
-                    {
-                        spdlog::warn("System detected text and tool calling within a single response");
-                        processToolCalling(completionObj);
-                    }
-                    else
-                    {
-                        spdlog::warn("System detected corrupted tool call");
-                        handleUserInput("Please make sure you're calling this tool correctly.");
-                    }
+                    printResponse("System: stopped after {}s, the time limit for one task. Ask to continue if needed.", task.elapsed().count() / 1000);
+                    state = agentState::Done;
+                    break;
                 }
+                step.index = task.nextStep();
+                auto requestStart = std::chrono::steady_clock::now();
+                step.completion = getResponse(true);
+                step.prefixReuse = lastPrefixReuse;
+                step.requestTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - requestStart);
+                state = agentState::Dispatch;
+                break;
             }
-            else
+
+            case agentState::Dispatch:
             {
-                printResponse("Agent: {}", completion);
+                auto toolStart = std::chrono::steady_clock::now();
+                state = dispatch(step, pendingInput);
+                step.toolTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - toolStart);
+                spdlog::debug("Step {}: ~{} context tokens, {:.0f}% prefix reuse, request {} ms, {} tool call(s) {} ms", step.index,
+                    step.contextTokens, 100.0 * step.prefixReuse, step.requestTime.count(), step.toolCalls, step.toolTime.count());
+                for (const auto& hook : stepHooks)
+                {
+                    hook(step);
+                }
+                break;
             }
-            return;
+
+            case agentState::Done:
+                break;
+            }
+        }
+    }
+
+    // Acts on the answer of a step. Tool results are added to the history or left in pendingInput
+    // for the next step, a plain answer is shown and ends the task.
+    agentState dispatch(agentStep& step, std::optional<std::string>& pendingInput) {
+        const std::string& completion = step.completion;
+        nlohmann::json nativeCalls = lastToolCalls();
+        if (!nativeCalls.empty())
+        {
+            step.toolCalls = nativeCalls.size();
+            processNativeToolCalls(nativeCalls);
+            return agentState::Prepare;
+        }
+
+        if (!streamedCalls.empty())
+        {
+            // Already parsed while the answer streamed in
+            step.toolCalls = streamedCalls.size();
+            pendingInput = processToolCalls(streamedCalls);
+            return agentState::Prepare;
         }
 
+        nlohmann::json completionObj = {};
+        if(agentUtils::isToolCalling(completion, completionObj))
+        {
+            step.toolCalls = 1;
+            pendingInput = processToolCalls({completionObj});
+            return agentState::Prepare;
+        }
+
+        spdlog::info("LLM responded:\n\n{}\n\n", completion);
+        std::vector<nlohmann::json> calls = agentUtils::extractToolCalls(completion);
+        if(!calls.empty())
+        {
+            // Several calls, or text and tool calls within a single response
+            spdlog::debug("System detected {} tool call(s) within the response", calls.size());
+            step.toolCalls = calls.size();
+            pendingInput = processToolCalls(calls);
+            return agentState::Prepare;
+        }
+        if(stringUtils::countSubstring(completion, R"({"tool_name":)") ||
+            stringUtils::countSubstring(completion, R"("parameters":)"))
+        {
+            spdlog::warn("System detected corrupted tool call");
+            pendingInput = "Please make sure you're calling this tool correctly.";
+            return agentState::Prepare;
+        }
+        if (!answerStreamed)
+        {
+            printResponse("Agent: {}", completion);
+        }
+        return agentState::Done;
     }
 };
\ No newline at end of file
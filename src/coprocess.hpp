@@ -0,0 +1,219 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <spdlog/spdlog.h>
+#include "cmdexec.hpp"
+
+// One long-running tool process that answers line-delimited requests on stdin/stdout.
+// It talks over a socketpair, so writing to a worker that died gives an error
+// instead of SIGPIPE.
+class coprocess {
+private:
+    pid_t pid = -1;
+    int socket = -1;
+    std::string pending; // bytes read past the last complete line
+
+public:
+    explicit coprocess(const std::vector<std::string>& argv) {
+        int ends[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, ends) != 0) {
+            throw std::runtime_error("socketpair() failed: " + std::string(std::strerror(errno)));
+        }
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, ends[1], STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, ends[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+        posix_spawnattr_t attributes;
+        posix_spawnattr_init(&attributes);
+        sigset_t noSignals, defaultSignals;
+        sigemptyset(&noSignals);
+        sigemptyset(&defaultSignals);
+        sigaddset(&defaultSignals, SIGPIPE);
+        posix_spawnattr_setsigmask(&attributes, &noSignals);
+        posix_spawnattr_setsigdefault(&attributes, &defaultSignals);
+        posix_spawnattr_setpgroup(&attributes, 0);
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+        std::vector<char*> arguments;
+        for (const auto& arg : argv) {
+            arguments.push_back(const_cast<char*>(arg.c_str()));
+        }
+        arguments.push_back(nullptr);
+        int error = posix_spawnp(&pid, arguments[0], &actions, &attributes, arguments.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attributes);
+        close(ends[1]);
+        if (error != 0) {
+            close(ends[0]);
+            throw std::runtime_error("could not start " + argv[0] + ": " + std::strerror(error));
+        }
+        socket = ends[0];
+        spdlog::info("Started tool process {}: {}", pid, fmt::join(argv, " "));
+    }
+
+    coprocess(const coprocess&) = delete;
+    coprocess& operator=(const coprocess&) = delete;
+
+    ~coprocess() {
+        // End of input asks it to stop; whatever is left of the group after a short grace is killed
+        close(socket);
+        for (int i = 0; i < 20 && alive(); ++i) {
+            usleep(10000);
+        }
+        kill(-pid, SIGKILL);
+        int status = 0;
+        waitpid(pid, &status, 0);
+    }
+
+    bool alive() const {
+        siginfo_t info{};
+        return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == 0;
+    }
+
+    bool send(const std::string& line) {
+        size_t written = 0;
+        while (written < line.size()) {
+            ssize_t sent = ::send(socket, line.data() + written, line.size() - written, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return false;
+            written += sent;
+        }
+        return true;
+    }
+
+    // Nothing was written past the last line read, neither buffered nor waiting on the socket
+    bool drained() const {
+        if (!pending.empty()) return false;
+        struct pollfd check = {socket, POLLIN, 0};
+        return poll(&check, 1, 0) == 0;
+    }
+
+    enum class readStatus { complete, closed, timedOut, tooLong };
+
+    // Reads one response line, without the newline
+    readStatus receive(std::string& line, const commandOptions& options) {
+        thread_local std::vector<char> buffer(64 * 1024);
+        auto deadline = std::chrono::steady_clock::now() + options.timeout;
+        while (true) {
+            size_t newline = pending.find('\n');
+            if (newline != std::string::npos) {
+                line.assign(pending, 0, newline);
+                pending.erase(0, newline + 1);
+                return readStatus::complete;
+            }
+            if (pending.size() > options.maxOutput) return readStatus::tooLong;
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0) return readStatus::timedOut;
+            struct pollfd wait = {socket, POLLIN, 0};
+            int ready = poll(&wait, 1, static_cast<int>(remaining.count()));
+            if (ready < 0 && errno != EINTR) return readStatus::closed;
+            if (ready <= 0) continue;
+            ssize_t got = read(socket, buffer.data(), buffer.size());
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return readStatus::closed;
+            pending.append(buffer.data(), got);
+        }
+    }
+};
+
+// Keeps a few idle workers of one persistent custom tool. Calls that run at the same time
+// each get their own worker; a worker that crashed, timed out or wrote more than one line
+// per request is dropped and the next call starts a fresh one.
+class coprocessPool {
+private:
+    std::vector<std::string> argv;
+    size_t maxIdle;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<coprocess>> idle;
+
+    std::unique_ptr<coprocess> acquire(bool& fresh) {
+        // Stopping a worker may wait for it to exit, so dropped ones go after the lock is released
+        std::vector<std::unique_ptr<coprocess>> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!idle.empty()) {
+                auto worker = std::move(idle.back());
+                idle.pop_back();
+                if (!worker->alive()) {
+                    spdlog::warn("Tool process for {} exited while idle, restarting", argv[0]);
+                    dropped.push_back(std::move(worker));
+                } else if (!worker->drained()) {
+                    // Wrote something after its last answer, it would be read as the next one
+                    spdlog::warn("Tool process for {} wrote output nobody asked for, restarting", argv[0]);
+                    dropped.push_back(std::move(worker));
+                } else {
+                    fresh = false;
+                    return worker;
+                }
+            }
+        }
+        fresh = true;
+        return std::make_unique<coprocess>(argv);
+    }
+
+    void release(std::unique_ptr<coprocess> worker) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle.size() < maxIdle) {
+            idle.push_back(std::move(worker));
+        }
+    }
+
+public:
+    coprocessPool(const std::string& commandLine, size_t maxIdle) : maxIdle(std::max<size_t>(1, maxIdle)) {
+        bool needsShell = false;
+        argv = CommandExecutor::splitArguments(commandLine, needsShell);
+        if (needsShell || argv.empty()) {
+            argv = {"/bin/sh", "-c", "exec " + commandLine};
+        }
+    }
+
+    // Sends one request line and returns the response line, or an error text
+    std::string call(const std::string& request, const commandOptions& options = CommandExecutor::defaults()) {
+        std::unique_ptr<coprocess> worker;
+        bool fresh = false;
+        try {
+            worker = acquire(fresh);
+            if (!worker->send(request + "\n")) {
+                // Died between calls without being noticed yet, nothing was delivered
+                if (fresh) return "Error: tool process exited on startup";
+                worker = acquire(fresh);
+                if (!worker->send(request + "\n")) return "Error: tool process exited on startup";
+            }
+        } catch (const std::exception& e) {
+            return std::string("Error: ") + e.what();
+        }
+
+        std::string line;
+        switch (worker->receive(line, options)) {
+        case coprocess::readStatus::complete:
+            // More than one line would be taken as the answer to the next request
+            if (worker->drained()) {
+                release(std::move(worker));
+            } else {
+                spdlog::warn("Tool process for {} wrote more than one line, restarting it", argv[0]);
+            }
+            return line;
+        case coprocess::readStatus::closed:
+            return "Error: tool process exited before answering, it is restarted on the next call";
+        case coprocess::readStatus::timedOut:
+            return fmt::format("Error: tool process did not answer within {:g} s and was killed", options.timeout.count() / 1000.0);
+        case coprocess::readStatus::tooLong:
+            return "Error: tool response exceeded " + std::to_string(options.maxOutput / 1024) + " KB, the process was killed";
+        }
+        return {};
+    }
+};
\ No newline at end of file
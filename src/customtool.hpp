@@ -1,17 +1,64 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <optional>
+#include <regex>
+#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <nlohmann/json.hpp>
-#include <unordered_set>
 #include <filesystem>
 #include <iostream>
 #include "tool.hpp"
 #include "cmdexec.hpp"
-#include <spdlog/fmt/bundled/args.h>
+#include "coprocess.hpp"
+#include "fileevents.hpp"
 
-class JSONObjectFormatter
+// One argument of a custom tool, compiled from its "name: type - description" definition:
+//   name: int | number | string | bool - ...
+//   name: string "word" - ...     a flag, passes "word" when set (name: flag passes "name")
+//   name: enum(a|b|c) - ...       one of the listed values
+struct customArgument
 {
-public:
-    static std::string jsonValueToString(const nlohmann::json &value)
+    enum class kind { string, integer, number, boolean, flag, choice };
+    std::string name;
+    kind type = kind::string;
+    std::string description;
+    std::string flag;
+    std::vector<std::string> choices;
+};
+
+// A custom tool's "format" compiled once into the words of its argv. Each word is literal text
+// and {name} slots; quotes in the format group text into one word and are removed. A slot's
+// value always stays inside its word, so a value can never add arguments or reach a shell.
+// A format whose literal text uses shell syntax (pipes, redirections, $VARIABLES) is also kept
+// as a command line for sh, with each value quoted where its slot is.
+class customTemplate
+{
+private:
+    struct segment
+    {
+        std::string text;          // literal text, or the argument name of a slot
+        bool slot = false;
+        std::string formatSpec;    // "{:>5}" for {name:>5}, empty for none
+        int argument = -1;         // index into arguments, -1 for names not defined there
+        char quote = 0;            // the quote a slot is written in, for the sh command line
+    };
+
+    struct word
+    {
+        std::vector<segment> segments;
+        bool quoted = false;       // kept even when it renders empty
+    };
+
+    std::vector<customArgument> arguments;
+    std::vector<word> words;
+    std::vector<segment> commandLine; // the format as written, for formats that need sh
+    bool shellSyntax = false;
+
+    static std::string scalarText(const nlohmann::json &value)
     {
         switch (value.type())
         {
@@ -26,93 +73,449 @@ public:
         case nlohmann::json::value_t::boolean:
             return value.get<bool>() ? "true" : "false";
         case nlohmann::json::value_t::null:
-            return "null";
-        case nlohmann::json::value_t::array:
-        case nlohmann::json::value_t::object:
-            return value.dump();
+            return "";
         default:
-            return "null";
+            return value.dump();
         }
     }
-    static std::vector<std::string> extractKeys(const std::string &format_str)
+
+    static std::vector<customArgument> parseArguments(const std::string &text)
     {
-        std::vector<std::string> keys;
-        std::unordered_set<std::string> unique_keys;
-        size_t pos = 0;
+        // Every "name: type" pair starts a new argument, its description runs until the next one
+        static const std::regex argumentRegex(R"re((?:^|[,\s])(\w+):\s*(\w+)(\([^)]*\))?\s*(?:"([^"]*)")?[^-,]*-?)re");
+        std::vector<std::smatch> matches;
+        for (auto it = std::sregex_iterator(text.begin(), text.end(), argumentRegex); it != std::sregex_iterator(); ++it)
+        {
+            matches.push_back(*it);
+        }
+        std::vector<customArgument> result;
+        for (size_t i = 0; i < matches.size(); ++i)
+        {
+            const auto &match = matches[i];
+            customArgument argument;
+            argument.name = match[1];
+            std::string type = match[2];
+            size_t descriptionStart = match.position(0) + match.length(0);
+            size_t descriptionEnd = i + 1 < matches.size() ? matches[i + 1].position(0) : text.size();
+            argument.description = text.substr(descriptionStart, descriptionEnd - descriptionStart);
+            argument.description.erase(0, argument.description.find_first_not_of(" "));
+            argument.description.erase(argument.description.find_last_not_of(" ,") + 1);
 
-        while ((pos = format_str.find('{', pos)) != std::string::npos)
+            if (type == "int" || type == "integer")
+                argument.type = customArgument::kind::integer;
+            else if (type == "float" || type == "double" || type == "number")
+                argument.type = customArgument::kind::number;
+            else if (type == "flag" || match[4].matched)
+            {
+                argument.type = customArgument::kind::flag;
+                argument.flag = match[4].matched ? std::string(match[4]) : argument.name;
+            }
+            else if (type == "bool" || type == "boolean")
+                argument.type = customArgument::kind::boolean;
+            else if (type == "enum" && match[3].matched)
+            {
+                argument.type = customArgument::kind::choice;
+                std::string list = match[3].str().substr(1, match[3].length() - 2);
+                size_t start = 0;
+                while (start <= list.size())
+                {
+                    size_t end = std::min(list.find('|', start), list.size());
+                    std::string choice = list.substr(start, end - start);
+                    choice.erase(0, choice.find_first_not_of(" "));
+                    choice.erase(choice.find_last_not_of(" ") + 1);
+                    if (!choice.empty())
+                        argument.choices.push_back(choice);
+                    start = end + 1;
+                }
+            }
+            result.push_back(std::move(argument));
+        }
+        return result;
+    }
+
+    // Checks a value against its argument's type and turns it into text, "" when not set
+    std::optional<std::string> value(const segment &slot, const nlohmann::json &data, std::string &error) const
+    {
+        if (!data.is_object() || !data.contains(slot.text) || data[slot.text].is_null())
+            return "";
+        const nlohmann::json &given = data[slot.text];
+        if (slot.argument < 0)
+            return scalarText(given);
+
+        const customArgument &argument = arguments[slot.argument];
+        std::string text = scalarText(given);
+        switch (argument.type)
+        {
+        case customArgument::kind::integer:
         {
-            size_t end_pos = format_str.find('}', pos);
-            if (end_pos != std::string::npos)
+            if (given.is_number_integer())
+                break;
+            char *end = nullptr;
+            errno = 0;
+            std::strtoll(text.c_str(), &end, 10);
+            if (text.empty() || *end != '\0' || errno != 0)
             {
-                std::string key = format_str.substr(pos + 1, end_pos - pos - 1);
+                error = argument.name + " must be an integer, got " + given.dump();
+                return std::nullopt;
+            }
+            break;
+        }
+        case customArgument::kind::number:
+        {
+            if (given.is_number())
+                break;
+            char *end = nullptr;
+            std::strtod(text.c_str(), &end);
+            if (text.empty() || *end != '\0')
+            {
+                error = argument.name + " must be a number, got " + given.dump();
+                return std::nullopt;
+            }
+            break;
+        }
+        case customArgument::kind::boolean:
+            if (text != "true" && text != "false")
+            {
+                error = argument.name + " must be true or false, got " + given.dump();
+                return std::nullopt;
+            }
+            break;
+        case customArgument::kind::flag:
+            // Set with true or with its word, which is how the arguments text tells models to set it
+            if (text == "false" || text.empty() || text == "0")
+                return "";
+            if (text != "true" && text != argument.flag && text != "1")
+            {
+                error = argument.name + " is a flag, set it to true or leave it out";
+                return std::nullopt;
+            }
+            return argument.flag;
+        case customArgument::kind::choice:
+            if (std::find(argument.choices.begin(), argument.choices.end(), text) == argument.choices.end())
+            {
+                error = argument.name + " must be one of: " + fmt::format("{}", fmt::join(argument.choices, ", ")) + ", got " + given.dump();
+                return std::nullopt;
+            }
+            break;
+        case customArgument::kind::string:
+            break;
+        }
+        if (slot.formatSpec.empty())
+            return text;
+        if (argument.type == customArgument::kind::integer)
+            return fmt::format(fmt::runtime(slot.formatSpec), std::stoll(text));
+        if (argument.type == customArgument::kind::number)
+            return fmt::format(fmt::runtime(slot.formatSpec), std::stod(text));
+        return fmt::format(fmt::runtime(slot.formatSpec), text);
+    }
 
-                // Remove format specifiers (everything after ':')
-                size_t colon_pos = key.find(':');
-                if (colon_pos != std::string::npos)
+public:
+    // Throws std::runtime_error for a format that can't be compiled
+    customTemplate(const std::string &argumentsText, const std::string &format) : arguments(parseArguments(argumentsText))
+    {
+        word current;
+        bool inWord = false;
+        char quote = 0;
+        auto literal = [&](char c) {
+            if (current.segments.empty() || current.segments.back().slot)
+                current.segments.push_back({});
+            current.segments.back().text += c;
+            inWord = true;
+        };
+        auto raw = [&](char c) {
+            if (commandLine.empty() || commandLine.back().slot)
+                commandLine.push_back({});
+            commandLine.back().text += c;
+        };
+        for (size_t i = 0; i < format.size(); ++i)
+        {
+            char c = format[i];
+            if (c != '{' && c != '}')
+                raw(c == '\n' && !quote ? ' ' : c);
+            if ((c == '{' || c == '}') && i + 1 < format.size() && format[i + 1] == c)
+            {
+                literal(c);
+                raw(c);
+                ++i;
+            }
+            else if (c == '{')
+            {
+                size_t end = format.find('}', i);
+                if (end == std::string::npos)
+                    throw std::runtime_error("unclosed '{' in format");
+                std::string name = format.substr(i + 1, end - i - 1);
+                segment slot{name, true, "", -1, quote};
+                size_t colon = name.find(':');
+                if (colon != std::string::npos)
                 {
-                    key = key.substr(0, colon_pos);
+                    slot.text = name.substr(0, colon);
+                    slot.formatSpec = "{:" + name.substr(colon + 1) + "}";
                 }
-
-                if (!key.empty() && unique_keys.find(key) == unique_keys.end())
+                if (slot.text.empty())
+                    throw std::runtime_error("empty {} in format, arguments are placed by name");
+                for (size_t a = 0; a < arguments.size(); ++a)
                 {
-                    unique_keys.insert(key);
-                    keys.push_back(key);
+                    if (arguments[a].name == slot.text)
+                        slot.argument = static_cast<int>(a);
                 }
-                pos = end_pos + 1;
+                commandLine.push_back(slot);
+                current.segments.push_back(std::move(slot));
+                inWord = true;
+                i = end;
+            }
+            else if (c == '}')
+                throw std::runtime_error("unmatched '}' in format, write '}}' for a literal one");
+            else if (quote)
+            {
+                if (c == quote)
+                    quote = 0;
+                else
+                {
+                    if (quote == '"' && (c == '$' || c == '`'))
+                        shellSyntax = true;
+                    literal(c);
+                }
+            }
+            else if (c == '\'' || c == '"')
+            {
+                quote = c;
+                current.quoted = inWord = true;
+            }
+            else if (c == ' ' || c == '\t' || c == '\n')
+            {
+                if (inWord)
+                    words.push_back(std::move(current));
+                current = {};
+                inWord = false;
             }
             else
             {
-                break;
+                // The same characters that make a realCommand go through sh
+                if (std::strchr("|&;<>()$`*?[", c) || ((c == '~' || c == '#') && !inWord))
+                    shellSyntax = true;
+                literal(c);
             }
         }
+        if (quote)
+            throw std::runtime_error("unclosed quote in format");
+        if (inWord)
+            words.push_back(std::move(current));
+    }
 
-        return keys;
+    const std::vector<customArgument> &getArguments() const
+    {
+        return arguments;
+    }
+
+    bool needsShell() const
+    {
+        return shellSyntax;
     }
-    static std::string format(const std::string &format_str, const nlohmann::json &data)
+
+    // The argv words for one call, or nothing with error set when a value doesn't fit its type
+    std::optional<std::vector<std::string>> render(const nlohmann::json &data, std::string &error) const
     {
-        auto requiredKeys = extractKeys(format_str);
-        fmt::dynamic_format_arg_store<fmt::format_context> store;
-        for(const auto& key : requiredKeys)
+        std::vector<std::string> argv;
+        argv.reserve(words.size());
+        for (const auto &current : words)
         {
-            // if not found - replace with empty placeholder
-            store.push_back(fmt::arg(key.c_str(), data.contains(key) ? jsonValueToString(data[key]) : ""));
+            std::string text;
+            for (const auto &piece : current.segments)
+            {
+                if (!piece.slot)
+                {
+                    text += piece.text;
+                    continue;
+                }
+                auto rendered = value(piece, data, error);
+                if (!rendered)
+                    return std::nullopt;
+                text += *rendered;
+            }
+            // An unset optional argument leaves no empty word behind
+            if (!text.empty() || current.quoted)
+                argv.push_back(std::move(text));
         }
-        return fmt::vformat(format_str, store);
+        return argv;
+    }
+
+    // The format as an sh command line: literal text as written, each value quoted on its own.
+    // A value inside quotes closes them around itself, "a{x}b" becomes "a"'value'"b".
+    std::optional<std::string> renderCommandLine(const nlohmann::json &data, std::string &error) const
+    {
+        std::string line;
+        for (const auto &piece : commandLine)
+        {
+            if (!piece.slot)
+            {
+                line += piece.text;
+                continue;
+            }
+            auto rendered = value(piece, data, error);
+            if (!rendered)
+                return std::nullopt;
+            if (piece.quote)
+                line += piece.quote + CommandExecutor::quoteArgument(*rendered) + piece.quote;
+            else if (!rendered->empty())
+                line += CommandExecutor::quoteArgument(*rendered);
+        }
+        return line;
     }
 };
 
 class customTool : public agentTool
 {
 private:
-    std::string callFormat = {};
-    bool multiArg = false;
+    std::shared_ptr<const customTemplate> compiled; // shared by all clones
+    std::vector<std::string> commandPrefix;         // realCommand split into words, empty when it needs sh
+    bool readOnly = false;
+    std::shared_ptr<coprocessPool> workers; // persistent tools only, shared by all clones
+
+    // A response line is {"output": ...} or {"error": ...}, a JSON string, or plain text
+    static std::string responseText(const std::string &line)
+    {
+        nlohmann::json response = nlohmann::json::parse(line, nullptr, false);
+        if (response.is_object())
+        {
+            auto text = [](const nlohmann::json &value) { return value.is_string() ? value.get<std::string>() : value.dump(); };
+            if (response.contains("error") && !response["error"].is_null())
+                return "Error: " + text(response["error"]);
+            if (response.contains("output"))
+                return text(response["output"]);
+        }
+        if (response.is_string())
+            return response.get<std::string>();
+        return line;
+    }
 
 public:
+    // Throws std::runtime_error when the format can't be compiled
     customTool(const std::string &name, const std::string &description,
-               const std::string &arguments, const std::string &realCommand, const std::string &format)
-        : agentTool(name, description, arguments, realCommand), callFormat(format) {}
+               const std::string &arguments, const std::string &realCommand, const std::string &format,
+               bool isReadOnly = false, size_t persistentWorkers = 0)
+        : agentTool(name, description, "JSON OBJECT named \"command\" with following members: " + arguments, realCommand),
+          compiled(std::make_shared<customTemplate>(arguments, format)), readOnly(isReadOnly)
+    {
+        bool needsShell = false;
+        commandPrefix = CommandExecutor::splitArguments(realCommand, needsShell);
+        if (needsShell)
+            commandPrefix.clear();
+        if (persistentWorkers > 0)
+            workers = std::make_shared<coprocessPool>(realCommand, persistentWorkers);
+    }
+
+    bool isReadOnly() const override
+    {
+        return readOnly;
+    }
+
+    nlohmann::json getParametersSchema() const override
+    {
+        nlohmann::json properties = nlohmann::json::object();
+        for (const auto &argument : compiled->getArguments())
+        {
+            nlohmann::json property = {{"description", argument.description}};
+            switch (argument.type)
+            {
+            case customArgument::kind::integer:
+                property["type"] = "integer";
+                break;
+            case customArgument::kind::number:
+                property["type"] = "number";
+                break;
+            case customArgument::kind::boolean:
+            case customArgument::kind::flag:
+                property["type"] = "boolean";
+                break;
+            case customArgument::kind::choice:
+                property["type"] = "string";
+                property["enum"] = argument.choices;
+                break;
+            case customArgument::kind::string:
+                property["type"] = "string";
+                break;
+            }
+            properties[argument.name] = std::move(property);
+        }
+        // Members left out are rendered as nothing
+        nlohmann::json members = {{"type", "object"}, {"properties", properties}, {"required", nlohmann::json::array()}};
+        return {
+            {"type", "object"},
+            {"properties", {{"command", members}}},
+            {"required", {"command"}}
+        };
+    }
 
     std::unique_ptr<agentTool> clone() const override
     {
         return std::make_unique<customTool>(*this);
     }
 
-    std::string executeFormatted(const std::string &command)
+    std::string executeWith(const nlohmann::json &commandJson)
     {
-        nlohmann::json commandJson = nlohmann::json::parse(command);
-        std::string finalCommand = realCommand + " " + JSONObjectFormatter::format(callFormat, commandJson);
-        std::string output = CommandExecutor::executeSingleArg(finalCommand);
+        std::string error;
+        auto argv = compiled->render(commandJson, error);
+        if (!argv)
+            return "Error: " + error;
+        std::string output = run(*argv, commandJson);
+        if (!readOnly)
+        {
+            // No telling what it wrote, cached results and indexes of the project are checked again
+            fileEvents::instance().changed(".");
+        }
         return output;
     }
 
+private:
+    std::string run(const std::vector<std::string> &argv, const nlohmann::json &commandJson)
+    {
+        if (workers)
+        {
+            nlohmann::json request = {
+                {"arguments", commandJson},
+                {"command", fmt::format("{}", fmt::join(argv, " "))}
+            };
+            return responseText(workers->call(request.dump()));
+        }
+        if (compiled->needsShell())
+        {
+            std::string error;
+            auto line = compiled->renderCommandLine(commandJson, error);
+            if (!line)
+                return "Error: " + error;
+            return CommandExecutor::runCommandLine(realCommand + " " + *line).describe(CommandExecutor::defaults());
+        }
+        if (commandPrefix.empty())
+        {
+            // realCommand uses shell syntax, only the quoted arguments are added to it
+            std::string commandLine = realCommand;
+            for (const auto &arg : argv)
+                commandLine += " " + CommandExecutor::quoteArgument(arg);
+            return CommandExecutor::runCommandLine(commandLine).describe(CommandExecutor::defaults());
+        }
+        std::vector<std::string> fullArgv = commandPrefix;
+        fullArgv.insert(fullArgv.end(), argv.begin(), argv.end());
+        return CommandExecutor::run(fullArgv).describe(CommandExecutor::defaults());
+    }
+
+public:
     std::string executeImpl(const std::string &params) override
     {
         try
         {
             nlohmann::json paramJson = nlohmann::json::parse(params);
-            std::string command = paramJson.contains("command") ? paramJson["command"].dump() : "";
-            return executeFormatted(command);
+            if (!paramJson.contains("command"))
+                return "Error: missing \"command\" object";
+            const nlohmann::json &command = paramJson["command"];
+            if (command.is_string())
+            {
+                // Some models send the object as a JSON string
+                nlohmann::json inner = nlohmann::json::parse(command.get<std::string>(), nullptr, false);
+                if (!inner.is_object())
+                    return "Error: \"command\" must be an object with the tool's arguments";
+                return executeWith(inner);
+            }
+            return executeWith(command);
         }
         catch (const std::exception &e)
         {
@@ -140,6 +543,8 @@ public:
                 std::string arguments = toolJson.value("arguments", "");
                 std::string realCommand = toolJson.value("realCommand", "");
                 std::string formatting = toolJson.value("format", "");
+                bool readOnly = toolJson.value("readonly", false);
+                size_t persistentWorkers = toolJson.value("persistent", false) ? std::max(1u, toolJson.value("workers", 2u)) : 0;
 
                 if (name.empty() || description.empty() || realCommand.empty() || formatting.empty())
                 {
@@ -147,11 +552,16 @@ public:
                     continue;
                 }
 
-                arguments = "JSON OBJECT named \"command\" with following members: " + arguments;
-
+                try
+                {
+                    tools.push_back(std::make_unique<customTool>(name, description, arguments, realCommand, formatting, readOnly, persistentWorkers));
+                }
+                catch (const std::runtime_error &e)
+                {
+                    spdlog::error("Skipping tool {}: {}", name, e.what());
+                    continue;
+                }
                 spdlog::info("Registered custom tool: {}", name);
-
-                tools.push_back(std::make_unique<customTool>(name, description, arguments, realCommand, formatting));
             }
         }
         catch (const std::exception &e)
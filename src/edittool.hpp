@@ -0,0 +1,371 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <fstream>
+#include <filesystem>
+#include <regex>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tool.hpp"
+#include "fileevents.hpp"
+
+// One change to a file: the lines to find and the lines that replace them
+struct patchHunk {
+    std::vector<std::string> oldLines;
+    std::vector<std::string> newLines;
+    size_t lineHint = 0;        // where a unified diff says the old lines start, 1-based, 0 if unknown
+    size_t leadingContext = 0;  // unchanged lines at the start and end, a diff may be applied without them
+    size_t trailingContext = 0;
+};
+
+// Applies search/replace blocks or unified diffs, so changing a few lines doesn't mean
+// generating the whole file again. Whitespace differences and stale diff context are
+// tolerated; nothing is written unless every hunk applies, and then in one rename.
+class editFileTool : public agentTool {
+private:
+    enum matchLevel { exact, trailingSpace, indentation, levels };
+
+    struct placement {
+        size_t position;     // index of the first matched line
+        matchLevel level;
+        size_t droppedFront; // context lines left out of the match
+        size_t droppedBack;
+    };
+
+    // Lines keep their own ending, so an edit to a file with mixed endings only touches the changed lines
+    struct fileText {
+        std::vector<std::string> lines;
+        std::vector<bool> crlf; // per line, ends with \r\n
+        bool finalNewline = true;
+        bool allCrlf = false;   // every line ends with \r\n, so new lines do too
+
+        void replace(size_t position, size_t count, const std::vector<std::string>& replacement) {
+            // New lines end like the first line they replace
+            bool ending = count > 0 ? crlf[position] : allCrlf;
+            lines.erase(lines.begin() + position, lines.begin() + position + count);
+            lines.insert(lines.begin() + position, replacement.begin(), replacement.end());
+            crlf.erase(crlf.begin() + position, crlf.begin() + position + count);
+            crlf.insert(crlf.begin() + position, replacement.size(), ending);
+        }
+    };
+
+    static std::vector<std::string> splitLines(std::string_view text, std::vector<bool>* crlf = nullptr) {
+        std::vector<std::string> lines;
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find('\n', start);
+            if (end == std::string_view::npos) end = text.size();
+            std::string_view line = text.substr(start, end - start);
+            bool carriageReturn = !line.empty() && line.back() == '\r';
+            if (carriageReturn) line.remove_suffix(1);
+            lines.emplace_back(line);
+            if (crlf) crlf->push_back(carriageReturn);
+            start = end + 1;
+        }
+        return lines;
+    }
+
+    static std::string join(const fileText& file) {
+        std::string text;
+        for (size_t i = 0; i < file.lines.size(); ++i) {
+            text += file.lines[i];
+            if (i + 1 < file.lines.size() || file.finalNewline) text += file.crlf[i] ? "\r\n" : "\n";
+        }
+        return text;
+    }
+
+    static std::string_view normalized(std::string_view line, matchLevel level) {
+        if (level >= trailingSpace) {
+            size_t end = line.find_last_not_of(" \t");
+            line = end == std::string_view::npos ? std::string_view() : line.substr(0, end + 1);
+        }
+        if (level >= indentation) {
+            size_t start = line.find_first_not_of(" \t");
+            line = start == std::string_view::npos ? std::string_view() : line.substr(start);
+        }
+        return line;
+    }
+
+    static std::string_view leadingSpace(std::string_view line) {
+        size_t start = line.find_first_not_of(" \t");
+        return line.substr(0, start == std::string_view::npos ? line.size() : start);
+    }
+
+    static bool matchesAt(const std::vector<std::string>& lines, const std::vector<std::string>& wanted,
+                          size_t first, size_t count, size_t position, matchLevel level) {
+        for (size_t i = 0; i < count; ++i) {
+            if (normalized(lines[position + i], level) != normalized(wanted[first + i], level)) return false;
+        }
+        return true;
+    }
+
+    // <<<<<<< SEARCH / ======= / >>>>>>> REPLACE blocks, nullopt without any
+    static std::optional<std::vector<patchHunk>> parseBlocks(const std::vector<std::string>& lines) {
+        std::vector<patchHunk> hunks;
+        enum { outside, search, replace } state = outside;
+        for (const auto& line : lines) {
+            if (state == outside && line.starts_with("<<<<<<<")) {
+                hunks.emplace_back();
+                state = search;
+            } else if (state == search && line.starts_with("=======")) {
+                state = replace;
+            } else if (state == replace && line.starts_with(">>>>>>>")) {
+                state = outside;
+            } else if (state == search) {
+                hunks.back().oldLines.push_back(line);
+            } else if (state == replace) {
+                hunks.back().newLines.push_back(line);
+            }
+        }
+        if (hunks.empty()) return std::nullopt;
+        if (state != outside) throw std::runtime_error("unterminated search/replace block, end it with >>>>>>> REPLACE");
+        return hunks;
+    }
+
+    static std::optional<std::vector<patchHunk>> parseUnifiedDiff(const std::vector<std::string>& lines) {
+        static const std::regex header(R"(^@@ -(\d+)(?:,(\d+))? \+(\d+)(?:,(\d+))? @@.*)");
+        std::vector<patchHunk> hunks;
+        bool changed = false; // a hunk's trailing context only counts after its last change
+        for (size_t i = 0; i < lines.size(); ++i) {
+            const std::string& line = lines[i];
+            std::smatch match;
+            if (line.starts_with("@@")) {
+                hunks.emplace_back();
+                if (std::regex_match(line, match, header)) {
+                    hunks.back().lineHint = std::stoul(match[1]);
+                    // "-12,0" inserts after line 12
+                    if (match[2].matched && std::stoul(match[2]) == 0) hunks.back().lineHint++;
+                }
+                changed = false;
+                continue;
+            }
+            if (hunks.empty() || line.starts_with("\\")) continue;
+            if (line.starts_with("--- ") && i + 1 < lines.size() && lines[i + 1].starts_with("+++ ")) {
+                ++i;
+                continue;
+            }
+            patchHunk& hunk = hunks.back();
+            char kind = line.empty() ? ' ' : line[0];
+            std::string text = line.empty() ? "" : line.substr(1);
+            if (kind == ' ') {
+                hunk.oldLines.push_back(text);
+                hunk.newLines.push_back(text);
+                if (changed) hunk.trailingContext++;
+                else hunk.leadingContext++;
+            } else if (kind == '-' || kind == '+') {
+                (kind == '-' ? hunk.oldLines : hunk.newLines).push_back(text);
+                changed = true;
+                hunk.trailingContext = 0;
+            }
+        }
+        if (hunks.empty()) return std::nullopt;
+        return hunks;
+    }
+
+    // Finds where a hunk applies: exact first, then ignoring whitespace, then without outer context
+    static std::optional<placement> locate(const std::vector<std::string>& lines, const patchHunk& hunk,
+                                           long long lineShift, std::string& problem) {
+        const auto& wanted = hunk.oldLines;
+        size_t maxFront = std::min<size_t>(hunk.leadingContext, 2);
+        size_t maxBack = std::min<size_t>(hunk.trailingContext, 2);
+        for (size_t dropped = 0; dropped <= maxFront + maxBack; ++dropped) {
+            for (size_t front = std::min(dropped, maxFront); front + maxBack >= dropped; --front) {
+                size_t back = dropped - front;
+                size_t count = wanted.size() - front - back;
+                if (count == 0 || count > lines.size()) {
+                    if (front == 0) break;
+                    continue;
+                }
+                for (int level = exact; level < levels; ++level) {
+                    std::vector<size_t> found;
+                    for (size_t position = 0; position + count <= lines.size(); ++position) {
+                        if (matchesAt(lines, wanted, front, count, position, static_cast<matchLevel>(level))) {
+                            found.push_back(position);
+                        }
+                    }
+                    if (found.empty()) continue;
+                    size_t best = found[0];
+                    if (found.size() > 1) {
+                        if (hunk.lineHint == 0) {
+                            problem = "matches " + std::to_string(found.size()) + " places (lines " + std::to_string(found[0] + 1) +
+                                " and " + std::to_string(found[1] + 1) + (found.size() > 2 ? ", ..." : "") + "), include more surrounding lines";
+                            return std::nullopt;
+                        }
+                        // The one closest to where the diff says it is
+                        long long expected = static_cast<long long>(hunk.lineHint) - 1 + lineShift + static_cast<long long>(front);
+                        for (size_t position : found) {
+                            if (std::llabs(static_cast<long long>(position) - expected) < std::llabs(static_cast<long long>(best) - expected)) {
+                                best = position;
+                            }
+                        }
+                    }
+                    return placement{best, static_cast<matchLevel>(level), front, back};
+                }
+                if (front == 0) break;
+            }
+        }
+        problem = "was not found";
+        return std::nullopt;
+    }
+
+    // Shows the model what is really there, so it can fix the hunk without reading the file
+    static std::string closestMatch(const std::vector<std::string>& lines, const std::vector<std::string>& wanted) {
+        size_t bestPosition = 0;
+        size_t bestScore = 0;
+        for (size_t position = 0; position < lines.size(); ++position) {
+            size_t score = 0;
+            for (size_t i = 0; i < wanted.size() && position + i < lines.size(); ++i) {
+                if (normalized(lines[position + i], indentation) == normalized(wanted[i], indentation)) ++score;
+            }
+            if (score > bestScore) {
+                bestScore = score;
+                bestPosition = position;
+            }
+        }
+        if (bestScore == 0) return "";
+        std::string result = "; closest is line " + std::to_string(bestPosition + 1) + " where " + std::to_string(bestScore) +
+            " of " + std::to_string(wanted.size()) + " lines match, the file has there:\n";
+        for (size_t i = bestPosition; i < std::min(lines.size(), bestPosition + wanted.size() + 2); ++i) {
+            result += lines[i] + "\n";
+        }
+        return result;
+    }
+
+    static void writeAtomically(const std::string& path, const std::string& content, const struct stat* original) {
+        std::string target = path;
+        if (original) {
+            // Replace the file a symlink points to, not the link
+            target = std::filesystem::canonical(path).string();
+        }
+        std::string temporary = target + ".edit-" + std::to_string(getpid());
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) throw std::runtime_error("could not create " + temporary);
+            file << content;
+            file.close();
+            if (!file) {
+                std::remove(temporary.c_str());
+                throw std::runtime_error("could not write " + temporary);
+            }
+        }
+        if (original) chmod(temporary.c_str(), original->st_mode & 07777);
+        if (std::rename(temporary.c_str(), target.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            throw std::runtime_error("could not replace " + target);
+        }
+    }
+
+public:
+    editFileTool() : agentTool(
+        "Edit File",
+        R"(Changes part of a file without rewriting all of it, prefer it to Write to File for existing files.
+        patch is one or more blocks of: a line <<<<<<< SEARCH, the exact current lines, a line =======, the new lines, a line >>>>>>> REPLACE.
+        A unified diff works too. Either every change applies or the file is left alone)",
+        "file_path: string - path to the file to change, patch: string - search/replace blocks or a unified diff",
+        "patch (in process)"
+    ) {}
+
+    std::unique_ptr<agentTool> clone() const override {
+        return std::make_unique<editFileTool>(*this);
+    }
+
+    std::string executeImpl(const std::string& params) override {
+        try {
+            auto jsonParams = nlohmann::json::parse(params);
+            std::string filePath = jsonParams["file_path"];
+            std::string patch = jsonParams["patch"];
+
+            auto patchLines = splitLines(patch);
+            auto hunks = parseBlocks(patchLines);
+            if (!hunks) hunks = parseUnifiedDiff(patchLines);
+            if (!hunks) {
+                return "Error: patch has no <<<<<<< SEARCH blocks and no @@ diff hunks";
+            }
+
+            fileText file;
+            struct stat info;
+            bool exists = stat(filePath.c_str(), &info) == 0;
+            if (exists) {
+                std::ifstream in(filePath, std::ios::binary);
+                if (!in.is_open()) return "Error: Could not open file " + filePath;
+                std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                file.lines = splitLines(text, &file.crlf);
+                file.finalNewline = text.empty() || text.back() == '\n';
+                // A last line without a newline has no ending to go by
+                size_t ended = file.finalNewline ? file.crlf.size() : file.crlf.size() - 1;
+                file.allCrlf = ended > 0 && std::all_of(file.crlf.begin(), file.crlf.begin() + ended, [](bool crlf) { return crlf; });
+                if (!file.finalNewline) file.crlf.back() = file.allCrlf; // in case lines are added after it
+            }
+
+            if (!exists && std::any_of(hunks->begin(), hunks->end(), [](const patchHunk& hunk) { return !hunk.oldLines.empty(); })) {
+                return "Error: " + filePath + " does not exist";
+            }
+
+            std::string report;
+            long long lineShift = 0; // how far earlier hunks moved the lines of later ones
+            for (size_t index = 0; index < hunks->size(); ++index) {
+                patchHunk& hunk = (*hunks)[index];
+                std::string label = hunks->size() > 1 ? "hunk " + std::to_string(index + 1) : "the change";
+                if (hunk.oldLines.empty()) {
+                    // Pure insertion: a new file, or a zero-context diff hunk at its line
+                    if (!file.lines.empty() && hunk.lineHint == 0) {
+                        return "Error: " + label + " has nothing to search for, only a new or empty file can be written that way";
+                    }
+                    size_t at = std::min(file.lines.size(), static_cast<size_t>(std::max(0LL, static_cast<long long>(hunk.lineHint) - 1 + lineShift)));
+                    file.replace(at, 0, hunk.newLines);
+                    lineShift += hunk.newLines.size();
+                    report += "\n  inserted " + std::to_string(hunk.newLines.size()) + " lines at line " + std::to_string(at + 1);
+                    continue;
+                }
+
+                std::string problem;
+                auto place = locate(file.lines, hunk, lineShift, problem);
+                if (!place) {
+                    std::string result = "Error: " + label + " " + problem + ", nothing was changed";
+                    if (problem == "was not found") result += closestMatch(file.lines, hunk.oldLines);
+                    return result;
+                }
+
+                // Context lines are in both old and new lines, so drop them from both
+                std::vector<std::string> replacement(hunk.newLines.begin() + place->droppedFront, hunk.newLines.end() - place->droppedBack);
+                size_t count = hunk.oldLines.size() - place->droppedFront - place->droppedBack;
+                if (place->level == indentation) {
+                    // Same code at a different depth, move the new lines to where the old ones are
+                    std::string_view wantedIndent, actualIndent;
+                    for (size_t i = 0; i < count; ++i) {
+                        if (!normalized(file.lines[place->position + i], indentation).empty()) {
+                            wantedIndent = leadingSpace(hunk.oldLines[place->droppedFront + i]);
+                            actualIndent = leadingSpace(file.lines[place->position + i]);
+                            break;
+                        }
+                    }
+                    std::string from(wantedIndent), to(actualIndent);
+                    for (auto& line : replacement) {
+                        if (line.starts_with(from)) line = to + line.substr(from.size());
+                    }
+                }
+                file.replace(place->position, count, replacement);
+                lineShift += static_cast<long long>(replacement.size()) - static_cast<long long>(count);
+
+                report += "\n  lines " + std::to_string(place->position + 1) + "-" + std::to_string(place->position + count) +
+                    ": -" + std::to_string(count) + " +" + std::to_string(replacement.size());
+                if (place->level == trailingSpace) report += " (trailing whitespace ignored)";
+                if (place->level == indentation) report += " (indentation adjusted)";
+                if (place->droppedFront + place->droppedBack > 0) {
+                    size_t dropped = place->droppedFront + place->droppedBack;
+                    report += " (" + std::to_string(dropped) + (dropped == 1 ? " context line" : " context lines") + " did not match)";
+                }
+            }
+
+            writeAtomically(filePath, join(file), exists ? &info : nullptr);
+            fileEvents::instance().changed(filePath);
+            return std::string(exists ? "Edited " : "Created ") + filePath + ", " + std::to_string(hunks->size()) +
+                (hunks->size() == 1 ? " change:" : " changes:") + report;
+        } catch (const std::exception& e) {
+            return "Error: " + std::string(e.what());
+        }
+    }
+};
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <filesystem>
+#include <algorithm>
+
+// Tools that change files report them here, so indexes and caches built from the file
+// system can update what changed instead of rescanning everything.
+class fileEvents {
+public:
+    // Receives the absolute path of a file or directory that was written, created or removed
+    using listener = std::function<void(const std::string&)>;
+
+private:
+    std::mutex listenerMutex;
+    std::vector<std::pair<size_t, listener>> listeners;
+    size_t nextId = 1;
+
+public:
+    static fileEvents& instance() {
+        // Never destroyed, listeners may unsubscribe during static destruction
+        static fileEvents* events = new fileEvents;
+        return *events;
+    }
+
+    size_t subscribe(listener onChange) {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        listeners.emplace_back(nextId, std::move(onChange));
+        return nextId++;
+    }
+
+    void unsubscribe(size_t id) {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        listeners.erase(std::remove_if(listeners.begin(), listeners.end(),
+            [id](const auto& entry) { return entry.first == id; }), listeners.end());
+    }
+
+    // Absolute, without "." / ".." parts or a trailing slash, the form listeners receive
+    static std::string normalize(const std::string& path) {
+        std::error_code ec;
+        std::string absolutePath = std::filesystem::absolute(path, ec).lexically_normal().string();
+        if (ec) return {};
+        while (absolutePath.size() > 1 && absolutePath.back() == '/') {
+            absolutePath.pop_back();
+        }
+        return absolutePath;
+    }
+
+    void changed(const std::string& path) {
+        std::string absolutePath = normalize(path);
+        if (absolutePath.empty()) return;
+        std::vector<listener> current;
+        {
+            std::lock_guard<std::mutex> lock(listenerMutex);
+            for (const auto& entry : listeners) {
+                current.push_back(entry.second);
+            }
+        }
+        for (const auto& onChange : current) {
+            onChange(absolutePath);
+        }
+    }
+};
\ No newline at end of file
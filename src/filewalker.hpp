@@ -0,0 +1,289 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <filesystem>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ignorerules.hpp"
+
+struct walkEntry {
+    std::string path;         // as shown to the user: the walk root joined with the relative path
+    std::string relativePath; // relative to the walk root
+    std::string absolutePath;
+};
+
+// Lists the files below a directory on several threads, skipping what git ignores.
+// Each thread owns a deque of pending work: it takes from the back of its own deque and,
+// when that runs dry, steals from the front of another thread's, so one huge subtree
+// doesn't leave the other threads idle.
+// .git, symbolic links and nested repositories (submodules, vendored checkouts) are skipped.
+class fileWalker {
+private:
+    static constexpr size_t filesPerTask = 128;
+
+    // Either a directory to list or a batch of files from one directory
+    struct task {
+        std::string relativeDirectory;
+        std::vector<std::string> files;
+        std::shared_ptr<const ignoreChain> ignores;
+    };
+
+    struct workQueue {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    struct walkState {
+        std::string root;
+        std::string absoluteRoot;
+        std::vector<std::unique_ptr<workQueue>> queues;
+        std::atomic<size_t> pending{0};
+        std::atomic<bool> stopped{false};
+        const std::function<bool(const walkEntry&)>* onFile = nullptr;
+        const std::function<void(const std::string&)>* onDirectory = nullptr;
+    };
+
+    unsigned int threadCount;
+    bool skipNestedRepositories = true;
+
+    static bool exists(const std::string& path) {
+        return access(path.c_str(), F_OK) == 0;
+    }
+
+    // .gitignore files between the repository root and the walk root also apply
+    static std::shared_ptr<const ignoreChain> ancestorRules(const std::string& absoluteRoot) {
+        std::vector<std::string> directories;
+        std::filesystem::path current = absoluteRoot;
+        std::string repositoryRoot;
+        while (true) {
+            directories.push_back(current.string());
+            if (exists(join(current.string(), ".git"))) {
+                repositoryRoot = current.string();
+                break;
+            }
+            if (current == current.root_path() || !current.has_parent_path()) break;
+            current = current.parent_path();
+        }
+        if (repositoryRoot.empty()) return nullptr;
+
+        std::shared_ptr<const ignoreChain> chain;
+        auto exclude = std::make_shared<ignoreChain>();
+        if (exclude->rules.loadFile(join(repositoryRoot, ".git/info/exclude")) && !exclude->rules.empty()) {
+            exclude->directory = repositoryRoot;
+            chain = exclude;
+        }
+        // The walk root's own .gitignore is read when the root is listed
+        for (auto it = directories.rbegin(); it + 1 != directories.rend(); ++it) {
+            auto layer = std::make_shared<ignoreChain>();
+            if (layer->rules.loadFile(join(*it, ".gitignore")) && !layer->rules.empty()) {
+                layer->directory = *it;
+                layer->parent = chain;
+                chain = layer;
+            }
+        }
+        return chain;
+    }
+
+    static void push(walkState& state, size_t queueIndex, task&& work) {
+        state.pending++;
+        auto& queue = *state.queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(work));
+    }
+
+    static bool take(walkState& state, size_t queueIndex, task& work) {
+        {
+            auto& own = *state.queues[queueIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                work = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < state.queues.size(); ++offset) {
+            auto& victim = *state.queues[(queueIndex + offset) % state.queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                work = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void listDirectory(walkState& state, size_t queueIndex, const task& work) const {
+        std::string absoluteDirectory = join(state.absoluteRoot, work.relativeDirectory);
+        DIR* dir = opendir(absoluteDirectory.c_str());
+        if (!dir) return;
+        if (state.onDirectory && *state.onDirectory) {
+            (*state.onDirectory)(absoluteDirectory);
+        }
+
+        auto ignores = work.ignores;
+        auto layer = std::make_shared<ignoreChain>();
+        if (layer->rules.loadFile(join(absoluteDirectory, ".gitignore")) && !layer->rules.empty()) {
+            layer->directory = absoluteDirectory;
+            layer->parent = ignores;
+            ignores = layer;
+        }
+
+        task files{work.relativeDirectory, {}, ignores};
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name == "." || name == ".." || name == ".git") continue;
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat info;
+                if (fstatat(dirfd(dir), entry->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_LNK;
+            }
+            if (type != DT_DIR && type != DT_REG) continue;
+
+            std::string absolutePath = join(absoluteDirectory, name);
+            if (ignoreChain::ignored(ignores, absolutePath, type == DT_DIR)) continue;
+
+            if (type == DT_DIR) {
+                if (skipNestedRepositories && exists(join(absolutePath, ".git"))) continue;
+                push(state, queueIndex, task{join(work.relativeDirectory, name), {}, ignores});
+                continue;
+            }
+            files.files.push_back(std::move(name));
+            if (files.files.size() == filesPerTask) {
+                push(state, queueIndex, std::move(files));
+                files = task{work.relativeDirectory, {}, ignores};
+            }
+        }
+        closedir(dir);
+        if (!files.files.empty()) {
+            push(state, queueIndex, std::move(files));
+        }
+    }
+
+    void visitFiles(walkState& state, const task& work) const {
+        for (const auto& name : work.files) {
+            if (state.stopped) return;
+            walkEntry entry;
+            entry.relativePath = join(work.relativeDirectory, name);
+            entry.path = join(state.root, entry.relativePath);
+            entry.absolutePath = join(state.absoluteRoot, entry.relativePath);
+            if (!(*state.onFile)(entry)) {
+                state.stopped = true;
+            }
+        }
+    }
+
+    void work(walkState& state, size_t queueIndex) const {
+        task current;
+        while (!state.stopped) {
+            if (!take(state, queueIndex, current)) {
+                if (state.pending == 0) return;
+                std::this_thread::yield();
+                continue;
+            }
+            if (current.files.empty()) {
+                listDirectory(state, queueIndex, current);
+            } else {
+                visitFiles(state, current);
+            }
+            state.pending--;
+        }
+    }
+
+public:
+    static std::string join(const std::string& directory, const std::string& name) {
+        if (directory.empty()) return name;
+        if (name.empty()) return directory;
+        return directory.back() == '/' ? directory + name : directory + "/" + name;
+    }
+
+    static std::string absolute(const std::string& path) {
+        std::string result = std::filesystem::absolute(path).lexically_normal().string();
+        while (result.size() > 1 && result.back() == '/') {
+            result.pop_back();
+        }
+        return result;
+    }
+
+    // Whether a walk from base would skip path: inside .git, a nested repository or ignored,
+    // itself or through one of its parent directories. Both paths are absolute.
+    bool excluded(const std::string& base, const std::string& path) const {
+        if (path.size() <= base.size() || path.compare(0, base.size(), base) != 0 || path[base.size()] != '/') {
+            return path != base;
+        }
+        auto ignores = ancestorRules(base);
+        std::string directory = base;
+        size_t start = base.size() + 1;
+        while (start <= path.size()) {
+            auto layer = std::make_shared<ignoreChain>();
+            if (layer->rules.loadFile(join(directory, ".gitignore")) && !layer->rules.empty()) {
+                layer->directory = directory;
+                layer->parent = ignores;
+                ignores = layer;
+            }
+            size_t end = path.find('/', start);
+            if (end == std::string::npos) end = path.size();
+            std::string name = path.substr(start, end - start);
+            std::string current = path.substr(0, end);
+            struct stat info;
+            bool isDirectory = end < path.size() || (lstat(current.c_str(), &info) == 0 && S_ISDIR(info.st_mode));
+            if (name == ".git" || ignoreChain::ignored(ignores, current, isDirectory)) return true;
+            if (isDirectory && skipNestedRepositories && exists(join(current, ".git"))) return true;
+            directory = current;
+            start = end + 1;
+        }
+        return false;
+    }
+
+    explicit fileWalker(unsigned int threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency())))
+        : threadCount(std::max(1u, threads)) {}
+
+    void setSkipNestedRepositories(bool skip) {
+        skipNestedRepositories = skip;
+    }
+
+    // Calls onFile for every file below root, concurrently from the walker threads.
+    // Returning false from onFile stops the walk. A root that is a file is visited alone.
+    // onDirectory gets the absolute path of every directory that is listed.
+    void walk(const std::string& root, const std::function<bool(const walkEntry&)>& onFile,
+              const std::function<void(const std::string&)>& onDirectory = nullptr) const {
+        walkState state;
+        state.root = root;
+        state.absoluteRoot = absolute(root);
+        state.onFile = &onFile;
+        state.onDirectory = &onDirectory;
+
+        struct stat info;
+        if (stat(state.absoluteRoot.c_str(), &info) != 0) return;
+        if (S_ISREG(info.st_mode)) {
+            onFile(walkEntry{root, std::filesystem::path(root).filename().string(), state.absoluteRoot});
+            return;
+        }
+        if (!S_ISDIR(info.st_mode)) return;
+
+        for (unsigned int i = 0; i < threadCount; ++i) {
+            state.queues.push_back(std::make_unique<workQueue>());
+        }
+        push(state, 0, task{"", {}, ancestorRules(state.absoluteRoot)});
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; ++i) {
+            threads.emplace_back([this, &state, i]() { work(state, i); });
+        }
+        work(state, 0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+};
\ No newline at end of file
@@ -1,10 +1,28 @@
 #pragma once
 #include <string>
+#include <set>
+#include <sstream>
 #include <nlohmann/json.hpp>
 #include "tool.hpp"
 #include "cmdexec.hpp"
+#include "fileevents.hpp"
 
 class gitTool : public agentTool {
+private:
+    // Subcommands that can rewrite files in the working tree
+    static bool changesWorkingTree(const std::string& command) {
+        static const std::set<std::string> writing = {
+            "am", "apply", "checkout", "cherry-pick", "clean", "clone", "merge", "mv", "pull",
+            "rebase", "reset", "restore", "revert", "rm", "stash", "submodule", "switch"
+        };
+        std::istringstream words(command);
+        std::string word;
+        while (words >> word) {
+            if (!word.starts_with("-")) return writing.contains(word);
+        }
+        return false;
+    }
+
 public:
     gitTool() : agentTool(
         "git",
@@ -28,6 +46,10 @@ public:
             }
                         
             std::string output = CommandExecutor::executeSingleArg(realCommand, {command});
+            if (changesWorkingTree(command)) {
+                // No telling which files changed, everything below the repository is looked at again
+                fileEvents::instance().changed(".");
+            }
             return output;
         } catch (const std::exception& e) {
             return "Error parsing parameters: " + std::string(e.what());
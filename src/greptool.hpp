@@ -4,25 +4,53 @@
 #include <memory>
 #include "spdlog/spdlog.h"
 #include "tool.hpp"
-#include "cmdexec.hpp"
+#include "codesearch.hpp"
+#include "trigramindex.hpp"
 
 class grepTool : public agentTool {
+private:
+    std::shared_ptr<trigramIndex> index; // optional, shared by all clones
+
 public:
-    grepTool() : agentTool(
+    explicit grepTool(std::shared_ptr<trigramIndex> searchIndex = nullptr) : agentTool(
         "grep",
         R"(Searches through file contents using regular expressions. Works efficiently with codebases of any size. 
-        Always specify pattern to search, it is grep with -e flag)",
-        "query: string - text or regex to search",
-        "grep -rnw ./ -e "
-    ) {}
+        Skips files ignored by git. Results are grouped by file and capped, use a more specific query or path when there are too many)",
+        "query: string - text or regex to search, path: string - directory or file to search in (optional, defaults to current dir), whole_word: boolean - only match whole words",
+        "grep (in process)"
+    ), index(std::move(searchIndex)) {}
 
     std::unique_ptr<agentTool> clone() const override {
         return std::make_unique<grepTool>(*this);
     }
 
+    std::vector<std::string> resultDependencies(const nlohmann::json& params) const override {
+        std::string path = params.value("path", "./");
+        return {path.empty() ? "./" : path};
+    }
+
+    bool isReadOnly() const override {
+        return true;
+    }
+
     std::string executeImpl(const std::string& params) override {
         auto json = nlohmann::json::parse(params);
-        std::string output = CommandExecutor::execute(realCommand, {json["query"].get<std::string>()});
-        return output;
+        std::string query = json["query"].get<std::string>();
+        if (query.empty()) {
+            return "Error: empty query";
+        }
+        std::string path = json.value("path", "./");
+        bool wholeWord = json.value("whole_word", false);
+
+        searchLimits limits;
+        codeSearch search(query, wholeWord);
+        std::optional<std::vector<walkEntry>> candidates;
+        if (index) {
+            candidates = index->candidates(path, search.requiredLiterals());
+        }
+        auto result = candidates ? search.runOn(*candidates, limits) : search.run(path, fileWalker(), limits);
+        spdlog::info("grep '{}' in {}: {} matches in {} of {} files", query, path,
+            result.totalMatches, result.files.size(), result.filesSearched);
+        return codeSearch::format(result, limits);
     }
 };
\ No newline at end of file
@@ -3,51 +3,203 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
 #include <nlohmann/json.hpp>
 #include <curl/curl.h>
 #include <spdlog/spdlog.h>
 
 
+// Keeps curl handles alive between requests. A curl easy handle owns its connection cache,
+// so reusing it per endpoint skips DNS, TCP and TLS setup on every agent turn.
+// Handles are checked out for the duration of one request, concurrent requests get their own.
 class HttpClient {
 public:
-    virtual ~HttpClient() = default;
+    HttpClient() {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+    }
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    virtual ~HttpClient() {
+        for (auto& [endpoint, handles] : idleHandles) {
+            for (CURL* curl : handles) {
+                curl_easy_cleanup(curl);
+            }
+        }
+        for (auto& [key, headers] : headerCache) {
+            curl_slist_free_all(headers);
+        }
+        curl_global_cleanup();
+    }
+
+    // Route all requests through a unix domain socket (e.g. /var/run/ollama.sock).
+    // The URL is still used for the Host header and the path.
+    void setUnixSocket(const std::string& path) {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        unixSocketPath = path;
+        for (auto& [endpoint, handles] : idleHandles) {
+            for (CURL* curl : handles) {
+                curl_easy_cleanup(curl);
+            }
+        }
+        idleHandles.clear();
+    }
 
 protected:
     std::string makeRequest(const std::string& url, const nlohmann::json& payload, const std::string& api_key = "", bool isPost = true) {
+        return makeRequest(url, payload.dump(), api_key, isPost);
+    }
+
+    // Same with a body that is already serialized (see requestBody), curl reads it in place.
+    // status, when given, gets the HTTP status code (0 when there was no response).
+    std::string makeRequest(const std::string& url, const std::string& body, const std::string& api_key = "", bool isPost = true,
+                            long* status = nullptr) {
         std::string response;
-        CURL* curl = curl_easy_init();
+        CURL* curl = acquireHandle(url);
         if (!curl) return {};
 
-        std::string jsonStr = payload.dump();
-        spdlog::debug("makeRequest payload: {}", jsonStr);
+        spdlog::debug("makeRequest payload: {}", body);
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         
         if (isPost) {
             curl_easy_setopt(curl, CURLOPT_POST, 1L);
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonStr.c_str());
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body.size());
+        } else {
+            curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
         }
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-        struct curl_slist* headers = createHeaders(api_key);
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, getHeaders(api_key));
 
         CURLcode res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
+        if (status) {
+            *status = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, status);
+        }
+        releaseHandle(url, curl);
 
         if (res != CURLE_OK) {
+            spdlog::warn("makeRequest failed: {}", curl_easy_strerror(res));
             return "";
         }
         spdlog::debug("makeRequest response: {}", response);
         return response;
     }
 
+    // Same as makeRequest, but hands the response to onLine one line at a time while it is still
+    // being received. Returning false from onLine or setting cancel stops the transfer.
+    bool makeStreamingRequest(const std::string& url, const nlohmann::json& payload,
+                              const std::function<bool(const std::string&)>& onLine,
+                              const std::string& api_key = "",
+                              const std::atomic<bool>* cancel = nullptr) {
+        return makeStreamingRequest(url, payload.dump(), onLine, api_key, cancel);
+    }
+
+    bool makeStreamingRequest(const std::string& url, const std::string& body,
+                              const std::function<bool(const std::string&)>& onLine,
+                              const std::string& api_key = "",
+                              const std::atomic<bool>* cancel = nullptr,
+                              long* status = nullptr) {
+        CURL* curl = acquireHandle(url);
+        if (!curl) return false;
+
+        spdlog::debug("makeStreamingRequest payload: {}", body);
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body.size());
+
+        StreamState state{{}, &onLine, false, cancel};
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &state);
+        if (cancel) {
+            curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+            curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &state);
+            curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, getHeaders(api_key));
+
+        CURLcode res = curl_easy_perform(curl);
+        if (status) {
+            *status = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, status);
+        }
+        releaseHandle(url, curl);
+
+        if (state.stopped) {
+            return true;
+        }
+        if (res != CURLE_OK) {
+            spdlog::warn("makeStreamingRequest failed: {}", curl_easy_strerror(res));
+            return false;
+        }
+        // Last line may come without a trailing newline
+        if (!state.pending.empty()) {
+            onLine(state.pending);
+        }
+        return true;
+    }
+
     static size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
         size_t totalSize = size * nmemb;
         userp->append((char*)contents, totalSize);
         return totalSize;
     }
 
+    struct StreamState {
+        std::string pending;
+        const std::function<bool(const std::string&)>* onLine;
+        bool stopped;
+        const std::atomic<bool>* cancel;
+    };
+
+    // Called by curl at least once a second, even while no data arrives
+    static int ProgressCallback(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+        auto* state = static_cast<StreamState*>(clientp);
+        if (state->cancel && state->cancel->load()) {
+            state->stopped = true;
+            return 1; // aborts the transfer
+        }
+        return 0;
+    }
+
+    static size_t StreamCallback(void* contents, size_t size, size_t nmemb, StreamState* state) {
+        size_t totalSize = size * nmemb;
+        state->pending.append((char*)contents, totalSize);
+
+        size_t start = 0;
+        size_t end = 0;
+        while ((end = state->pending.find('\n', start)) != std::string::npos) {
+            std::string line = state->pending.substr(start, end - start);
+            start = end + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty() && !(*state->onLine)(line)) {
+                state->stopped = true;
+                return 0; // makes curl abort the transfer
+            }
+        }
+        state->pending.erase(0, start);
+        return totalSize;
+    }
+
+    // Header lists only depend on the api key, they are built once and shared by all handles.
+    struct curl_slist* getHeaders(const std::string& api_key = "") {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        auto it = headerCache.find(api_key);
+        if (it != headerCache.end()) {
+            return it->second;
+        }
+        struct curl_slist* headers = createHeaders(api_key);
+        headerCache[api_key] = headers;
+        return headers;
+    }
+
     struct curl_slist* createHeaders(const std::string& api_key = "") {
         struct curl_slist* headers = nullptr;
         headers = curl_slist_append(headers, "Content-Type: application/json");
@@ -56,4 +208,52 @@ protected:
         }
         return headers;
     }
+
+private:
+    std::mutex poolMutex;
+    std::unordered_map<std::string, std::vector<CURL*>> idleHandles; // scheme://host:port -> handles
+    std::unordered_map<std::string, struct curl_slist*> headerCache; // api key -> headers
+    std::string unixSocketPath;
+
+    static std::string endpointOf(const std::string& url) {
+        size_t schemeEnd = url.find("://");
+        size_t hostStart = schemeEnd == std::string::npos ? 0 : schemeEnd + 3;
+        size_t pathStart = url.find('/', hostStart);
+        return pathStart == std::string::npos ? url : url.substr(0, pathStart);
+    }
+
+    CURL* acquireHandle(const std::string& url) {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        auto& handles = idleHandles[endpointOf(url)];
+        if (!handles.empty()) {
+            CURL* curl = handles.back();
+            handles.pop_back();
+            return curl;
+        }
+
+        CURL* curl = curl_easy_init();
+        if (!curl) return nullptr;
+        // HTTP/2 over TLS when the server offers it, plain HTTP/1.1 keep-alive otherwise
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+        // A host that is down should fail fast so the request can go elsewhere
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+        // Agent turns can be minutes apart while the user types, keep idle connections longer
+        curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, 600L);
+        if (!unixSocketPath.empty()) {
+            curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, unixSocketPath.c_str());
+        }
+        return curl;
+    }
+
+    void releaseHandle(const std::string& url, CURL* curl) {
+        // Drop pointers into this request's buffers before the handle goes back to the pool
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, nullptr);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, nullptr);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, nullptr);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+        std::lock_guard<std::mutex> lock(poolMutex);
+        idleHandles[endpointOf(url)].push_back(curl);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <cstring>
+
+// Patterns of one .gitignore file, matched against paths relative to the directory it lives in.
+// Supports the gitignore syntax: comments, negation (!), directory-only patterns (trailing /),
+// anchored patterns (containing /), *, ?, [classes] and ** for any number of directories.
+class ignoreRules {
+private:
+    struct rule {
+        std::string pattern;
+        bool negated = false;
+        bool directoryOnly = false;
+        bool anchored = false; // matched against the whole relative path instead of the file name
+    };
+    std::vector<rule> rules;
+
+    static bool matchClass(const char*& p, char c) {
+        const char* start = p + 1;
+        bool negated = *start == '!' || *start == '^';
+        if (negated) ++start;
+        const char* q = start;
+        bool matched = false;
+        // A ']' right after the opening bracket is a literal
+        do {
+            if (!*q) return false;
+            if (q[1] == '-' && q[2] && q[2] != ']') {
+                matched = matched || (c >= q[0] && c <= q[2]);
+                q += 3;
+            } else {
+                matched = matched || c == *q;
+                ++q;
+            }
+        } while (*q != ']');
+        p = q + 1;
+        return matched != negated;
+    }
+
+public:
+    // Shell glob match where * and ? stop at '/', "**/" spans any number of directories
+    static bool globMatch(const char* p, const char* s) {
+        while (*p) {
+            if (p[0] == '*' && p[1] == '*') {
+                p += 2;
+                if (*p == '/') {
+                    ++p;
+                    for (const char* t = s; ; ++t) {
+                        if (globMatch(p, t)) return true;
+                        t = std::strchr(t, '/');
+                        if (!t) return false;
+                    }
+                }
+                for (const char* t = s; ; ++t) {
+                    if (globMatch(p, t)) return true;
+                    if (!*t) return false;
+                }
+            }
+            if (*p == '*') {
+                ++p;
+                for (const char* t = s; ; ++t) {
+                    if (globMatch(p, t)) return true;
+                    if (!*t || *t == '/') return false;
+                }
+            }
+            if (!*s) return false;
+            if (*p == '?') {
+                if (*s == '/') return false;
+            } else if (*p == '[' && std::strchr(p + 1, ']')) {
+                if (*s == '/' || !matchClass(p, *s)) return false;
+                ++s;
+                continue;
+            } else {
+                if (*p == '\\' && p[1]) ++p;
+                if (*p != *s) return false;
+            }
+            ++p;
+            ++s;
+        }
+        return !*s;
+    }
+
+    void addLine(std::string line) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        // Trailing spaces are ignored unless escaped
+        while (!line.empty() && line.back() == ' ' && !(line.size() > 1 && line[line.size() - 2] == '\\')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') return;
+
+        rule current;
+        if (line[0] == '!') {
+            current.negated = true;
+            line.erase(0, 1);
+        } else if (line[0] == '\\') {
+            line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            current.directoryOnly = true;
+            line.pop_back();
+        }
+        if (line.find('/') != std::string::npos) {
+            current.anchored = true;
+            if (line[0] == '/') line.erase(0, 1);
+        }
+        if (line.empty()) return;
+        current.pattern = line;
+        rules.push_back(current);
+    }
+
+    bool loadFile(const std::string& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) return false;
+        std::string line;
+        while (std::getline(file, line)) {
+            addLine(line);
+        }
+        return true;
+    }
+
+    bool empty() const {
+        return rules.empty();
+    }
+
+    // 1 = ignored, -1 = re-included by a negated pattern, 0 = no pattern applies.
+    // Later patterns take precedence, like in git.
+    int match(const std::string& relativePath, bool isDirectory) const {
+        const char* fileName = relativePath.c_str();
+        if (const char* slash = std::strrchr(fileName, '/')) fileName = slash + 1;
+        for (auto it = rules.rbegin(); it != rules.rend(); ++it) {
+            if (it->directoryOnly && !isDirectory) continue;
+            if (globMatch(it->pattern.c_str(), it->anchored ? relativePath.c_str() : fileName)) {
+                return it->negated ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+};
+
+// The .gitignore files that apply inside one directory: its own and those of all its parents.
+// Layers are shared between directories, a subdirectory only adds a layer when it has its own file.
+struct ignoreChain {
+    std::string directory; // absolute path the rules are relative to
+    ignoreRules rules;
+    std::shared_ptr<const ignoreChain> parent;
+
+    static bool ignored(const std::shared_ptr<const ignoreChain>& chain, const std::string& absolutePath, bool isDirectory) {
+        for (const ignoreChain* layer = chain.get(); layer; layer = layer->parent.get()) {
+            if (absolutePath.size() <= layer->directory.size() + 1) continue;
+            int result = layer->rules.match(absolutePath.substr(layer->directory.size() + 1), isDirectory);
+            if (result != 0) return result > 0;
+        }
+        return false;
+    }
+};
\ No newline at end of file
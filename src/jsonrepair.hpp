@@ -0,0 +1,302 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <cstdlib>
+#include <nlohmann/json.hpp>
+
+// Reads the JSON models actually write, in one pass: strings in single quotes, raw newlines
+// and tabs inside strings, unknown escapes such as "\d" in a regex, trailing or doubled commas,
+// unquoted keys, // and /* */ comments, Python's True/False/None, quotes inside a string that
+// can't be closing it (printf("hi") in code), and objects left unclosed at the end of the text.
+// Braces inside strings never count, so code in a "content" argument is safe.
+class lenientJson {
+private:
+    static constexpr int maxDepth = 256;
+
+    std::string_view text;
+    size_t pos = 0;
+    int depth = 0;
+
+    bool atEnd() const {
+        return pos >= text.size();
+    }
+
+    void skipSpace() {
+        while (!atEnd()) {
+            char c = text[pos];
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                ++pos;
+            } else if (c == '/' && pos + 1 < text.size() && text[pos + 1] == '/') {
+                size_t end = text.find('\n', pos);
+                pos = end == std::string_view::npos ? text.size() : end;
+            } else if (c == '/' && pos + 1 < text.size() && text[pos + 1] == '*') {
+                size_t end = text.find("*/", pos + 2);
+                pos = end == std::string_view::npos ? text.size() : end + 2;
+            } else {
+                return;
+            }
+        }
+    }
+
+    static bool isWordChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' || c == '-';
+    }
+
+    static void appendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    std::optional<uint32_t> hex4(size_t at) const {
+        if (at + 4 > text.size()) return std::nullopt;
+        uint32_t code = 0;
+        for (size_t i = at; i < at + 4; ++i) {
+            char c = text[i];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return std::nullopt;
+        }
+        return code;
+    }
+
+    // A quote closes the string only when what follows can come after a string
+    bool closesString(size_t quoteAt) const {
+        size_t next = quoteAt + 1;
+        while (next < text.size() && (text[next] == ' ' || text[next] == '\t' || text[next] == '\r' || text[next] == '\n')) {
+            ++next;
+        }
+        return next >= text.size() || text[next] == ',' || text[next] == '}' || text[next] == ']' ||
+               text[next] == ':' || (depth == 0);
+    }
+
+    std::optional<std::string> parseString() {
+        char quote = text[pos++];
+        std::string out;
+        while (!atEnd()) {
+            char c = text[pos];
+            if (c == quote) {
+                if (closesString(pos)) {
+                    ++pos;
+                    return out;
+                }
+                out += c; // printf("hi") inside a string written without escapes
+                ++pos;
+                continue;
+            }
+            if (c != '\\') {
+                out += c; // raw newlines and tabs are kept as they are
+                ++pos;
+                continue;
+            }
+            if (pos + 1 >= text.size()) break;
+            char escaped = text[pos + 1];
+            pos += 2;
+            switch (escaped) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case '/': out += '/'; break;
+            case '\\': out += '\\'; break;
+            case '"': out += '"'; break;
+            case '\'': out += '\''; break;
+            case 'u': {
+                auto code = hex4(pos);
+                if (!code) {
+                    out += "\\u";
+                    break;
+                }
+                pos += 4;
+                if (*code >= 0xD800 && *code <= 0xDBFF && pos + 1 < text.size() && text[pos] == '\\' && text[pos + 1] == 'u') {
+                    auto low = hex4(pos + 2);
+                    if (low && *low >= 0xDC00 && *low <= 0xDFFF) {
+                        *code = 0x10000 + ((*code - 0xD800) << 10) + (*low - 0xDC00);
+                        pos += 6;
+                    }
+                }
+                appendUtf8(out, *code);
+                break;
+            }
+            default:
+                // Not a JSON escape, most likely meant literally (regex \d, Windows paths)
+                out += '\\';
+                out += escaped;
+            }
+        }
+        return std::nullopt; // unterminated
+    }
+
+    std::optional<nlohmann::json> parseNumberOrWord() {
+        size_t start = pos;
+        while (!atEnd() && (isWordChar(text[pos]) || text[pos] == '.' || text[pos] == '+')) {
+            ++pos;
+        }
+        std::string word(text.substr(start, pos - start));
+        if (word.empty()) return std::nullopt;
+        if (word == "true" || word == "True") return true;
+        if (word == "false" || word == "False") return false;
+        if (word == "null" || word == "None") return nullptr;
+        const char* begin = word.c_str();
+        char* end = nullptr;
+        bool integral = word.find_first_of(".eE") == std::string::npos;
+        if (integral) {
+            errno = 0;
+            long long value = std::strtoll(begin, &end, 10);
+            if (*end == '\0' && errno == 0) return value;
+        }
+        double value = std::strtod(begin, &end);
+        if (*end == '\0' && end != begin) return value;
+        return std::nullopt;
+    }
+
+    std::optional<nlohmann::json> parseObject() {
+        ++pos;
+        nlohmann::json object = nlohmann::json::object();
+        while (true) {
+            skipSpace();
+            if (atEnd()) return object; // left unclosed by a cut off answer
+            char c = text[pos];
+            if (c == '}') {
+                ++pos;
+                return object;
+            }
+            if (c == ',') {
+                ++pos;
+                continue;
+            }
+            std::string key;
+            if (c == '"' || c == '\'') {
+                auto parsed = parseString();
+                if (!parsed) return std::nullopt;
+                key = std::move(*parsed);
+            } else {
+                size_t start = pos;
+                while (!atEnd() && isWordChar(text[pos])) ++pos;
+                if (pos == start) return std::nullopt;
+                key = std::string(text.substr(start, pos - start));
+            }
+            skipSpace();
+            if (atEnd() || text[pos] != ':') return std::nullopt;
+            ++pos;
+            auto value = parseValue();
+            if (!value) return std::nullopt;
+            object[key] = std::move(*value);
+        }
+    }
+
+    std::optional<nlohmann::json> parseArray() {
+        ++pos;
+        nlohmann::json array = nlohmann::json::array();
+        while (true) {
+            skipSpace();
+            if (atEnd()) return array;
+            char c = text[pos];
+            if (c == ']') {
+                ++pos;
+                return array;
+            }
+            if (c == ',') {
+                ++pos;
+                continue;
+            }
+            auto value = parseValue();
+            if (!value) return std::nullopt;
+            array.push_back(std::move(*value));
+        }
+    }
+
+    std::optional<nlohmann::json> parseValue() {
+        skipSpace();
+        if (atEnd() || depth >= maxDepth) return std::nullopt;
+        char c = text[pos];
+        if (c == '{' || c == '[') {
+            ++depth;
+            auto value = c == '{' ? parseObject() : parseArray();
+            --depth;
+            return value;
+        }
+        if (c == '"' || c == '\'') {
+            auto parsed = parseString();
+            if (!parsed) return std::nullopt;
+            return nlohmann::json(std::move(*parsed));
+        }
+        return parseNumberOrWord();
+    }
+
+public:
+    explicit lenientJson(std::string_view input) : text(input) {}
+
+    // The value starting at offset start, nothing when it can't be read even leniently.
+    // end is set to the offset just past it.
+    std::optional<nlohmann::json> parseAt(size_t start, size_t& end) {
+        pos = start;
+        depth = 0;
+        auto value = parseValue();
+        end = pos;
+        return value;
+    }
+
+    static std::optional<nlohmann::json> parse(std::string_view input) {
+        lenientJson parser(input);
+        size_t end = 0;
+        return parser.parseAt(0, end);
+    }
+
+    // Every {"tool_name", "parameters"} object in an answer, in order. Strict JSON answers take the fast path.
+    static std::vector<nlohmann::json> toolCalls(std::string_view input) {
+        std::vector<nlohmann::json> calls;
+        auto isCall = [](const nlohmann::json& value) {
+            return value.is_object() && value.contains("tool_name") && value.contains("parameters");
+        };
+        auto collect = [&](const nlohmann::json& value) {
+            if (isCall(value)) {
+                calls.push_back(value);
+            } else if (value.is_array()) {
+                for (const auto& item : value) {
+                    if (isCall(item)) calls.push_back(item);
+                }
+            }
+        };
+
+        nlohmann::json whole = nlohmann::json::parse(input.begin(), input.end(), nullptr, false);
+        if (!whole.is_discarded()) {
+            collect(whole);
+            return calls;
+        }
+
+        lenientJson parser(input);
+        size_t pos = 0;
+        while ((pos = input.find_first_of("{[", pos)) != std::string_view::npos) {
+            size_t end = pos;
+            auto value = parser.parseAt(pos, end);
+            if (value && (value->is_object() || value->is_array())) {
+                size_t before = calls.size();
+                collect(*value);
+                if (calls.size() > before) {
+                    pos = end;
+                    continue;
+                }
+            }
+            ++pos; // not a call, or a stray brace in prose: look inside it
+        }
+        return calls;
+    }
+};
\ No newline at end of file
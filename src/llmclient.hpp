@@ -3,8 +3,23 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cctype>
 #include <nlohmann/json.hpp>
 #include <curl/curl.h>
+#include "messagestore.hpp"
+
+// Receives generated text pieces as they arrive. Return false to stop the generation early.
+using streamCallback = std::function<bool(const std::string&)>;
+
+struct chatOptions {
+    streamCallback onToken = nullptr; // when set, the answer is streamed token by token
+    nlohmann::json tools = nlohmann::json::array(); // function schemas for native tool calling
+    // Set from any thread to abort a streamed request, also while it waits for the first token
+    std::shared_ptr<std::atomic<bool>> cancel = nullptr;
+};
 
 class LLMClient {
 private:
@@ -12,8 +27,15 @@ private:
 public:
     virtual ~LLMClient() = default;
 
-    virtual std::string chat(const std::vector<std::pair<std::string, std::string>>& messages,
-                             const std::string& systemPrompt = "") = 0;
+    // Returns the response envelope as JSON text, the assistant reply is at ["message"]["content"],
+    // requested tool calls at ["message"]["tool_calls"] (same shape as the JSON in chatMessage::toolCalls),
+    // token usage at ["prompt_eval_count"] and ["eval_count"] when the server reports it
+    // and server errors at ["error"], with the HTTP status at ["http_status"] when there was one.
+    // Requests the server never answered (refused, timed out, dropped mid-stream) also set
+    // ["connection_error"], see isConnectionError().
+    virtual std::string chat(const messageList& messages,
+                             const std::string& systemPrompt = "",
+                             const chatOptions& options = {}) = 0;
 
     void setModel(const std::string& model) {
         modelName = model;
@@ -23,8 +45,62 @@ public:
         return modelName;
     }
 
+    // Client side settings that change the answer (sampling options and the like), part of the response cache key
+    virtual nlohmann::json getRequestOptions() const {
+        return nlohmann::json::object();
+    }
+
     virtual std::vector<std::string> listModels() {
         // Default implementation - return empty vector
         return {};
     }
+
+    static bool isConnectionError(const nlohmann::json& envelope) {
+        return envelope.is_object() && envelope.value("connection_error", false);
+    }
+
+    // The server refused the request because the model can't take tools, as opposed to failing it
+    static bool isToolSupportError(const nlohmann::json& envelope) {
+        if (!envelope.is_object() || !envelope.contains("error")) return false;
+        std::string text = envelope["error"].is_string() ? envelope["error"].get<std::string>() : envelope["error"].dump();
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+        for (const char* phrase : {"does not support tool", "tools are not supported",
+                                   "tool use is not supported", "does not support function calling", "tool calling is not supported"}) {
+            if (text.find(phrase) != std::string::npos) return true;
+        }
+        return false;
+    }
+
+protected:
+    static std::string connectionError(const std::string& url) {
+        return nlohmann::json{{"error", "no response from " + url}, {"connection_error", true}}.dump();
+    }
+
+    // Brings tool calls from any server into the chatMessage::toolCalls shape: every call gets an id
+    // and arguments sent as a JSON string (OpenAI) are turned into an object.
+    static nlohmann::json normalizeToolCalls(const nlohmann::json& calls) {
+        nlohmann::json normalized = nlohmann::json::array();
+        if (!calls.is_array()) {
+            return normalized;
+        }
+        for (const auto& call : calls) {
+            if (!call.contains("function") || !call["function"].contains("name")) {
+                continue;
+            }
+            nlohmann::json arguments = call["function"].value("arguments", nlohmann::json::object());
+            if (arguments.is_string()) {
+                std::string raw = arguments;
+                arguments = nlohmann::json::parse(raw.empty() ? "{}" : raw, nullptr, false);
+            }
+            std::string id = call.contains("id") && call["id"].is_string() ? call["id"].get<std::string>() : "";
+            if (id.empty()) {
+                id = "call_" + std::to_string(normalized.size());
+            }
+            normalized.push_back({
+                {"id", id},
+                {"function", {{"name", call["function"]["name"]}, {"arguments", arguments}}}
+            });
+        }
+        return normalized;
+    }
 };
\ No newline at end of file
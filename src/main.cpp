@@ -7,6 +7,8 @@
 #include "ollama.hpp"
 #include "llmclient.hpp"
 #include "oaiclient.hpp"
+#include "cachedclient.hpp"
+#include "poolclient.hpp"
 #include "conversation.hpp"
 #include "linenoise.hpp"
 
@@ -32,6 +34,9 @@ int main(int argc, char** argv)
     bool disableDefaultTools = false;
     bool disableCustomTools = false;
     bool disableTools = false;
+    bool disableStreaming = false;
+    std::string cacheMode = {};
+    std::string resumeSession = {};
 
     CLI::App cli{"vibecpp"};
     cli.add_option("--type", clientType, "LLM client type. Supported types: \"ollama\", \"openai\".");
@@ -41,6 +46,9 @@ int main(int argc, char** argv)
     cli.add_flag("--ndt", disableDefaultTools, "Disable default tools.");
     cli.add_flag("--nct", disableCustomTools, "Disable custom tools.");
     cli.add_flag("--nt", disableTools, "Disable all tools.");
+    cli.add_flag("--ns", disableStreaming, "Disable token streaming, print answers once complete.");
+    cli.add_option("--cache", cacheMode, "LLM response cache mode: \"off\", \"readwrite\", \"record\", \"replay\".");
+    cli.add_option("--resume", resumeSession, "Continue a saved session, by id or \"last\".");
     cli.add_flag("-d", debugEnabled, "Enable debug logging mode.");
 
     try
@@ -66,6 +74,7 @@ int main(int argc, char** argv)
         }
     }
 
+    bool serverGiven = !clientEndpoint.empty();
     if(clientEndpoint.empty())
         clientEndpoint = cfg.get<std::string>("client.endpoint");
     if(clientApiKey.empty())
@@ -82,14 +91,56 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    std::string unixSocket = cfg.get<std::string>("client.unix_socket");
+
     std::unique_ptr<LLMClient> client = {};
+    auto endpoints = cfg.get<std::vector<std::string>>("client.endpoints");
+    if(serverGiven && !endpoints.empty())
+    {
+        spdlog::warn("Using --server {}, client.endpoints from the config is ignored", clientEndpoint);
+        endpoints.clear();
+    }
+    else if(endpoints.size() == 1 && !clientEndpoint.empty() && clientEndpoint != endpoints.front())
+    {
+        spdlog::warn("client.endpoints has one entry, {} is used instead of client.endpoint {}", endpoints.front(), clientEndpoint);
+    }
+    if(endpoints.size() == 1)
+        clientEndpoint = endpoints.front();
     if(clientType == "ollama")
     {
-        client = std::make_unique<OllamaClient>(clientEndpoint);
+        auto makeOllama = [&](const std::string& endpoint) {
+            auto ollama = std::make_unique<OllamaClient>(endpoint);
+            ollama->setUnixSocket(unixSocket);
+            auto keepAlive = cfg.get<nlohmann::json>("client.keep_alive");
+            if(!keepAlive.is_null())
+                ollama->setKeepAlive(keepAlive);
+            ollama->setModel(clientModel);
+            return ollama;
+        };
+        if(endpoints.size() > 1)
+        {
+            std::vector<std::pair<std::string, std::unique_ptr<LLMClient>>> servers;
+            for(const auto& endpoint : endpoints)
+                servers.emplace_back(endpoint, makeOllama(endpoint));
+            poolOptions pool;
+            if(cfg.get<std::string>("client.routing") == "latency")
+                pool.routing = routingPolicy::latency;
+            pool.maxAttempts = cfg.get<unsigned int>("client.max_attempts", pool.maxAttempts);
+            pool.hedgeDelay = std::chrono::milliseconds(cfg.get<unsigned int>("client.hedge_ms", 0));
+            pool.healthInterval = std::chrono::seconds(cfg.get<unsigned int>("client.health_seconds", 15));
+            // Takes the model from its endpoints, its health thread reads it from the start
+            client = std::make_unique<PoolLLMClient>(std::move(servers), pool);
+            clientEndpoint = endpoints.front() + fmt::format(" (+{} more)", endpoints.size() - 1);
+        }
+        else
+            client = makeOllama(clientEndpoint);
     }
     else if(clientType == "openai")
     {
-        client = std::make_unique<OpenAIClient>(clientEndpoint, clientApiKey);
+        auto openai = std::make_unique<OpenAIClient>(clientEndpoint, clientApiKey);
+        openai->setUnixSocket(unixSocket);
+        client = std::move(openai);
+        client->setModel(clientModel);
     }
     else
     {
@@ -98,7 +149,22 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    client->setModel(clientModel);
+    if(cacheMode.empty())
+        cacheMode = cfg.get<std::string>("cache.mode");
+    if(!cacheMode.empty() && cacheMode != "off")
+    {
+        try
+        {
+            auto mode = CachedLLMClient::parseMode(cacheMode);
+            uintmax_t maxBytes = static_cast<uintmax_t>(cfg.get<unsigned int>("cache.max_mb", 256)) << 20;
+            client = std::make_unique<CachedLLMClient>(std::move(client), agentUtils::getDataDirectory() + "cache", mode, maxBytes);
+        }
+        catch (const std::invalid_argument& e)
+        {
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+    }
     auto conv = std::make_shared<ConversationLLM>();
 
     if(disableTools)
@@ -107,12 +173,37 @@ int main(int argc, char** argv)
         disableDefaultTools = true;
     }
 
+    if(cfg.get<bool>("search.index", false))
+        conv->setSearchIndex(std::make_shared<trigramIndex>(std::filesystem::current_path().string()));
+    if(cfg.get<bool>("search.symbols", true) && !disableDefaultTools)
+        conv->setSymbolIndex(std::make_shared<symbolIndex>(std::filesystem::current_path().string()));
+
+    if(cfg.get<unsigned int>("agent.read_max_tokens") > 0)
+        conv->setReadTokenBudget(cfg.get<unsigned int>("agent.read_max_tokens"));
+
     if(!disableDefaultTools)
         conv->loadDefaultTools();
 
     if(!disableCustomTools)
         conv->loadToolsFromFile(agentUtils::getHomeDirectory() + ".custom.vibecpp");
 
+    conv->setNativeTools(cfg.get<bool>("client.native_tools", true));
+    conv->setResultCache(cfg.get<bool>("agent.result_cache", true));
+    if(!cfg.get<std::string>("client.tokenizer").empty())
+        conv->loadTokenizer(cfg.get<std::string>("client.tokenizer"));
+    if(cfg.get<unsigned int>("agent.tool_workers") > 0)
+        conv->setToolWorkers(cfg.get<unsigned int>("agent.tool_workers"));
+    if(cfg.get<unsigned int>("agent.tool_timeout") > 0)
+        CommandExecutor::defaults().timeout = std::chrono::seconds(cfg.get<unsigned int>("agent.tool_timeout"));
+    if(cfg.get<unsigned int>("agent.tool_output_kb") > 0)
+        CommandExecutor::defaults().maxOutput = size_t(cfg.get<unsigned int>("agent.tool_output_kb")) * 1024;
+
+    agentLimits limits;
+    limits.maxSteps = cfg.get<unsigned int>("agent.max_steps", limits.maxSteps);
+    limits.maxDuration = std::chrono::seconds(cfg.get<unsigned int>("agent.max_seconds", 0));
+    conv->setLimits(limits);
+    conv->setContextLimit(cfg.get<unsigned int>("agent.context_limit", 0));
+    conv->setSummaryPolicy(cfg.get<float>("agent.summary_low_water", 0.6f), cfg.get<unsigned int>("agent.keep_recent", 8));
     conv->setClient(std::move(client));
     conv->setPrintCallback([](const std::string& incoming){
         if(incoming.starts_with("Tool results:"))
@@ -122,6 +213,40 @@ int main(int argc, char** argv)
         else
             std::cout << incoming << std::endl;
     });
+    if(!disableStreaming)
+    {
+        conv->setStreamCallback([](const std::string& piece){
+            std::cout << piece << std::flush;
+        });
+    }
+
+    std::string sessionDirectory = agentUtils::getDataDirectory() + "sessions";
+    if(!resumeSession.empty())
+    {
+        auto started = std::chrono::steady_clock::now();
+        restoredSession saved;
+        auto log = sessionLog::resume(sessionDirectory, resumeSession, saved);
+        if(!log)
+        {
+            std::cout << "No saved session " << resumeSession << " in " << sessionDirectory << std::endl;
+            return 1;
+        }
+        if(saved.meta.value("directory", "") != std::filesystem::current_path().string())
+            std::cout << "Note: the session was started in " << saved.meta.value("directory", "another directory") << std::endl;
+        std::cout << fmt::format("Resumed session {}: {} messages in {:.1f} ms", log->id(), saved.history.size(),
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count()) << std::endl;
+        conv->resumeSession(std::move(log), std::move(saved));
+    }
+    else if(cfg.get<bool>("session.save", true))
+    {
+        nlohmann::json meta = {
+            {"type", clientType},
+            {"model", clientModel},
+            {"directory", std::filesystem::current_path().string()},
+            {"tokenizer", cfg.get<std::string>("client.tokenizer")}
+        };
+        conv->setSession(sessionLog::create(sessionDirectory, meta, cfg.get<unsigned int>("session.keep", 50)));
+    }
 
 
     if (isPipeInput()) 
@@ -139,6 +264,8 @@ int main(int argc, char** argv)
         
         std::cout << fmt::format("Endpoint: {}\nType: {}\nModel: {}", 
             clientEndpoint, clientType, clientModel) << std::endl;
+        if(conv->getSession())
+            std::cout << "Session: " << conv->getSession()->id() << " (continue it with --resume)" << std::endl;
         std::cout << "Ask your first question." << std::endl;
         while (true) 
         {
@@ -151,12 +278,27 @@ int main(int argc, char** argv)
                 break;
             }
             linenoise::AddHistory(input.c_str());
-            conv->handleUserInput(input);
+            try
+            {
+                conv->handleUserInput(input);
+            }
+            catch (const std::runtime_error& e)
+            {
+                std::cout << e.what() << std::endl;
+            }
         }
     }
     else //non-chat mode
     {
-        conv->handleUserInput(outgoingMessage);
+        try
+        {
+            conv->handleUserInput(outgoingMessage);
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
     }
     
     return 0;
@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Read-only view of a whole file. Larger files are mapped so searching them copies nothing,
+// small ones are read into a buffer because setting up a mapping costs more than it saves.
+class mappedFile {
+private:
+    static constexpr size_t mapThreshold = 64 * 1024;
+
+    const char* mapping = nullptr;
+    size_t mappedSize = 0;
+    std::string buffer;
+    bool isOpen = false;
+
+    void reset() {
+        if (mapping) {
+            munmap(const_cast<char*>(mapping), mappedSize);
+        }
+        mapping = nullptr;
+        mappedSize = 0;
+        buffer.clear();
+        isOpen = false;
+    }
+
+public:
+    mappedFile() = default;
+    explicit mappedFile(const std::string& path) {
+        open(path);
+    }
+
+    mappedFile(const mappedFile&) = delete;
+    mappedFile& operator=(const mappedFile&) = delete;
+
+    ~mappedFile() {
+        reset();
+    }
+
+    // Files larger than maxSize are not opened
+    bool open(const std::string& path, size_t maxSize = SIZE_MAX) {
+        reset();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || static_cast<size_t>(info.st_size) > maxSize) {
+            ::close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        if (size >= mapThreshold) {
+            void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                madvise(data, size, MADV_SEQUENTIAL);
+                mapping = static_cast<const char*>(data);
+                mappedSize = size;
+                isOpen = true;
+            }
+        }
+        if (!isOpen) {
+            buffer.resize(size);
+            size_t done = 0;
+            while (done < size) {
+                ssize_t got = ::read(fd, buffer.data() + done, size - done);
+                if (got <= 0) break;
+                done += static_cast<size_t>(got);
+            }
+            buffer.resize(done);
+            isOpen = true;
+        }
+        ::close(fd);
+        return true;
+    }
+
+    bool is_open() const {
+        return isOpen;
+    }
+
+    std::string_view view() const {
+        return mapping ? std::string_view(mapping, mappedSize) : std::string_view(buffer);
+    }
+};
\ No newline at end of file
@@ -0,0 +1,191 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+enum class messageRole : uint8_t { system, user, assistant, tool };
+
+inline std::string_view roleName(messageRole role) {
+    switch (role) {
+    case messageRole::system: return "system";
+    case messageRole::user: return "user";
+    case messageRole::assistant: return "assistant";
+    case messageRole::tool: return "tool";
+    }
+    return "user";
+}
+
+// One history entry. The text fields point into the arena of the messageStore or messageList
+// the message came from and stay valid as long as that is alive.
+struct chatMessage {
+    messageRole role = messageRole::user;
+    std::string_view content;
+    // Native tool calls requested by an assistant message as JSON text, empty without any.
+    // Normalized to [{"id": "...", "function": {"name": "...", "arguments": {...}}}]
+    std::string_view toolCalls;
+    std::string_view toolCallId; // "tool" messages: id of the call this is the result of
+    std::string_view toolName;   // "tool" messages: function name of that call
+    int tokenCount = -1;         // cached raw token count, -1 until counted
+    int64_t createdAt = 0;       // milliseconds since the epoch
+
+    nlohmann::json toolCallsJson() const {
+        if (toolCalls.empty()) return nlohmann::json::array();
+        auto calls = nlohmann::json::parse(toolCalls, nullptr, false);
+        return calls.is_discarded() ? nlohmann::json::array() : calls;
+    }
+};
+
+// Append-only storage for message text. Text is copied in once and never moves, so views into
+// it stay valid until the arena goes away. Small texts share growing blocks, large ones get
+// a block of their own.
+class messageArena {
+public:
+    std::string_view store(std::string_view text) {
+        if (text.empty()) return {};
+        usedBytes += text.size();
+        if (text.size() > largeText) {
+            auto& block = blocks.emplace_back(std::make_unique_for_overwrite<char[]>(text.size()));
+            reservedBytes += text.size();
+            std::memcpy(block.get(), text.data(), text.size());
+            return {block.get(), text.size()};
+        }
+        if (!current || used + text.size() > capacity) {
+            // Blocks grow with the history, half of what is reserved so far
+            capacity = std::max(text.size(), std::clamp(reservedBytes / 2, minBlock, maxBlock));
+            current = blocks.emplace_back(std::make_unique_for_overwrite<char[]>(capacity)).get();
+            used = 0;
+            reservedBytes += capacity;
+        }
+        char* start = current + used;
+        std::memcpy(start, text.data(), text.size());
+        used += text.size();
+        return {start, text.size()};
+    }
+
+    size_t bytesUsed() const {
+        return usedBytes;
+    }
+
+    size_t bytesReserved() const {
+        return reservedBytes;
+    }
+
+private:
+    static constexpr size_t minBlock = 16 * 1024;
+    static constexpr size_t maxBlock = 256 * 1024;
+    static constexpr size_t largeText = 64 * 1024; // stored in a block of its own
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* current = nullptr; // block small texts are appended to
+    size_t capacity = 0;     // its size
+    size_t used = 0;         // bytes of it in use
+    size_t usedBytes = 0;
+    size_t reservedBytes = 0;
+};
+
+// Read-only list of messages that keeps the text they point to alive. Copies share the text,
+// handing one to another thread only copies the small message records.
+class messageList {
+public:
+    messageList() = default;
+    messageList(std::shared_ptr<const messageArena> text, std::vector<chatMessage> records)
+        : arena(std::move(text)), messages(std::move(records)) {}
+
+    auto begin() const { return messages.begin(); }
+    auto end() const { return messages.end(); }
+    size_t size() const { return messages.size(); }
+    bool empty() const { return messages.empty(); }
+    const chatMessage& operator[](size_t index) const { return messages[index]; }
+    const chatMessage& back() const { return messages.back(); }
+
+    // The arena the text lives in, for views that have to outlive the list
+    const std::shared_ptr<const messageArena>& storage() const { return arena; }
+
+private:
+    std::shared_ptr<const messageArena> arena;
+    std::vector<chatMessage> messages;
+};
+
+// The conversation history: message records and the arena their text lives in. Text is copied
+// in once and read in place by token counting and request building. compact() moves the kept
+// messages into a fresh arena, so memory follows the live history instead of everything ever
+// said; snapshots still using the old arena keep it until they are gone.
+class messageStore {
+public:
+    const chatMessage& append(messageRole role, std::string_view content,
+                              const nlohmann::json& toolCalls = nlohmann::json::array(),
+                              std::string_view toolCallId = {}, std::string_view toolName = {}) {
+        chatMessage msg;
+        msg.role = role;
+        msg.content = arena->store(content);
+        if (!toolCalls.empty()) {
+            msg.toolCalls = arena->store(toolCalls.dump());
+        }
+        msg.toolCallId = arena->store(toolCallId);
+        msg.toolName = arena->store(toolName);
+        msg.createdAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        return records.emplace_back(msg);
+    }
+
+    // Copies a message from another store or list, keeping its token count and time
+    const chatMessage& append(const chatMessage& other) {
+        chatMessage msg = other;
+        msg.content = arena->store(other.content);
+        msg.toolCalls = arena->store(other.toolCalls);
+        msg.toolCallId = arena->store(other.toolCallId);
+        msg.toolName = arena->store(other.toolName);
+        return records.emplace_back(msg);
+    }
+
+    void clear() {
+        records.clear();
+        arena = std::make_shared<messageArena>();
+    }
+
+    // Replaces the messages before `from` with one assistant message holding their summary
+    void compact(size_t from, std::string_view summary) {
+        messageStore kept;
+        kept.records.reserve(records.size() - from + 1);
+        kept.append(messageRole::assistant, summary);
+        for (size_t i = from; i < records.size(); ++i) {
+            kept.append(records[i]);
+        }
+        *this = std::move(kept);
+    }
+
+    // Messages [from, to) as they are now, later changes to the store don't affect it
+    messageList snapshot(size_t from = 0, size_t to = std::string::npos) const {
+        to = std::min(to, records.size());
+        from = std::min(from, to);
+        return messageList(arena, std::vector<chatMessage>(records.begin() + from, records.begin() + to));
+    }
+
+    auto begin() { return records.begin(); }
+    auto end() { return records.end(); }
+    auto begin() const { return records.begin(); }
+    auto end() const { return records.end(); }
+    size_t size() const { return records.size(); }
+    bool empty() const { return records.empty(); }
+    chatMessage& operator[](size_t index) { return records[index]; }
+    const chatMessage& operator[](size_t index) const { return records[index]; }
+    chatMessage& back() { return records.back(); }
+    const chatMessage& back() const { return records.back(); }
+
+    size_t textBytes() const {
+        return arena->bytesUsed();
+    }
+
+    size_t reservedBytes() const {
+        return arena->bytesReserved() + records.capacity() * sizeof(chatMessage);
+    }
+
+private:
+    std::shared_ptr<messageArena> arena = std::make_shared<messageArena>();
+    std::vector<chatMessage> records;
+};
\ No newline at end of file
@@ -7,45 +7,190 @@
 #include <curl/curl.h>
 #include "llmclient.hpp"
 #include "httpclient.hpp"
+#include "requestbody.hpp"
 
 class OpenAIClient : public LLMClient, public HttpClient {
 private:
     std::string apiKey;
     std::string baseUrl;
+    requestBody requestBuilder{toJson};
 public:
     OpenAIClient(const std::string& baseUrl, const std::string& api_key);
     ~OpenAIClient() = default;
 
-    std::string chat(const std::vector<std::pair<std::string, std::string>>& messages,
-                     const std::string& systemPrompt = "");
+    std::string chat(const messageList& messages,
+                     const std::string& systemPrompt = "",
+                     const chatOptions& options = {}) override;
+
+    std::string chatStream(const std::string& body, const streamCallback& onToken, const std::atomic<bool>* cancel = nullptr);
+
+    static nlohmann::json toOpenAIToolCalls(const nlohmann::json& toolCalls);
+
+    static nlohmann::json toJson(const chatMessage& msg);
 
     void setModel(const std::string& model);
 };
 
 inline OpenAIClient::OpenAIClient(const std::string& baseURL, const std::string& api_key) : apiKey(api_key), baseUrl(baseURL) {}
 
-inline std::string OpenAIClient::chat(const std::vector<std::pair<std::string, std::string>>& messages,
-                                       const std::string& systemPrompt) {
-    nlohmann::json payload;
-    payload["model"] = getModel();
-
-    nlohmann::json messagesJson;
-    if (!systemPrompt.empty()) {
-        messagesJson.push_back({{"role", "system"}, {"content", systemPrompt}});
+inline std::string OpenAIClient::chat(const messageList& messages,
+                                       const std::string& systemPrompt,
+                                       const chatOptions& options) {
+    nlohmann::json head = {{"model", getModel()}};
+    if (options.onToken) {
+        head["stream"] = true;
     }
-
-    for (const auto& msg : messages) {
-        messagesJson.push_back({{"role", msg.first}, {"content", msg.second}});
+    if (!options.tools.empty()) {
+        head["tools"] = options.tools;
     }
+    const std::string& body = requestBuilder.build(head, systemPrompt, messages);
 
-    payload["messages"] = messagesJson;
+    if (options.onToken) {
+        return chatStream(body, options.onToken, options.cancel.get());
+    }
 
-    std::string response = makeRequest(baseUrl, payload, apiKey, true);
+    long status = 0;
+    std::string response = makeRequest(baseUrl, body, apiKey, true, &status);
+    if (response.empty()) {
+        return connectionError(baseUrl);
+    }
 
     try {
         auto jsonResponse = nlohmann::json::parse(response);
-        return jsonResponse["choices"][0].dump();
+        if (jsonResponse.contains("error")) {
+            return nlohmann::json{{"error", jsonResponse["error"]}, {"http_status", status}}.dump();
+        }
+        auto choice = jsonResponse["choices"][0];
+        if (jsonResponse.contains("usage")) {
+            choice["prompt_eval_count"] = jsonResponse["usage"].value("prompt_tokens", 0);
+            choice["eval_count"] = jsonResponse["usage"].value("completion_tokens", 0);
+        }
+        if (choice.contains("message") && choice["message"].contains("tool_calls")) {
+            choice["message"]["tool_calls"] = normalizeToolCalls(choice["message"]["tool_calls"]);
+        }
+        return choice.dump();
     } catch (...) {
         return "Error parsing response";
     }
-};
\ No newline at end of file
+}
+
+inline nlohmann::json OpenAIClient::toJson(const chatMessage& msg) {
+    nlohmann::json msgJson = {{"role", roleName(msg.role)}, {"content", msg.content}};
+    if (!msg.toolCalls.empty()) {
+        msgJson["tool_calls"] = toOpenAIToolCalls(msg.toolCallsJson());
+    }
+    if (msg.role == messageRole::tool) {
+        msgJson["tool_call_id"] = msg.toolCallId;
+    }
+    return msgJson;
+}
+
+// OpenAI wants the arguments of earlier calls back as a JSON string
+inline nlohmann::json OpenAIClient::toOpenAIToolCalls(const nlohmann::json& toolCalls) {
+    nlohmann::json calls = nlohmann::json::array();
+    for (const auto& call : toolCalls) {
+        calls.push_back({
+            {"id", call["id"]},
+            {"type", "function"},
+            {"function", {
+                {"name", call["function"]["name"]},
+                {"arguments", call["function"]["arguments"].dump()}
+            }}
+        });
+    }
+    return calls;
+}
+
+// Server-sent events: "data: {...choices[0].delta.content...}" lines, terminated by "data: [DONE]".
+// Returns the same shape as a non-streamed choice so callers don't need to care.
+inline std::string OpenAIClient::chatStream(const std::string& body, const streamCallback& onToken, const std::atomic<bool>* cancel) {
+    std::string content;
+    std::string finishReason;
+    nlohmann::json toolCalls = nlohmann::json::array();
+    std::string otherLines;
+    nlohmann::json usage;
+    long status = 0;
+    bool ok = makeStreamingRequest(baseUrl, body, [&](const std::string& line) {
+        if (!line.starts_with("data:")) {
+            otherLines += line; // comments, event names, keep-alives or a plain JSON error body
+            return true;
+        }
+        std::string data = line.substr(5);
+        if (!data.empty() && data.front() == ' ') {
+            data.erase(0, 1);
+        }
+        if (data == "[DONE]") {
+            return false;
+        }
+        auto chunk = nlohmann::json::parse(data, nullptr, false);
+        if (!chunk.is_discarded() && chunk.contains("usage") && chunk["usage"].is_object()) {
+            usage = chunk["usage"];
+        }
+        if (chunk.is_discarded() || !chunk.contains("choices") || chunk["choices"].empty()) {
+            return true;
+        }
+        const auto& choice = chunk["choices"][0];
+        if (choice.contains("finish_reason") && choice["finish_reason"].is_string()) {
+            finishReason = choice["finish_reason"];
+        }
+        if (!choice.contains("delta")) {
+            return true;
+        }
+        // Tool calls are streamed in fragments keyed by index, arguments arrive piece by piece
+        if (choice["delta"].contains("tool_calls")) {
+            for (const auto& fragment : choice["delta"]["tool_calls"]) {
+                size_t index = fragment.value("index", 0);
+                while (toolCalls.size() <= index) {
+                    toolCalls.push_back({{"id", ""}, {"function", {{"name", ""}, {"arguments", ""}}}});
+                }
+                auto& call = toolCalls[index];
+                if (fragment.contains("id") && fragment["id"].is_string()) {
+                    call["id"] = fragment["id"];
+                }
+                if (fragment.contains("function")) {
+                    const auto& function = fragment["function"];
+                    if (function.contains("name") && function["name"].is_string()) {
+                        call["function"]["name"] = call["function"]["name"].get<std::string>() + function["name"].get<std::string>();
+                    }
+                    if (function.contains("arguments") && function["arguments"].is_string()) {
+                        call["function"]["arguments"] = call["function"]["arguments"].get<std::string>() + function["arguments"].get<std::string>();
+                    }
+                }
+            }
+        }
+        if (!choice["delta"].contains("content") || !choice["delta"]["content"].is_string()) {
+            return true;
+        }
+        std::string piece = choice["delta"]["content"];
+        if (piece.empty()) {
+            return true;
+        }
+        content += piece;
+        return onToken(piece);
+    }, apiKey, cancel, &status);
+
+    if (!ok) {
+        return connectionError(baseUrl);
+    }
+
+    if (content.empty() && toolCalls.empty()) {
+        auto error = nlohmann::json::parse(otherLines, nullptr, false);
+        if (!error.is_discarded() && error.is_object() && error.contains("error")) {
+            return nlohmann::json{{"error", error["error"]}, {"http_status", status}}.dump();
+        }
+    }
+
+    nlohmann::json choice = {
+        {"index", 0},
+        {"message", {{"role", "assistant"}, {"content", content}}},
+        {"finish_reason", finishReason}
+    };
+    if (!toolCalls.empty()) {
+        choice["message"]["tool_calls"] = normalizeToolCalls(toolCalls);
+    }
+    if (usage.is_object()) {
+        choice["prompt_eval_count"] = usage.value("prompt_tokens", 0);
+        choice["eval_count"] = usage.value("completion_tokens", 0);
+    }
+    return choice.dump();
+}
\ No newline at end of file
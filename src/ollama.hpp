@@ -2,6 +2,7 @@
 
 #include "llmclient.hpp"
 #include "httpclient.hpp"
+#include "requestbody.hpp"
 #include <string>
 #include <vector>
 #include <functional>
@@ -17,47 +18,129 @@ private:
     int min_p = 0;
     float top_p = 0.8f;
     float repetition_penalty = 1.05f;
+    nlohmann::json keepAlive = "30m"; // how long the server keeps the model (and its KV cache) loaded
+    requestBody requestBuilder{toJson};
+
+    static nlohmann::json toJson(const chatMessage& msg) {
+        nlohmann::json msgJson = {
+            {"role", roleName(msg.role)},
+            {"content", msg.content}
+        };
+        if (!msg.toolCalls.empty()) {
+            msgJson["tool_calls"] = msg.toolCallsJson();
+        }
+        if (!msg.toolName.empty()) {
+            msgJson["tool_name"] = msg.toolName;
+        }
+        return msgJson;
+    }
 
 public:
-    explicit OllamaClient(const std::string& url = "http://localhost:11434") : baseUrl(url) {
-        curl_global_init(CURL_GLOBAL_DEFAULT);
+    explicit OllamaClient(const std::string& url = "http://localhost:11434") : baseUrl(url) {}
+
+    // Duration string ("30m", "2h") or seconds, a negative number keeps the model loaded forever
+    void setKeepAlive(const nlohmann::json& duration) {
+        keepAlive = duration;
     }
 
-    ~OllamaClient() {
-        curl_global_cleanup();
+    nlohmann::json getRequestOptions() const override {
+        return {
+            {"temperature", temperature},
+            {"top_k", top_k},
+            {"min_p", min_p},
+            {"top_p", top_p},
+            {"repeat_penalty", repetition_penalty},
+        };
     }
 
-    std::string chat(const std::vector<std::pair<std::string, std::string>>& messages,
-                     const std::string& systemPrompt = "") override {
-        nlohmann::json payload = {
+    std::string chat(const messageList& messages,
+                     const std::string& systemPrompt = "",
+                     const chatOptions& options = {}) override {
+        nlohmann::json head = {
             {"model", getModel()},
-            {"messages", nlohmann::json::array()},
-            {"stream", false},
+            {"stream", static_cast<bool>(options.onToken)},
             {"think", false},
-            {"options", {
-                {"temperature", temperature},
-                {"top_k", top_k},
-                {"min_p", min_p},
-                {"top_p", top_p},
-                {"repeat_penalty", repetition_penalty},
-            }}
+            {"keep_alive", keepAlive},
+            {"options", getRequestOptions()}
         };
+        if (!options.tools.empty()) {
+            head["tools"] = options.tools;
+        }
+        const std::string& body = requestBuilder.build(head, systemPrompt, messages);
 
-        if (!systemPrompt.empty()) {
-            payload["messages"].push_back({
-                {"role", "system"},
-                {"content", systemPrompt}
-            });
+        if (options.onToken) {
+            return chatStream(body, options.onToken, options.cancel.get());
         }
 
-        for (const auto& msg : messages) {
-            payload["messages"].push_back({
-                {"role", msg.first},
-                {"content", msg.second}
-            });
+        long status = 0;
+        std::string response = makeRequest(baseUrl + "/api/chat", body, "", true, &status);
+        if (response.empty()) return connectionError(baseUrl);
+        auto json = nlohmann::json::parse(response, nullptr, false);
+        if (!json.is_discarded() && json.contains("error")) {
+            json["http_status"] = status;
+            return json.dump();
         }
+        if (json.is_discarded() || !json.contains("message") || !json["message"].contains("tool_calls")) {
+            return response;
+        }
+        json["message"]["tool_calls"] = normalizeToolCalls(json["message"]["tool_calls"]);
+        return json.dump();
+    }
 
-        return makeRequest(baseUrl + "/api/chat", payload, "", true);
+    // Ollama streams NDJSON, one chunk per line: {"message":{"content":"..."},"done":false}
+    // The final chunk (done == true) carries the stats, the content is assembled here.
+    std::string chatStream(const std::string& body, const streamCallback& onToken, const std::atomic<bool>* cancel = nullptr) {
+        std::string content;
+        nlohmann::json toolCalls = nlohmann::json::array();
+        nlohmann::json envelope = nlohmann::json::object();
+        long status = 0;
+        bool ok = makeStreamingRequest(baseUrl + "/api/chat", body, [&](const std::string& line) {
+            auto chunk = nlohmann::json::parse(line, nullptr, false);
+            if (chunk.is_discarded()) {
+                spdlog::warn("Skipping malformed stream chunk: {}", line);
+                return true;
+            }
+            if (chunk.contains("error")) {
+                envelope = chunk;
+                return false;
+            }
+            if (chunk.value("done", false)) {
+                envelope = chunk;
+            }
+            if (!chunk.contains("message")) {
+                return true;
+            }
+            // Tool calls arrive complete, in a chunk of their own
+            if (chunk["message"].contains("tool_calls")) {
+                for (const auto& call : chunk["message"]["tool_calls"]) {
+                    toolCalls.push_back(call);
+                }
+            }
+            if (!chunk["message"].contains("content")) {
+                return true;
+            }
+            std::string piece = chunk["message"]["content"];
+            if (piece.empty()) {
+                return true;
+            }
+            content += piece;
+            return onToken(piece);
+        }, "", cancel, &status);
+
+        if (!ok) return connectionError(baseUrl);
+        if (envelope.contains("error")) {
+            envelope["http_status"] = status;
+            return envelope.dump();
+        }
+
+        envelope["message"] = {
+            {"role", "assistant"},
+            {"content", content}
+        };
+        if (!toolCalls.empty()) {
+            envelope["message"]["tool_calls"] = normalizeToolCalls(toolCalls);
+        }
+        return envelope.dump();
     }
 
     std::vector<std::string> listModels() override {
@@ -65,7 +148,8 @@ public:
 
         if (response.empty()) return {};
 
-        auto json = nlohmann::json::parse(response);
+        auto json = nlohmann::json::parse(response, nullptr, false);
+        if (json.is_discarded() || !json.contains("models")) return {};
         std::vector<std::string> models;
         for (const auto& model : json["models"]) {
             models.push_back(model["name"]);
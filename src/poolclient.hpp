@@ -0,0 +1,349 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <condition_variable>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include "llmclient.hpp"
+
+enum class routingPolicy { leastOutstanding, latency };
+
+struct poolOptions {
+    routingPolicy routing = routingPolicy::leastOutstanding;
+    unsigned int maxAttempts = 3;                 // rounds per request, each on another endpoint if possible
+    std::chrono::milliseconds retryBackoff{250};  // doubled every round
+    std::chrono::milliseconds hedgeDelay{0};      // 0 = no hedged requests
+    std::chrono::seconds healthInterval{15};      // 0 = no probes, failed endpoints rest for 30s
+};
+
+// Spreads requests over several servers running the same model. Every request goes to the
+// endpoint with the fewest requests in flight (or the lowest measured latency), connection
+// failures are retried elsewhere with backoff and a request that shows no output within the
+// hedge delay is also sent to a second endpoint, whichever answers first wins.
+// Endpoints are probed with listModels(), hosts that are down or miss the model are skipped.
+class PoolLLMClient : public LLMClient {
+private:
+    struct endpoint {
+        std::string name;
+        std::unique_ptr<LLMClient> client;
+        unsigned int outstanding = 0;
+        double latencyMs = 0; // moving average of the time to the first token, 0 until measured
+        std::chrono::steady_clock::time_point downUntil{};
+    };
+
+    // One request sent to one endpoint
+    struct attempt {
+        size_t endpointIndex = 0;
+        std::chrono::steady_clock::time_point started;
+        bool sawOutput = false;
+        bool done = false;
+        bool cancelled = false;
+        std::shared_ptr<std::atomic<bool>> cancel = std::make_shared<std::atomic<bool>>(false);
+        std::string result;
+        std::future<void> job;
+    };
+
+    // Shared by the attempts of one chat() call, the first attempt to produce output wins
+    struct requestRace {
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::vector<std::shared_ptr<attempt>> attempts;
+        std::shared_ptr<attempt> winner;
+        bool forwarded = false; // the caller has seen tokens, retrying would repeat them
+    };
+
+    std::vector<std::unique_ptr<endpoint>> endpoints;
+    poolOptions options;
+    std::mutex statsMutex;
+    std::mutex stragglerMutex;
+    std::vector<std::future<void>> stragglers; // losing attempts that have not noticed yet
+
+    std::thread healthThread;
+    std::mutex healthMutex;
+    std::condition_variable healthWake;
+    bool stopping = false;
+
+    double score(const endpoint& target) const {
+        if (options.routing == routingPolicy::latency) {
+            return target.latencyMs * (target.outstanding + 1);
+        }
+        return target.outstanding * 1e9 + target.latencyMs;
+    }
+
+    // Picks the best endpoint, preferring ones that are up and were not tried for this request yet.
+    // Counts the new request as outstanding on it.
+    size_t reserve(const std::vector<size_t>& avoid) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        auto now = std::chrono::steady_clock::now();
+        size_t best = endpoints.size();
+        int bestRank = 4;
+        for (size_t i = 0; i < endpoints.size(); ++i) {
+            const auto& target = *endpoints[i];
+            bool avoided = std::find(avoid.begin(), avoid.end(), i) != avoid.end();
+            int rank = (now < target.downUntil ? 1 : 0) + (avoided ? 2 : 0);
+            if (rank < bestRank || (rank == bestRank && score(target) < score(*endpoints[best]))) {
+                best = i;
+                bestRank = rank;
+            }
+        }
+        endpoints[best]->outstanding++;
+        return best;
+    }
+
+    void recordLatency(size_t index, std::chrono::steady_clock::duration elapsed) {
+        double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+        std::lock_guard<std::mutex> lock(statsMutex);
+        auto& target = *endpoints[index];
+        target.latencyMs = target.latencyMs == 0 ? ms : 0.7 * target.latencyMs + 0.3 * ms;
+    }
+
+    void markDown(size_t index, std::chrono::seconds duration) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        endpoints[index]->downUntil = std::chrono::steady_clock::now() + duration;
+    }
+
+    std::chrono::seconds restDuration() const {
+        return options.healthInterval.count() > 0 ? options.healthInterval * 2 : std::chrono::seconds(30);
+    }
+
+    std::shared_ptr<attempt> launch(const std::shared_ptr<requestRace>& race, size_t index,
+                                    const messageList& messages, const std::string& systemPrompt,
+                                    const chatOptions& callerOptions) {
+        auto current = std::make_shared<attempt>();
+        current->endpointIndex = index;
+        current->started = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            race->attempts.push_back(current);
+        }
+        spdlog::debug("Sending request to {}", endpoints[index]->name);
+
+        // Always streamed, that is how a losing attempt gets cancelled
+        chatOptions attemptOptions = callerOptions;
+        attemptOptions.cancel = current->cancel;
+        streamCallback callerToken = callerOptions.onToken;
+        attemptOptions.onToken = [this, race, current, callerToken](const std::string& piece) {
+            {
+                std::lock_guard<std::mutex> lock(race->mutex);
+                if (!current->sawOutput) {
+                    current->sawOutput = true;
+                    recordLatency(current->endpointIndex, std::chrono::steady_clock::now() - current->started);
+                }
+                if (!race->winner) {
+                    race->winner = current;
+                    race->changed.notify_all();
+                }
+                if (race->winner != current) {
+                    current->cancelled = true;
+                    return false;
+                }
+                if (callerToken) {
+                    race->forwarded = true;
+                }
+            }
+            return callerToken ? callerToken(piece) : true;
+        };
+
+        LLMClient* client = endpoints[index]->client.get();
+        current->job = std::async(std::launch::async, [this, race, current, client, messages, systemPrompt, attemptOptions]() {
+            std::string result;
+            try {
+                result = client->chat(messages, systemPrompt, attemptOptions);
+            } catch (const std::exception& e) {
+                result = nlohmann::json{{"error", e.what()}}.dump();
+            }
+            bool failed = isConnectionError(nlohmann::json::parse(result, nullptr, false));
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                endpoints[current->endpointIndex]->outstanding--;
+            }
+            if (failed) {
+                spdlog::warn("Endpoint {} did not answer", endpoints[current->endpointIndex]->name);
+                markDown(current->endpointIndex, restDuration());
+            } else if (!current->sawOutput) {
+                recordLatency(current->endpointIndex, std::chrono::steady_clock::now() - current->started);
+            }
+            std::lock_guard<std::mutex> lock(race->mutex);
+            current->result = std::move(result);
+            current->done = true;
+            // Tool calls or errors may come without any streamed text, finishing first wins then
+            if (!race->winner && !failed) {
+                race->winner = current;
+            }
+            race->changed.notify_all();
+        });
+        return current;
+    }
+
+    // Cancels the attempts that lost the race and hands them to the straggler list,
+    // chat() doesn't wait for them to wind down
+    void abandon(const std::shared_ptr<requestRace>& race) {
+        std::lock_guard<std::mutex> lock(stragglerMutex);
+        for (auto& current : race->attempts) {
+            current->cancel->store(true);
+            if (current->job.valid()) {
+                stragglers.push_back(std::move(current->job));
+            }
+        }
+        stragglers.erase(std::remove_if(stragglers.begin(), stragglers.end(), [](const std::future<void>& job) {
+            return job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }), stragglers.end());
+    }
+
+    bool hasModel(const std::vector<std::string>& models) {
+        std::string model = getModel();
+        if (model.empty()) {
+            return !models.empty();
+        }
+        return std::any_of(models.begin(), models.end(), [&model](const std::string& name) {
+            return name == model || name == model + ":latest";
+        });
+    }
+
+    void healthLoop() {
+        std::unique_lock<std::mutex> lock(healthMutex);
+        while (!stopping) {
+            lock.unlock();
+            for (size_t i = 0; i < endpoints.size(); ++i) {
+                std::vector<std::string> models;
+                try {
+                    models = endpoints[i]->client->listModels();
+                } catch (const std::exception& e) {
+                    spdlog::debug("Health check of {} failed: {}", endpoints[i]->name, e.what());
+                }
+                bool healthy = hasModel(models);
+                std::lock_guard<std::mutex> statsLock(statsMutex);
+                auto& target = *endpoints[i];
+                bool wasDown = std::chrono::steady_clock::now() < target.downUntil;
+                if (healthy) {
+                    target.downUntil = {};
+                } else {
+                    target.downUntil = std::chrono::steady_clock::now() + restDuration();
+                }
+                if (wasDown == healthy) {
+                    spdlog::info("Endpoint {} is {}", target.name, healthy ? "up" : "down or missing the model");
+                }
+            }
+            lock.lock();
+            healthWake.wait_for(lock, options.healthInterval, [this] { return stopping; });
+        }
+    }
+
+public:
+    PoolLLMClient(std::vector<std::pair<std::string, std::unique_ptr<LLMClient>>> clients, const poolOptions& pool = {})
+        : options(pool) {
+        for (auto& [name, client] : clients) {
+            auto target = std::make_unique<endpoint>();
+            target->name = name;
+            target->client = std::move(client);
+            endpoints.push_back(std::move(target));
+        }
+        if (endpoints.empty()) {
+            throw std::invalid_argument("PoolLLMClient needs at least one endpoint");
+        }
+        setModel(endpoints.front()->client->getModel());
+        options.maxAttempts = std::max(1u, options.maxAttempts);
+        if (options.healthInterval.count() > 0) {
+            healthThread = std::thread(&PoolLLMClient::healthLoop, this);
+        }
+    }
+
+    ~PoolLLMClient() override {
+        {
+            std::lock_guard<std::mutex> lock(healthMutex);
+            stopping = true;
+        }
+        healthWake.notify_all();
+        if (healthThread.joinable()) {
+            healthThread.join();
+        }
+        std::lock_guard<std::mutex> lock(stragglerMutex);
+        for (auto& job : stragglers) {
+            job.wait();
+        }
+    }
+
+    std::string chat(const messageList& messages,
+                     const std::string& systemPrompt = "",
+                     const chatOptions& callerOptions = {}) override {
+        std::vector<size_t> tried;
+        std::string lastError = connectionError("any endpoint");
+        thread_local std::mt19937 jitter(std::random_device{}());
+
+        for (unsigned int round = 0; round < options.maxAttempts; ++round) {
+            if (round > 0) {
+                auto backoff = options.retryBackoff * (1 << std::min(round - 1, 6u));
+                backoff += std::chrono::milliseconds(std::uniform_int_distribution<long>(0, backoff.count() / 2)(jitter));
+                spdlog::info("Retrying request in {} ms", backoff.count());
+                std::this_thread::sleep_for(backoff);
+            }
+
+            auto race = std::make_shared<requestRace>();
+            size_t primary = reserve(tried);
+            tried.push_back(primary);
+            launch(race, primary, messages, systemPrompt, callerOptions);
+
+            std::unique_lock<std::mutex> lock(race->mutex);
+            auto anyProgress = [&race] {
+                return race->winner || std::all_of(race->attempts.begin(), race->attempts.end(),
+                    [](const std::shared_ptr<attempt>& current) { return current->done; });
+            };
+            if (options.hedgeDelay.count() > 0 && endpoints.size() > 1 &&
+                !race->changed.wait_for(lock, options.hedgeDelay, anyProgress)) {
+                lock.unlock();
+                size_t hedge = reserve(tried);
+                tried.push_back(hedge);
+                spdlog::info("No output from {} after {} ms, also asking {}", endpoints[primary]->name,
+                    options.hedgeDelay.count(), endpoints[hedge]->name);
+                launch(race, hedge, messages, systemPrompt, callerOptions);
+                lock.lock();
+            }
+
+            race->changed.wait(lock, [&race] {
+                bool allDone = std::all_of(race->attempts.begin(), race->attempts.end(),
+                    [](const std::shared_ptr<attempt>& current) { return current->done; });
+                return (race->winner && race->winner->done) || allDone;
+            });
+
+            auto winner = race->winner;
+            bool forwarded = race->forwarded;
+            lock.unlock();
+            abandon(race);
+
+            if (winner && (!isConnectionError(nlohmann::json::parse(winner->result, nullptr, false)) || forwarded)) {
+                return winner->result;
+            }
+            // Nobody answered, or the winner dropped before the caller saw anything
+            for (const auto& current : race->attempts) {
+                if (current->done && !current->cancelled) {
+                    lastError = current->result;
+                }
+            }
+        }
+        return lastError;
+    }
+
+    // Every endpoint is configured alike, the first one stands for all in response cache keys
+    nlohmann::json getRequestOptions() const override {
+        return endpoints.front()->client->getRequestOptions();
+    }
+
+    std::vector<std::string> listModels() override {
+        for (const auto& target : endpoints) {
+            auto models = target->client->listModels();
+            if (!models.empty()) {
+                return models;
+            }
+        }
+        return {};
+    }
+};
\ No newline at end of file
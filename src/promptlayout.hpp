@@ -0,0 +1,101 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include "llmclient.hpp"
+
+// Servers reuse their KV cache only for the part of a request that is byte-identical to the
+// previous one. Requests are laid out as [system prompt + tool catalog][message 0][message 1]...
+// and the history is append-only between compressions, so normally only the new messages at the
+// end have to be evaluated. This tracks how much of each request matched the previous one.
+class promptLayout {
+public:
+    struct reuseReport {
+        size_t reusedBytes = 0;
+        size_t totalBytes = 0;
+        size_t firstChangedMessage = 0; // index into the history, history size when only new messages were added
+
+        double ratio() const {
+            return totalBytes == 0 ? 0.0 : static_cast<double>(reusedBytes) / totalBytes;
+        }
+    };
+
+private:
+    struct fragment {
+        uint64_t hash = 0;
+        size_t bytes = 0;
+
+        bool operator==(const fragment& other) const {
+            return hash == other.hash && bytes == other.bytes;
+        }
+    };
+
+    fragment header;                  // system prompt and tool catalog, serialized once per change
+    bool headerValid = false;
+    std::vector<fragment> messages;   // fragments of the current history, appended as it grows
+    unsigned int historyEpoch = 0;
+    fragment lastHeader;
+    std::vector<fragment> lastRequest;
+
+    static uint64_t fnv1a(std::string_view data, uint64_t hash = 1469598103934665603ULL) {
+        for (unsigned char c : data) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Hashed in place, field by field, the message text is not copied
+    static fragment makeFragment(const chatMessage& msg) {
+        uint64_t hash = fnv1a(roleName(msg.role));
+        size_t bytes = roleName(msg.role).size();
+        for (std::string_view field : {msg.content, msg.toolCallId, msg.toolName, msg.toolCalls}) {
+            hash = fnv1a(field, fnv1a(std::string_view("\0", 1), hash));
+            bytes += field.size() + 1;
+        }
+        return {hash, bytes};
+    }
+
+public:
+    // The tool catalog is serialized here once, callers must call this whenever prompt or tools change
+    void setHeader(const std::string& systemPrompt, const nlohmann::json& tools) {
+        std::string serialized = systemPrompt + '\0' + (tools.empty() ? "" : tools.dump());
+        header = {fnv1a(serialized), serialized.size()};
+        headerValid = true;
+    }
+
+    // Compares the request about to be sent with the previous one. Messages are hashed once,
+    // a different epoch means the history was rewritten and everything is hashed again.
+    reuseReport track(const messageList& history, unsigned int epoch) {
+        if (epoch != historyEpoch || history.size() < messages.size()) {
+            messages.clear();
+            historyEpoch = epoch;
+        }
+        for (size_t i = messages.size(); i < history.size(); ++i) {
+            messages.push_back(makeFragment(history[i]));
+        }
+
+        reuseReport report;
+        report.totalBytes = header.bytes;
+        for (const auto& msg : messages) {
+            report.totalBytes += msg.bytes;
+        }
+
+        report.firstChangedMessage = 0;
+        if (headerValid && header == lastHeader) {
+            report.reusedBytes = header.bytes;
+            while (report.firstChangedMessage < messages.size() &&
+                   report.firstChangedMessage < lastRequest.size() &&
+                   messages[report.firstChangedMessage] == lastRequest[report.firstChangedMessage]) {
+                report.reusedBytes += messages[report.firstChangedMessage].bytes;
+                report.firstChangedMessage++;
+            }
+        }
+
+        lastHeader = header;
+        lastRequest = messages;
+        return report;
+    }
+};
\ No newline at end of file
@@ -1,38 +1,225 @@
 #pragma once
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/stat.h>
 #include <nlohmann/json.hpp>
 #include "tool.hpp"
+#include "mappedfile.hpp"
+
+// Where every line of a file starts, so reading line N of a large file doesn't scan up to it
+// again on every call. Kept for the few files read most recently, invalidated by mtime/size.
+class lineIndexCache {
+private:
+    static constexpr size_t maxEntries = 16;
+
+    struct entry {
+        std::string path;
+        int64_t mtime;
+        uint64_t size;
+        std::shared_ptr<const std::vector<size_t>> starts;
+    };
+
+    std::mutex cacheMutex;
+    std::list<entry> entries; // most recently used first
+
+public:
+    std::shared_ptr<const std::vector<size_t>> get(const std::string& path, const struct stat& info, std::string_view text) {
+        int64_t mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                if (it->path == path && it->mtime == mtime && it->size == static_cast<uint64_t>(info.st_size)) {
+                    entries.splice(entries.begin(), entries, it);
+                    return it->starts;
+                }
+            }
+        }
+
+        auto starts = std::make_shared<std::vector<size_t>>();
+        starts->push_back(0);
+        const char* begin = text.data();
+        const char* end = begin + text.size();
+        for (const char* p = begin; p < end;) {
+            const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!newline || newline + 1 == end) break;
+            starts->push_back(static_cast<size_t>(newline + 1 - begin));
+            p = newline + 1;
+        }
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        std::erase_if(entries, [&](const entry& old) { return old.path == path; });
+        entries.push_front({path, mtime, static_cast<uint64_t>(info.st_size), starts});
+        if (entries.size() > maxEntries) entries.pop_back();
+        return starts;
+    }
+};
 
 class readFileTool : public agentTool {
 public:
-    readFileTool() : agentTool(
+    using tokenCountFunction = std::function<unsigned int(std::string_view)>;
+
+private:
+    static constexpr size_t binaryProbeSize = 8192;
+
+    unsigned int maxTokens;
+    tokenCountFunction countTokens;
+    std::shared_ptr<lineIndexCache> lineIndexes = std::make_shared<lineIndexCache>(); // shared by all clones
+
+    static std::string humanSize(uint64_t bytes) {
+        if (bytes < 1024) return std::to_string(bytes) + " bytes";
+        if (bytes < 1024 * 1024) return std::to_string(bytes / 1024) + " KB";
+        return fmt::format("{:.1f} MB", bytes / (1024.0 * 1024.0));
+    }
+
+    static std::string binaryKind(std::string_view text) {
+        static const std::vector<std::pair<std::string_view, std::string>> magics = {
+            {"\x7f" "ELF", "ELF executable or library"}, {"\x89PNG", "PNG image"}, {"\xff\xd8\xff", "JPEG image"},
+            {"GIF8", "GIF image"}, {"%PDF", "PDF document"}, {"PK\x03\x04", "zip archive"},
+            {"\x1f\x8b", "gzip archive"}, {"BZh", "bzip2 archive"}, {"\xfd" "7zXZ", "xz archive"},
+            {"\x28\xb5\x2f\xfd", "zstd archive"}, {"!<arch>", "static library"}, {"SQLite format 3", "SQLite database"},
+            {"\xca\xfe\xba\xbe", "Java class or Mach-O"}, {"\0asm", "WebAssembly module"}};
+        for (const auto& [magic, kind] : magics) {
+            if (text.substr(0, magic.size()) == magic) return kind;
+        }
+        return "binary data";
+    }
+
+    unsigned int tokensOf(std::string_view text) const {
+        return countTokens ? countTokens(text) : static_cast<unsigned int>(text.size() / 4 + 1);
+    }
+
+public:
+    // maxTokens caps what one call returns, countTokens should match the conversation's count
+    explicit readFileTool(unsigned int tokenBudget = 8000, tokenCountFunction tokenCounter = nullptr) : agentTool(
         "Read File",
-        "Reads the contents of a file and returns it as text",
-        "file_path: string - path to the file to read",
+        R"(Reads the contents of a file and returns it as text. Large files are cut off at a size limit,
+        read the rest with start_line/end_line. Binary files are only described)",
+        "file_path: string - path to the file to read, start_line: int - first line to read counting from 1 (optional), end_line: int - last line to read (optional), offset: int - byte offset to read from instead of lines (optional), length: int - number of bytes to read from offset (optional)",
         "cat "
-    ) {}
+    ), maxTokens(tokenBudget), countTokens(std::move(tokenCounter)) {}
 
     std::unique_ptr<agentTool> clone() const override {
         return std::make_unique<readFileTool>(*this);
     }
 
+    std::vector<std::string> resultDependencies(const nlohmann::json& params) const override {
+        if (!params.contains("file_path") || !params["file_path"].is_string()) return {};
+        return {params["file_path"].get<std::string>()};
+    }
+
+    bool isReadOnly() const override {
+        return true;
+    }
+
     std::string executeImpl(const std::string& params) override {
         try {
             nlohmann::json paramJson = nlohmann::json::parse(params);
             std::string filePath = paramJson["file_path"];
-            
-            std::ifstream file(filePath);
-            if (!file.is_open()) {
+
+            mappedFile file;
+            struct stat info;
+            if (stat(filePath.c_str(), &info) != 0 || !file.open(filePath)) {
                 return "Error: Could not open file " + filePath;
             }
-            
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            file.close();
-            
-            return buffer.str();
+            std::string_view text = file.view();
+            if (text.empty()) {
+                return "";
+            }
+            if (std::memchr(text.data(), '\0', std::min(text.size(), binaryProbeSize))) {
+                return "Binary file " + filePath + " (" + binaryKind(text) + ", " + humanSize(text.size()) + "), contents not shown";
+            }
+
+            auto number = [&](const char* key) -> long long {
+                if (!paramJson.contains(key) || paramJson[key].is_null()) return 0;
+                const auto& value = paramJson[key];
+                return value.is_string() ? std::strtoll(value.get<std::string>().c_str(), nullptr, 10) : value.get<long long>();
+            };
+            for (const char* key : {"start_line", "end_line", "offset", "length"}) {
+                if (!paramJson.contains(key) || paramJson[key].is_null() || paramJson[key].is_number()) continue;
+                std::string given = paramJson[key].is_string() ? paramJson[key].get<std::string>() : "";
+                char* end = nullptr;
+                errno = 0;
+                std::strtoll(given.c_str(), &end, 10);
+                if (given.empty() || *end != '\0' || errno != 0) {
+                    return std::string("Error: ") + key + " must be an integer, got " + paramJson[key].dump();
+                }
+            }
+
+            if (paramJson.contains("offset") && !paramJson["offset"].is_null()) {
+                long long offset = number("offset");
+                long long length = paramJson.contains("length") ? number("length") : static_cast<long long>(text.size());
+                if (offset < 0 || static_cast<size_t>(offset) > text.size()) {
+                    return "Error: offset " + std::to_string(offset) + " is outside the file (" + std::to_string(text.size()) + " bytes)";
+                }
+                std::string_view range = text.substr(static_cast<size_t>(offset), static_cast<size_t>(std::max(0LL, length)));
+                // Token counts of a byte range are estimated, cutting per line doesn't apply here
+                size_t allowed = std::min(range.size(), static_cast<size_t>(maxTokens) * 4);
+                std::string result(range.substr(0, allowed));
+                size_t end = static_cast<size_t>(offset) + allowed;
+                if (allowed < text.size()) {
+                    result += "\n[Bytes " + std::to_string(offset) + "-" + std::to_string(end) + " of " + std::to_string(text.size());
+                    if (allowed < range.size()) result += ", " + humanSize(range.size() - allowed) + " of the range cut off at the size limit";
+                    result += "]";
+                }
+                return result;
+            }
+
+            auto starts = lineIndexes->get(filePath, info, text);
+            size_t totalLines = text.empty() ? 0 : starts->size();
+            long long firstLine = std::max(1LL, number("start_line"));
+            long long lastLine = number("end_line") > 0 ? number("end_line") : static_cast<long long>(totalLines);
+            lastLine = std::min(lastLine, static_cast<long long>(totalLines));
+            if (totalLines > 0 && static_cast<size_t>(firstLine) > totalLines) {
+                return "Error: start_line " + std::to_string(firstLine) + " is past the end of the file (" + std::to_string(totalLines) + " lines)";
+            }
+            if (number("end_line") > 0 && number("end_line") < firstLine) {
+                return "Error: end_line " + std::to_string(number("end_line")) + " is before start_line " + std::to_string(firstLine);
+            }
+
+            // Whole lines until the budget is used up
+            std::string result;
+            unsigned int usedTokens = 0;
+            size_t lineCutAt = 0; // bytes kept of a single line longer than the budget
+            long long line = firstLine;
+            for (; line <= lastLine; ++line) {
+                size_t begin = (*starts)[line - 1];
+                size_t end = static_cast<size_t>(line) < starts->size() ? (*starts)[line] : text.size();
+                std::string_view lineText = text.substr(begin, end - begin);
+                unsigned int lineTokens = tokensOf(lineText);
+                if (usedTokens + lineTokens > maxTokens && line > firstLine) break;
+                if (usedTokens + lineTokens > maxTokens) {
+                    // A single huge line, e.g. minified code
+                    lineText = lineText.substr(0, static_cast<size_t>(maxTokens) * 4);
+                    lineCutAt = lineText.size();
+                }
+                result += lineText;
+                usedTokens += lineTokens;
+            }
+            long long shownLast = line - 1;
+
+            bool wholeFile = firstLine == 1 && shownLast == static_cast<long long>(totalLines) && lineCutAt == 0;
+            if (!wholeFile) {
+                if (!result.empty() && result.back() != '\n') result += "\n";
+                result += "[Lines " + std::to_string(firstLine) + "-" + std::to_string(shownLast) + " of " + std::to_string(totalLines);
+                if (lineCutAt > 0) result += "; line " + std::to_string(firstLine) + " cut off after " + humanSize(lineCutAt);
+                if (shownLast < lastLine) {
+                    size_t cutBytes = (static_cast<size_t>(lastLine) < starts->size() ? (*starts)[lastLine] : text.size()) -
+                        (static_cast<size_t>(shownLast) < starts->size() ? (*starts)[shownLast] : text.size());
+                    result += "; " + std::to_string(lastLine - shownLast) + " more lines (" + humanSize(cutBytes) +
+                        ") cut off at the limit of " + std::to_string(maxTokens) + " tokens, continue with start_line=" +
+                        std::to_string(shownLast + 1);
+                }
+                result += "]";
+            }
+            return result;
         } catch (const std::exception& e) {
             return "Error reading file: " + std::string(e.what());
         }
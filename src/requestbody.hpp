@@ -0,0 +1,148 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+#include "llmclient.hpp"
+
+// Builds chat request bodies without putting the whole history into a JSON document every turn.
+// Each message is escaped into its JSON fragment once, the first time it is sent, and later
+// requests only concatenate the cached fragments into a buffer that keeps its capacity.
+// Messages are looked up by a hash of their fields and a hit is checked against the text the
+// fragment was made from, so any history works, copies included, and a collision only costs
+// a fresh fragment.
+class requestBody {
+public:
+    // The message as the server expects it, called once per distinct message
+    using messageFormat = std::function<nlohmann::json(const chatMessage&)>;
+
+    explicit requestBody(messageFormat messageToJson) : format(std::move(messageToJson)) {}
+
+    // head holds every field except "messages". The returned body is valid until the next
+    // build on the same thread.
+    const std::string& build(const nlohmann::json& head, const std::string& systemPrompt,
+                             const messageList& messages) {
+        thread_local std::string body;
+        std::string headJson = head.dump();
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        ++generation;
+        std::vector<const std::string*> parts;
+        parts.reserve(messages.size() + 1);
+        if (!systemPrompt.empty()) {
+            chatMessage system;
+            system.role = messageRole::system;
+            system.content = systemPrompt;
+            parts.push_back(&fragment(system, nullptr, [&] {
+                return nlohmann::json{{"role", "system"}, {"content", systemPrompt}};
+            }));
+        }
+        for (const auto& msg : messages) {
+            parts.push_back(&fragment(msg, messages.storage(), [&] { return format(msg); }));
+        }
+
+        size_t size = headJson.size() + 16 + parts.size();
+        for (const auto* part : parts) {
+            size += part->size();
+        }
+        body.clear();
+        body.reserve(size);
+        body.append(headJson, 0, headJson.size() - 1); // without the closing brace
+        body += headJson.size() > 2 ? ",\"messages\":[" : "\"messages\":[";
+        for (size_t i = 0; i < parts.size(); ++i) {
+            if (i > 0) body += ',';
+            body += *parts[i];
+        }
+        body += "]}";
+
+        evict(parts.size());
+        return body;
+    }
+
+private:
+    struct entry {
+        std::string json;
+        uint64_t lastUsed = 0;
+        // The fields the fragment was made from, owner keeps the text they point to alive
+        messageRole role = messageRole::user;
+        std::string_view content, toolCalls, toolCallId, toolName;
+        std::shared_ptr<const void> owner;
+    };
+
+    messageFormat format;
+    std::mutex cacheMutex;
+    std::unordered_map<uint64_t, entry> cache;
+    uint64_t generation = 0;
+
+    static uint64_t keyOf(const chatMessage& msg) {
+        std::hash<std::string_view> hash;
+        uint64_t key = hash(msg.content);
+        for (uint64_t part : {static_cast<uint64_t>(msg.role), hash(msg.toolCallId), hash(msg.toolName), hash(msg.toolCalls)}) {
+            key ^= part + 0x9e3779b97f4a7c15ULL + (key << 6) + (key >> 2);
+        }
+        return key;
+    }
+
+    // Text seen again in the same arena is the same bytes, only other copies are compared
+    static bool sameText(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && (a.empty() || a.data() == b.data() || std::memcmp(a.data(), b.data(), a.size()) == 0);
+    }
+
+    static bool sameMessage(const entry& cached, const chatMessage& msg) {
+        return cached.role == msg.role && sameText(cached.content, msg.content) && sameText(cached.toolCalls, msg.toolCalls) &&
+               sameText(cached.toolCallId, msg.toolCallId) && sameText(cached.toolName, msg.toolName);
+    }
+
+    // Points the entry at the message's text in its arena, or at a copy when there is none
+    static void remember(entry& cached, const chatMessage& msg, const std::shared_ptr<const messageArena>& arena) {
+        cached.role = msg.role;
+        if (arena) {
+            cached.content = msg.content;
+            cached.toolCalls = msg.toolCalls;
+            cached.toolCallId = msg.toolCallId;
+            cached.toolName = msg.toolName;
+            cached.owner = arena;
+            return;
+        }
+        auto text = std::make_shared<std::string>();
+        text->reserve(msg.content.size() + msg.toolCalls.size() + msg.toolCallId.size() + msg.toolName.size());
+        std::string_view* fields[] = {&cached.content, &cached.toolCalls, &cached.toolCallId, &cached.toolName};
+        std::string_view values[] = {msg.content, msg.toolCalls, msg.toolCallId, msg.toolName};
+        for (size_t i = 0; i < 4; ++i) {
+            *fields[i] = {text->data() + text->size(), values[i].size()};
+            text->append(values[i]);
+        }
+        cached.owner = std::move(text);
+    }
+
+    // arena is null for text the caller owns, such as the system prompt
+    template <typename makeJson>
+    const std::string& fragment(const chatMessage& msg, const std::shared_ptr<const messageArena>& arena, makeJson&& make) {
+        auto& cached = cache[keyOf(msg)];
+        if (cached.lastUsed == 0 || !sameMessage(cached, msg)) {
+            cached.json = make().dump();
+            remember(cached, msg, arena);
+        } else if (arena && cached.owner != arena) {
+            // The same message copied into a new arena by compact(), the old one can go
+            remember(cached, msg, arena);
+        }
+        cached.lastUsed = generation;
+        return cached.json;
+    }
+
+    // Messages that left the history (compression, a finished summary request) are dropped
+    // once the cache holds clearly more than the latest request needed
+    void evict(size_t used) {
+        if (cache.size() <= 2 * used + 64) return;
+        for (auto it = cache.begin(); it != cache.end();) {
+            if (generation - it->second.lastUsed > 1) it = cache.erase(it);
+            else ++it;
+        }
+    }
+};
\ No newline at end of file
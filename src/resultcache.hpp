@@ -0,0 +1,148 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <optional>
+#include <chrono>
+#include <algorithm>
+#include <sys/stat.h>
+#include <spdlog/spdlog.h>
+#include <nlohmann/json.hpp>
+#include "fileevents.hpp"
+
+// Outputs of read-only tool calls, so a call the model repeats in the same conversation
+// answers with a short note instead of the whole output again. An entry is only used while
+// the files and directories it was computed from are unchanged: files are compared by
+// mtime and size, directories by their mtime and the paths tools report to fileEvents.
+// Edits made outside the agent deep inside a directory are not seen, so results that
+// depend on a whole directory are only trusted for directoryLifetime.
+class toolResultCache {
+private:
+    static constexpr size_t maxEntries = 256;
+    static constexpr std::chrono::seconds directoryLifetime{60};
+
+    struct stamp {
+        std::string path;
+        bool directory = false;
+        int64_t mtime = 0;
+        int64_t size = 0;
+
+        bool operator==(const stamp&) const = default;
+    };
+
+    struct entry {
+        std::string output;
+        std::vector<stamp> stamps;
+        unsigned int step = 0;       // when the output was last shown in full...
+        unsigned int generation = 0; // ...in this version of the history
+        std::chrono::steady_clock::time_point stored;
+        uint64_t lastUse = 0;
+    };
+
+    std::mutex cacheMutex;
+    std::unordered_map<std::string, entry> entries;
+    unsigned int currentStep = 0;
+    uint64_t uses = 0;
+    size_t eventSubscription = 0;
+
+    // path is the dependency itself or lies below it
+    static bool covers(const std::string& dependency, const std::string& path) {
+        return path.size() >= dependency.size() && path.compare(0, dependency.size(), dependency) == 0 &&
+               (path.size() == dependency.size() || path[dependency.size()] == '/' || dependency == "/");
+    }
+
+    static std::optional<stamp> stampOf(const std::string& absolutePath) {
+        struct stat info;
+        if (stat(absolutePath.c_str(), &info) != 0) return std::nullopt;
+        stamp result{absolutePath, S_ISDIR(info.st_mode),
+                     static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec, 0};
+        if (!result.directory) result.size = static_cast<int64_t>(info.st_size);
+        return result;
+    }
+
+    bool stillValid(const entry& cached) const {
+        for (const auto& dependency : cached.stamps) {
+            auto current = stampOf(dependency.path);
+            if (!current || !(*current == dependency)) return false;
+            if (dependency.directory && std::chrono::steady_clock::now() - cached.stored > directoryLifetime) return false;
+        }
+        return true;
+    }
+
+public:
+    using dependencies = std::vector<stamp>;
+
+    toolResultCache() {
+        eventSubscription = fileEvents::instance().subscribe([this](const std::string& path) {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            std::erase_if(entries, [&](const auto& item) {
+                for (const auto& dependency : item.second.stamps) {
+                    if (covers(dependency.path, path) || covers(path, dependency.path)) return true;
+                }
+                return false;
+            });
+        });
+    }
+
+    toolResultCache(const toolResultCache&) = delete;
+    toolResultCache& operator=(const toolResultCache&) = delete;
+
+    ~toolResultCache() {
+        fileEvents::instance().unsubscribe(eventSubscription);
+    }
+
+    static std::string key(const std::string& toolName, const nlohmann::json& parameters) {
+        // Objects dump with sorted keys, so the same arguments in another order give the same key
+        return toolName + '\n' + parameters.dump();
+    }
+
+    // Taken before the call runs, so a change made while it runs invalidates the entry
+    static std::optional<dependencies> snapshot(const std::vector<std::string>& paths) {
+        if (paths.empty()) return std::nullopt;
+        dependencies stamps;
+        for (const auto& path : paths) {
+            auto current = stampOf(fileEvents::normalize(path));
+            if (!current) return std::nullopt;
+            stamps.push_back(std::move(*current));
+        }
+        return stamps;
+    }
+
+    void nextStep() {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        ++currentStep;
+    }
+
+    // The output to give for a repeated call: a short note when the full output is still in the
+    // history, the stored output when the history was rewritten since, nothing when it's stale
+    std::optional<std::string> lookup(const std::string& callKey, unsigned int generation) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto found = entries.find(callKey);
+        if (found == entries.end()) return std::nullopt;
+        entry& cached = found->second;
+        if (!stillValid(cached)) {
+            entries.erase(found);
+            return std::nullopt;
+        }
+        cached.lastUse = ++uses;
+        if (cached.generation != generation) {
+            cached.generation = generation;
+            cached.step = currentStep;
+            return cached.output;
+        }
+        unsigned int ago = currentStep - cached.step;
+        return fmt::format("[Unchanged since step {} ({} step{} ago): same output as the identical call then]",
+            cached.step, ago, ago == 1 ? "" : "s");
+    }
+
+    void store(const std::string& callKey, const std::string& output, dependencies stamps, unsigned int generation) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (entries.size() >= maxEntries && !entries.contains(callKey)) {
+            auto oldest = std::min_element(entries.begin(), entries.end(),
+                [](const auto& a, const auto& b) { return a.second.lastUse < b.second.lastUse; });
+            entries.erase(oldest);
+        }
+        entries[callKey] = {output, std::move(stamps), currentStep, generation, std::chrono::steady_clock::now(), ++uses};
+    }
+};
\ No newline at end of file
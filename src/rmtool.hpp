@@ -5,6 +5,7 @@
 #include <iostream>
 #include "tool.hpp"
 #include "cmdexec.hpp"
+#include "fileevents.hpp"
 
 class rmTool : public agentTool {
 public:
@@ -19,6 +20,36 @@ public:
         return std::make_unique<rmTool>(*this);
     }
 
+    // Paths named in an rm command line, options are skipped
+    static std::vector<std::string> operands(const std::string& command) {
+        std::vector<std::string> paths;
+        std::string current;
+        char quote = 0;
+        bool optionsEnded = false;
+        auto finish = [&]() {
+            if (!current.empty() && (optionsEnded || current[0] != '-')) {
+                paths.push_back(current);
+            } else if (current == "--") {
+                optionsEnded = true;
+            }
+            current.clear();
+        };
+        for (char c : command) {
+            if (quote) {
+                if (c == quote) quote = 0;
+                else current += c;
+            } else if (c == '"' || c == '\'') {
+                quote = c;
+            } else if (std::isspace(static_cast<unsigned char>(c))) {
+                finish();
+            } else {
+                current += c;
+            }
+        }
+        finish();
+        return paths;
+    }
+
     std::string executeImpl(const std::string& params) override {
         try {
             nlohmann::json paramJson = nlohmann::json::parse(params);
@@ -29,6 +60,9 @@ public:
                 return "Error: No command specified";
             }
             std::string output = CommandExecutor::executeSingleArg(realCommand, {command});
+            for (const auto& path : operands(command)) {
+                fileEvents::instance().changed(path);
+            }
             return output;
 
         } catch (const std::exception& e) {
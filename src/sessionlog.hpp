@@ -0,0 +1,385 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+#include <nlohmann/json.hpp>
+#include "messagestore.hpp"
+#include "mappedfile.hpp"
+
+// A conversation as read back from its log
+struct restoredSession {
+    messageStore history;
+    std::string summary;        // summary kept as the first history entry, empty without one
+    size_t droppedMessages = 0; // messages it replaced
+    nlohmann::json meta;        // written when the session started (model, directory, tokenizer)
+};
+
+// Saves a conversation while it happens to an append-only binary log, <id>.log in the sessions
+// directory. Records are length-prefixed and checksummed and message text is stored as it is,
+// so a session is restored by mapping the file and copying the text into a messageStore,
+// without parsing any JSON but the small meta record. Records are queued in memory and a
+// background thread writes and syncs them in batches, logging a turn costs a copy of its text.
+// A torn record at the end (crash while writing) is cut off when the session is resumed.
+class sessionLog {
+public:
+    ~sessionLog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (writer.joinable()) {
+            writer.join();
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    sessionLog(const sessionLog&) = delete;
+    sessionLog& operator=(const sessionLog&) = delete;
+
+    // Starts a new session, removing the oldest ones beyond `keep` (0 keeps all). Null when the
+    // directory or file can't be created.
+    static std::unique_ptr<sessionLog> create(const std::string& directory, const nlohmann::json& meta, size_t keep = 50) {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        if (keep > 0) {
+            prune(directory, keep - 1); // room for the new one
+        }
+
+        char stamp[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+        std::string id = fmt::format("{}-{:04x}", stamp, std::random_device{}() & 0xffff);
+        std::string path = directory + "/" + id + ".log";
+
+        int file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0600);
+        if (file < 0) {
+            spdlog::warn("Could not create session log {}: {}", path, std::strerror(errno));
+            return nullptr;
+        }
+        std::unique_ptr<sessionLog> log(new sessionLog(file, id));
+        log->queue(std::string_view(fileMagic, sizeof(fileMagic)));
+        log->meta(meta);
+        return log;
+    }
+
+    // Replays session `id` ("last" for the most recent one) into `restored` and keeps appending
+    // to it. Null when there is no such session.
+    static std::unique_ptr<sessionLog> resume(const std::string& directory, std::string id, restoredSession& restored) {
+        if (id == "last") {
+            id = newest(directory);
+        }
+        if (id.empty() || id.find_first_not_of("0123456789abcdefABCDEF-_") != std::string::npos) {
+            return nullptr;
+        }
+        std::string path = directory + "/" + id + ".log";
+        size_t validEnd = 0;
+        uintmax_t fileSize = 0;
+        {
+            mappedFile file;
+            if (!file.open(path)) {
+                return nullptr;
+            }
+            std::string_view data = file.view();
+            fileSize = data.size();
+            if (data.size() < sizeof(fileMagic) || std::memcmp(data.data(), fileMagic, sizeof(fileMagic)) != 0) {
+                spdlog::warn("{} is not a session log", path);
+                return nullptr;
+            }
+            validEnd = replay(data, restored);
+        }
+        if (validEnd < fileSize) {
+            spdlog::warn("Session log {} ends in a damaged record, dropping its last {} bytes", path, fileSize - validEnd);
+            if (::truncate(path.c_str(), static_cast<off_t>(validEnd)) != 0) {
+                spdlog::warn("Could not repair {}: {}", path, std::strerror(errno));
+                return nullptr;
+            }
+        }
+        int file = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (file < 0) {
+            spdlog::warn("Could not open session log {}: {}", path, std::strerror(errno));
+            return nullptr;
+        }
+        return std::unique_ptr<sessionLog>(new sessionLog(file, id));
+    }
+
+    const std::string& id() const {
+        return sessionId;
+    }
+
+    void message(const chatMessage& msg) {
+        std::string& record = startRecord(recordType::message);
+        put(record, static_cast<uint8_t>(msg.role));
+        put(record, static_cast<int32_t>(msg.tokenCount));
+        put(record, static_cast<int64_t>(msg.createdAt));
+        for (std::string_view field : {msg.content, msg.toolCalls, msg.toolCallId, msg.toolName}) {
+            put(record, static_cast<uint32_t>(field.size()));
+        }
+        for (std::string_view field : {msg.content, msg.toolCalls, msg.toolCallId, msg.toolName}) {
+            record += field;
+        }
+        finishRecord(record);
+    }
+
+    // Token count of history entry `index`, counted after the message was logged
+    void tokenCount(size_t index, int count) {
+        std::string& record = startRecord(recordType::tokens);
+        put(record, static_cast<uint32_t>(index));
+        put(record, static_cast<int32_t>(count));
+        finishRecord(record);
+    }
+
+    // The history entries before `from` were replaced by `summary`, which now covers `droppedMessages`
+    void compact(size_t from, std::string_view summary, size_t droppedMessages) {
+        std::string& record = startRecord(recordType::compact);
+        put(record, static_cast<uint64_t>(from));
+        put(record, static_cast<uint64_t>(droppedMessages));
+        record += summary;
+        finishRecord(record);
+    }
+
+    void clear() {
+        finishRecord(startRecord(recordType::clear));
+    }
+
+    // Blocks until everything logged so far is on disk
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t target = queuedBytes;
+        flushRequested = true;
+        wake.notify_all();
+        written.wait(lock, [&] { return syncedBytes >= target || failed; });
+    }
+
+private:
+    enum class recordType : uint8_t { meta = 1, message, tokens, compact, clear };
+
+    static constexpr char fileMagic[8] = {'V', 'I', 'B', 'E', 'S', 'E', 'S', '1'};
+    static constexpr size_t headerSize = 9; // u32 payload size, u32 checksum, u8 type
+    static constexpr auto batchInterval = std::chrono::milliseconds(200);
+    static constexpr size_t batchBytes = 1 << 20;
+
+    int fd = -1;
+    std::string sessionId;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable written;
+    std::string pending;     // records not handed to the writer yet
+    std::string batch;       // records being written, swapped with pending to keep both buffers
+    uint64_t queuedBytes = 0;
+    uint64_t syncedBytes = 0;
+    bool flushRequested = false;
+    bool stopping = false;
+    bool failed = false;
+    std::thread writer;
+
+    sessionLog(int file, std::string id) : fd(file), sessionId(std::move(id)) {
+        writer = std::thread([this] { run(); });
+    }
+
+    template <typename T>
+    static void put(std::string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static T get(std::string_view data, size_t offset) {
+        T value;
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        return value;
+    }
+
+    // Not cryptographic, catches torn and partly written records
+    static uint32_t checksum(uint8_t type, std::string_view payload) {
+        uint64_t hash = 0xcbf29ce484222325ULL ^ type;
+        size_t i = 0;
+        for (; i + 8 <= payload.size(); i += 8) {
+            hash = (hash ^ get<uint64_t>(payload, i)) * 0x100000001b3ULL;
+            hash ^= hash >> 29;
+        }
+        for (; i < payload.size(); ++i) {
+            hash = (hash ^ static_cast<unsigned char>(payload[i])) * 0x100000001b3ULL;
+        }
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+    // Records are built in a scratch buffer, only the finished record is copied under the lock
+    static std::string& startRecord(recordType type) {
+        thread_local std::string record;
+        record.assign(headerSize, '\0');
+        record[8] = static_cast<char>(type);
+        return record;
+    }
+
+    void finishRecord(std::string& record) {
+        std::string_view payload(record.data() + headerSize, record.size() - headerSize);
+        uint32_t size = static_cast<uint32_t>(payload.size());
+        uint32_t sum = checksum(static_cast<uint8_t>(record[8]), payload);
+        std::memcpy(record.data(), &size, sizeof(size));
+        std::memcpy(record.data() + 4, &sum, sizeof(sum));
+        queue(record);
+    }
+
+    void meta(const nlohmann::json& info) {
+        std::string& record = startRecord(recordType::meta);
+        record += info.dump();
+        finishRecord(record);
+    }
+
+    void queue(std::string_view bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (failed) return;
+        pending += bytes;
+        queuedBytes += bytes.size();
+        wake.notify_all();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || flushRequested || !pending.empty(); });
+            // Gives later records of the same turn a chance to join the batch
+            wake.wait_for(lock, batchInterval, [this] { return stopping || flushRequested || pending.size() >= batchBytes; });
+            flushRequested = false;
+            if (!pending.empty() && !failed) {
+                batch.clear();
+                batch.swap(pending);
+                uint64_t upTo = queuedBytes;
+                lock.unlock();
+                bool ok = writeAll(batch) && ::fdatasync(fd) == 0;
+                lock.lock();
+                if (!ok) {
+                    spdlog::warn("Writing session log {} failed: {}, the session is no longer saved", sessionId, std::strerror(errno));
+                    failed = true;
+                    pending.clear();
+                }
+                syncedBytes = upTo;
+            }
+            written.notify_all();
+            if (stopping && (pending.empty() || failed)) {
+                return;
+            }
+        }
+    }
+
+    bool writeAll(std::string_view data) {
+        while (!data.empty()) {
+            ssize_t done = ::write(fd, data.data(), data.size());
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) return false;
+            data.remove_prefix(static_cast<size_t>(done));
+        }
+        return true;
+    }
+
+    // Applies the records to `restored` and returns where the valid part of the log ends
+    static size_t replay(std::string_view data, restoredSession& restored) {
+        size_t offset = sizeof(fileMagic);
+        while (offset + headerSize <= data.size()) {
+            uint32_t size = get<uint32_t>(data, offset);
+            uint32_t sum = get<uint32_t>(data, offset + 4);
+            uint8_t type = static_cast<uint8_t>(data[offset + 8]);
+            if (size > data.size() - offset - headerSize) break;
+            std::string_view payload = data.substr(offset + headerSize, size);
+            if (checksum(type, payload) != sum || !apply(static_cast<recordType>(type), payload, restored)) break;
+            offset += headerSize + size;
+        }
+        return offset;
+    }
+
+    static bool apply(recordType type, std::string_view payload, restoredSession& restored) {
+        auto& history = restored.history;
+        switch (type) {
+        case recordType::meta:
+            restored.meta = nlohmann::json::parse(payload, nullptr, false);
+            return true;
+        case recordType::message: {
+            constexpr size_t fixed = 1 + 4 + 8 + 4 * 4;
+            if (payload.size() < fixed) return false;
+            chatMessage msg;
+            msg.role = static_cast<messageRole>(get<uint8_t>(payload, 0));
+            msg.tokenCount = get<int32_t>(payload, 1);
+            msg.createdAt = get<int64_t>(payload, 5);
+            size_t position = fixed;
+            std::string_view* fields[] = {&msg.content, &msg.toolCalls, &msg.toolCallId, &msg.toolName};
+            for (size_t i = 0; i < 4; ++i) {
+                size_t length = get<uint32_t>(payload, 13 + 4 * i);
+                if (length > payload.size() - position) return false;
+                *fields[i] = payload.substr(position, length);
+                position += length;
+            }
+            history.append(msg);
+            return true;
+        }
+        case recordType::tokens: {
+            if (payload.size() != 8) return false;
+            size_t index = get<uint32_t>(payload, 0);
+            if (index < history.size()) {
+                history[index].tokenCount = get<int32_t>(payload, 4);
+            }
+            return true;
+        }
+        case recordType::compact: {
+            if (payload.size() < 16) return false;
+            size_t from = std::min<size_t>(get<uint64_t>(payload, 0), history.size());
+            restored.summary = std::string(payload.substr(16));
+            restored.droppedMessages = get<uint64_t>(payload, 8);
+            history.compact(from, restored.summary);
+            return true;
+        }
+        case recordType::clear:
+            history.clear();
+            restored.summary.clear();
+            restored.droppedMessages = 0;
+            return true;
+        }
+        return false;
+    }
+
+    static std::vector<std::filesystem::path> sessionsByAge(const std::string& directory) {
+        std::error_code ec;
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            if (entry.path().extension() == ".log") {
+                entries.emplace_back(entry.last_write_time(ec), entry.path());
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+        std::vector<std::filesystem::path> paths;
+        for (auto& [time, path] : entries) {
+            paths.push_back(std::move(path));
+        }
+        return paths;
+    }
+
+    static std::string newest(const std::string& directory) {
+        auto sessions = sessionsByAge(directory);
+        return sessions.empty() ? std::string() : sessions.back().stem().string();
+    }
+
+    // Removes the oldest sessions until at most `keep` are left
+    static void prune(const std::string& directory, size_t keep) {
+        auto sessions = sessionsByAge(directory);
+        std::error_code ec;
+        for (size_t i = 0; i + keep < sessions.size(); ++i) {
+            std::filesystem::remove(sessions[i], ec);
+        }
+    }
+};
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
-#include <regex>
+#include <vector>
+#include <nlohmann/json.hpp>
 namespace stringUtils
 {
     int countSubstring(const std::string &str, const std::string &substr)
@@ -22,22 +23,31 @@ namespace stringUtils
         return count;
     }
 
-    bool extractJsonWithBraceMatching(const std::string &input, nlohmann::json &j)
+    // Position of the '}' closing the object that starts at jsonStart, npos when unbalanced.
+    // Braces inside JSON strings don't count.
+    size_t findMatchingBrace(const std::string &input, size_t jsonStart)
     {
-        size_t jsonStart = input.find('{');
-        if (jsonStart == std::string::npos)
-        {
-            // ("No JSON object found");
-            return false;
-        }
-
         int braceCount = 0;
-        size_t jsonEnd = jsonStart;
+        bool inString = false;
 
-        // Properly match braces
         for (size_t i = jsonStart; i < input.length(); ++i)
         {
-            if (input[i] == '{')
+            if (inString)
+            {
+                if (input[i] == '\\')
+                {
+                    i++;
+                }
+                else if (input[i] == '"')
+                {
+                    inString = false;
+                }
+            }
+            else if (input[i] == '"')
+            {
+                inString = true;
+            }
+            else if (input[i] == '{')
             {
                 braceCount++;
             }
@@ -46,13 +56,24 @@ namespace stringUtils
                 braceCount--;
                 if (braceCount == 0)
                 {
-                    jsonEnd = i;
-                    break;
+                    return i;
                 }
             }
         }
+        return std::string::npos;
+    }
+
+    bool extractJsonWithBraceMatching(const std::string &input, nlohmann::json &j)
+    {
+        size_t jsonStart = input.find('{');
+        if (jsonStart == std::string::npos)
+        {
+            // ("No JSON object found");
+            return false;
+        }
 
-        if (braceCount != 0)
+        size_t jsonEnd = findMatchingBrace(input, jsonStart);
+        if (jsonEnd == std::string::npos)
         {
             // ("Mismatched braces in JSON");
             return false;
@@ -70,6 +91,30 @@ namespace stringUtils
             return false;
         }
     }
+
+    // Every top level {...} object in the text that parses as JSON, in order of appearance
+    std::vector<nlohmann::json> extractAllJsonObjects(const std::string &input)
+    {
+        std::vector<nlohmann::json> objects;
+        size_t pos = 0;
+        while ((pos = input.find('{', pos)) != std::string::npos)
+        {
+            size_t end = findMatchingBrace(input, pos);
+            if (end == std::string::npos)
+            {
+                break;
+            }
+            auto j = nlohmann::json::parse(input.substr(pos, end - pos + 1), nullptr, false);
+            if (j.is_discarded())
+            {
+                pos++; // maybe a stray brace, try the next one
+                continue;
+            }
+            objects.push_back(j);
+            pos = end + 1;
+        }
+        return objects;
+    }
     std::string truncateString(const std::string &str, size_t maxLength = 20)
     {
         if (maxLength < 3)
@@ -84,22 +129,4 @@ namespace stringUtils
 
         return str.substr(0, maxLength - 3) + "...";
     }
-    unsigned int countTokensAdvanced(const std::vector<std::pair<std::string, std::string>> &conv)
-    {
-        int totalTokens = 0;
-
-        // handles punctuation better
-        std::regex tokenRegex(R"(\S+)");
-
-        for (const auto &[role, message] : conv)
-        {
-            auto tokens_begin = std::sregex_iterator(message.begin(), message.end(), tokenRegex);
-            auto tokens_end = std::sregex_iterator();
-            int messageTokens = std::distance(tokens_begin, tokens_end);
-
-            totalTokens += messageTokens;
-        }
-
-        return totalTokens;
-    }
 }
\ No newline at end of file
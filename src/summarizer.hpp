@@ -0,0 +1,125 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <future>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <spdlog/spdlog.h>
+#include "llmclient.hpp"
+
+// Summarizes older parts of the conversation on a background thread, so the summary is
+// ready by the time the context limit is reached. One summary job runs at a time; each job
+// folds a new segment of messages into the previous summary.
+class rollingSummarizer {
+private:
+    std::future<std::string> job;
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+    size_t jobCoversUpTo = 0;
+    unsigned int jobEpoch = 0;
+
+    static constexpr size_t maxMessageChars = 4000; // long tool outputs matter less than what was done with them
+
+    static std::string buildTranscript(const messageList& segment, const std::string& previousSummary) {
+        std::string transcript;
+        if (!previousSummary.empty()) {
+            transcript += "SUMMARY SO FAR:\n" + previousSummary + "\n\n";
+        }
+        transcript += "CONVERSATION TO ADD:\n";
+        for (const auto& msg : segment) {
+            std::string role(roleName(msg.role));
+            if (msg.role == messageRole::tool) {
+                role += " " + std::string(msg.toolName);
+            }
+            transcript += "[" + role + "] ";
+            transcript += msg.content.substr(0, maxMessageChars);
+            if (msg.content.size() > maxMessageChars) {
+                transcript += "\n[...truncated]";
+            }
+            transcript += "\n";
+            if (!msg.toolCalls.empty()) {
+                transcript += "[" + role + " requested tools] ";
+                transcript += msg.toolCalls;
+                transcript += "\n";
+            }
+        }
+        return transcript;
+    }
+
+public:
+    ~rollingSummarizer() {
+        // Aborts a running request instead of waiting for the whole summary
+        cancelled->store(true);
+    }
+
+    bool running() const {
+        return job.valid() && job.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+    }
+
+    bool ready() const {
+        return job.valid() && job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    bool pending() const {
+        return job.valid();
+    }
+
+    // Messages before this position are covered by the pending summary, 0 without one
+    size_t coversUpTo() const {
+        return job.valid() ? jobCoversUpTo : 0;
+    }
+
+    // History generation the job was started for, results for a changed history are stale
+    unsigned int epoch() const {
+        return jobEpoch;
+    }
+
+    void start(LLMClient& client, const messageList& segment, const std::string& previousSummary,
+               size_t coversUpTo, unsigned int historyEpoch) {
+        const static std::string summaryPrompt = "Condense the conversation below into a single, comprehensive text summary"
+        " that captures the core problem, solution approach, and any key technical details or constraints. Focus on the essential"
+        " programming challenge and its proposed resolution. Keep file names, decisions and open tasks, skip raw tool output."
+        " If a summary so far is given, return it updated with the new part. Respond with the summary only.";
+
+        jobCoversUpTo = coversUpTo;
+        jobEpoch = historyEpoch;
+        messageStore transcript;
+        transcript.append(messageRole::user, buildTranscript(segment, previousSummary));
+        messageList request = transcript.snapshot();
+        auto cancelFlag = cancelled;
+        spdlog::info("Summarizing {} older messages in the background", segment.size());
+        job = std::async(std::launch::async, [&client, request, cancelFlag]() {
+            chatOptions options;
+            // Streaming only so the request can be dropped when we shut down
+            options.onToken = [cancelFlag](const std::string&) { return !cancelFlag->load(); };
+            options.cancel = cancelFlag;
+            std::string response;
+            try {
+                response = client.chat(request, summaryPrompt, options);
+            } catch (const std::exception& e) {
+                spdlog::warn("Background summary failed: {}", e.what());
+                return std::string();
+            }
+            auto json = nlohmann::json::parse(response, nullptr, false);
+            if (json.is_discarded() || !json.contains("message") || !json["message"]["content"].is_string()) {
+                spdlog::warn("Background summary failed: {}", response);
+                return std::string();
+            }
+            return json["message"]["content"].get<std::string>();
+        });
+    }
+
+    void wait() const {
+        if (job.valid()) {
+            job.wait();
+        }
+    }
+
+    // Waits for the pending job if it is still running. Empty on failure.
+    std::string take() {
+        if (!job.valid()) {
+            return {};
+        }
+        return job.get();
+    }
+};
\ No newline at end of file
@@ -0,0 +1,972 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+#include <optional>
+#include <functional>
+#include <filesystem>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+#include <spdlog/spdlog.h>
+#include "filewalker.hpp"
+#include "mappedfile.hpp"
+#include "fileevents.hpp"
+
+struct symbolEntry {
+    std::string name;
+    std::string kind;      // class, struct, union, enum, namespace, interface, type, typedef, function, method, macro
+    std::string container; // enclosing classes and namespaces, "::" separated
+    std::string file;      // relative to the project root
+    unsigned int line = 0;
+    std::string signature; // the source line, trimmed, see symbolIndex::loadSignatures
+};
+
+// Definitions found in source files by a small lexer per language, without compiling anything.
+// It knows C/C++ (types, namespaces, functions, methods, macros, typedefs), Python (classes,
+// functions), JS/TS (classes, interfaces, functions, methods, types) and Go (types, functions,
+// methods). Good enough to answer "where is X defined" without grepping and reading files.
+class symbolExtractor {
+private:
+    enum class language { none, c, python, javascript, go };
+
+    struct token {
+        std::string_view text;
+        unsigned int line;
+        bool identifier;
+    };
+
+    std::string_view source;
+    std::string file;
+    std::vector<symbolEntry>& out;
+
+    static bool isIdentStart(char c) {
+        return std::isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+    }
+
+    static bool isIdentChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+    }
+
+    void emit(std::string_view name, const std::string& kind, const std::string& container, unsigned int line) {
+        if (name.empty()) return;
+        out.push_back({std::string(name), kind, container, file, line, {}});
+    }
+
+    // Tokens of a C-like source: identifiers and single punctuation characters ("::" and "->"
+    // are kept together). Comments, strings and character literals are dropped, C preprocessor
+    // lines too, except that #define emits a macro.
+    std::vector<token> tokenize(language lang) {
+        std::vector<token> tokens;
+        const char* p = source.data();
+        const char* end = p + source.size();
+        unsigned int line = 1;
+        bool lineStart = true;
+        auto skipTo = [&](const char* target) {
+            for (; p < target; ++p) {
+                if (*p == '\n') ++line;
+            }
+        };
+        while (p < end) {
+            char c = *p;
+            if (c == '\n') {
+                ++line;
+                ++p;
+                lineStart = true;
+                continue;
+            }
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                ++p;
+                continue;
+            }
+            if (c == '/' && p + 1 < end && p[1] == '/') {
+                while (p < end && *p != '\n') ++p;
+                continue;
+            }
+            if (c == '/' && p + 1 < end && p[1] == '*') {
+                const char* close = static_cast<const char*>(memmem(p + 2, end - p - 2, "*/", 2));
+                skipTo(close ? close + 2 : end);
+                continue;
+            }
+            if (lang == language::c && c == '#' && lineStart) {
+                const char* directive = p + 1;
+                while (directive < end && (*directive == ' ' || *directive == '\t')) ++directive;
+                if (end - directive > 6 && std::strncmp(directive, "define", 6) == 0 && !isIdentChar(directive[6])) {
+                    const char* name = directive + 6;
+                    while (name < end && (*name == ' ' || *name == '\t')) ++name;
+                    const char* nameEnd = name;
+                    while (nameEnd < end && isIdentChar(*nameEnd)) ++nameEnd;
+                    emit(std::string_view(name, nameEnd - name), "macro", "", line);
+                }
+                // The directive runs to the end of the line, backslashes continue it
+                while (p < end && *p != '\n') {
+                    if (*p == '\\' && p + 1 < end && p[1] == '\n') {
+                        ++line;
+                        ++p;
+                    }
+                    ++p;
+                }
+                continue;
+            }
+            lineStart = false;
+            if (lang == language::c && c == 'R' && p + 2 < end && p[1] == '"') {
+                // Raw string R"delim( ... )delim"
+                const char* open = static_cast<const char*>(std::memchr(p + 2, '(', std::min<size_t>(end - p - 2, 17)));
+                if (open) {
+                    std::string closing = ")" + std::string(p + 2, open) + "\"";
+                    const char* close = static_cast<const char*>(memmem(open, end - open, closing.data(), closing.size()));
+                    skipTo(close ? close + closing.size() : end);
+                    continue;
+                }
+            }
+            if (c == '"' || c == '\'' || (c == '`' && lang != language::c)) {
+                // Go raw strings and JS templates may span lines, the others end at the line
+                bool multiline = c == '`';
+                ++p;
+                while (p < end && *p != c) {
+                    if (*p == '\\' && c != '`') ++p;
+                    else if (*p == '\n') {
+                        if (!multiline) break;
+                        ++line;
+                    }
+                    ++p;
+                }
+                ++p;
+                continue;
+            }
+            if (lang == language::javascript && c == '/') {
+                // A regex literal where an operand is expected
+                bool operand = tokens.empty() || (!tokens.back().identifier && std::strchr("(,=:[!&|?{};", tokens.back().text[0]))
+                    || tokens.back().text == "return" || tokens.back().text == "typeof";
+                if (operand) {
+                    ++p;
+                    bool inClass = false;
+                    while (p < end && *p != '\n' && (*p != '/' || inClass)) {
+                        if (*p == '\\') ++p;
+                        else if (*p == '[') inClass = true;
+                        else if (*p == ']') inClass = false;
+                        ++p;
+                    }
+                    ++p;
+                    continue;
+                }
+            }
+            if (isIdentStart(c)) {
+                const char* start = p;
+                while (p < end && isIdentChar(*p)) ++p;
+                tokens.push_back({std::string_view(start, p - start), line, true});
+                continue;
+            }
+            if (std::isdigit(static_cast<unsigned char>(c))) {
+                while (p < end && (isIdentChar(*p) || *p == '.' || *p == '\'')) ++p;
+                continue;
+            }
+            size_t length = 1;
+            if (p + 1 < end && ((c == ':' && p[1] == ':') || (c == '-' && p[1] == '>') || (c == '=' && p[1] == '>'))) {
+                length = 2;
+            }
+            tokens.push_back({std::string_view(p, length), line, false});
+            p += length;
+        }
+        return tokens;
+    }
+
+    static size_t matching(const std::vector<token>& tokens, size_t open, char openChar, char closeChar) {
+        int depth = 0;
+        for (size_t i = open; i < tokens.size(); ++i) {
+            if (tokens[i].text.size() == 1 && tokens[i].text[0] == openChar) ++depth;
+            else if (tokens[i].text.size() == 1 && tokens[i].text[0] == closeChar && --depth == 0) return i;
+        }
+        return tokens.size();
+    }
+
+    struct scope {
+        enum kindType { global, ns, type, transparent, body } kind;
+        std::string name;
+    };
+
+    static std::string containerOf(const std::vector<scope>& scopes) {
+        std::string container;
+        for (const auto& current : scopes) {
+            if ((current.kind == scope::ns || current.kind == scope::type) && !current.name.empty()) {
+                container += (container.empty() ? "" : "::") + current.name;
+            }
+        }
+        return container;
+    }
+
+    static bool is(const token& t, std::string_view text) {
+        return t.text == text;
+    }
+
+    // C, C++, JS/TS and Go share one pass over the tokens: a stack of brace scopes, where only
+    // global, namespace and type scopes are looked at, function bodies are skipped.
+    void parseBraces(language lang) {
+        static const std::set<std::string_view> notFunctions = {
+            "if", "for", "while", "switch", "return", "sizeof", "alignof", "decltype", "catch", "new", "delete",
+            "throw", "static_assert", "defined", "__attribute__", "alignas", "noexcept", "typeid", "requires",
+            "case", "do", "else", "typeof", "await", "yield", "super", "import", "__declspec", "assert", "function"};
+
+        auto tokens = tokenize(lang);
+        std::vector<scope> scopes = {{scope::global, ""}};
+        // What the next '{' opens
+        scope pending{scope::body, ""};
+        bool hasPending = false;
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            const token& t = tokens[i];
+            if (is(t, "{")) {
+                bool externBlock = i > 0 && is(tokens[i - 1], "extern");
+                scopes.push_back(hasPending ? pending : scope{externBlock ? scope::transparent : scope::body, ""});
+                hasPending = false;
+                continue;
+            }
+            if (is(t, "}")) {
+                if (scopes.size() > 1) scopes.pop_back();
+                continue;
+            }
+            if (is(t, ";")) {
+                hasPending = false;
+                continue;
+            }
+            if (scopes.back().kind == scope::body) continue;
+            bool inType = scopes.back().kind == scope::type;
+            std::string container = containerOf(scopes);
+
+            if (lang == language::c) {
+                if (is(t, "template") && i + 1 < tokens.size() && is(tokens[i + 1], "<")) {
+                    i = matching(tokens, i + 1, '<', '>');
+                    continue;
+                }
+                if (is(t, "namespace")) {
+                    std::string name;
+                    size_t j = i + 1;
+                    for (; j < tokens.size() && (tokens[j].identifier || is(tokens[j], "::")); ++j) {
+                        name += tokens[j].text;
+                    }
+                    if (j < tokens.size() && is(tokens[j], "{")) {
+                        if (!name.empty()) emit(name, "namespace", container, t.line);
+                        pending = {scope::ns, name};
+                        hasPending = true;
+                        i = j - 1;
+                    }
+                    continue;
+                }
+                if (is(t, "class") || is(t, "struct") || is(t, "union") || is(t, "enum")) {
+                    // enum class, attributes and export macros come before the name, bases after it
+                    size_t j = i + 1;
+                    std::string_view name;
+                    unsigned int line = t.line;
+                    for (; j < tokens.size() && !is(tokens[j], "{") && !is(tokens[j], ";") && !is(tokens[j], ":") &&
+                           !is(tokens[j], "(") && !is(tokens[j], "=") && !is(tokens[j], ")") && !is(tokens[j], ","); ++j) {
+                        if (is(tokens[j], "<")) {
+                            j = matching(tokens, j, '<', '>');
+                            continue;
+                        }
+                        if (tokens[j].identifier && !is(tokens[j], "final") && !is(tokens[j], "class") && !is(tokens[j], "struct")) {
+                            name = tokens[j].text;
+                            line = tokens[j].line;
+                        }
+                    }
+                    if (j < tokens.size() && is(tokens[j], ":")) {
+                        while (j < tokens.size() && !is(tokens[j], "{") && !is(tokens[j], ";")) ++j;
+                    }
+                    if (j < tokens.size() && is(tokens[j], "{")) {
+                        emit(name, std::string(t.text), container, line);
+                        pending = {t.text == "enum" ? scope::body : scope::type, std::string(name)};
+                        hasPending = true;
+                        i = j - 1;
+                    }
+                    continue;
+                }
+                if (is(t, "typedef")) {
+                    // typedef ... name; or typedef ret (*name)(args);
+                    size_t j = i + 1;
+                    std::string_view name;
+                    unsigned int line = t.line;
+                    for (; j < tokens.size() && !is(tokens[j], ";"); ++j) {
+                        if (is(tokens[j], "{")) {
+                            j = matching(tokens, j, '{', '}');
+                            continue;
+                        }
+                        if (is(tokens[j], "(") && j + 2 < tokens.size() && is(tokens[j + 1], "*") && tokens[j + 2].identifier) {
+                            name = tokens[j + 2].text;
+                            line = tokens[j + 2].line;
+                            break;
+                        }
+                        if (tokens[j].identifier) {
+                            name = tokens[j].text;
+                            line = tokens[j].line;
+                        }
+                    }
+                    // Anonymous struct bodies are skipped with the typedef
+                    if (j < tokens.size() && !is(tokens[j], ";")) {
+                        while (j < tokens.size() && !is(tokens[j], ";")) ++j;
+                    }
+                    emit(name, "typedef", container, line);
+                    i = j;
+                    continue;
+                }
+                if (is(t, "using") && i + 2 < tokens.size() && tokens[i + 1].identifier && is(tokens[i + 2], "=")) {
+                    emit(tokens[i + 1].text, "typedef", container, tokens[i + 1].line);
+                    continue;
+                }
+                // name ( ... ) qualifiers { or ; -- a function or method
+                if ((t.identifier || is(t, "~")) && i + 1 < tokens.size()) {
+                    size_t nameIndex = i;
+                    std::string_view name = t.text;
+                    if (is(t, "~")) {
+                        if (!tokens[i + 1].identifier) continue;
+                        nameIndex = i + 1;
+                    }
+                    if (is(tokens[nameIndex], "operator")) {
+                        size_t j = nameIndex + 1;
+                        while (j < tokens.size() && !is(tokens[j], "(")) ++j;
+                        if (j < tokens.size() && j + 1 < tokens.size() && is(tokens[j + 1], ")") && j == nameIndex + 1) j += 2; // operator()
+                        while (j < tokens.size() && !is(tokens[j], "(")) ++j;
+                        name = std::string_view(tokens[nameIndex].text.data(), tokens[j - 1].text.data() + tokens[j - 1].text.size() - tokens[nameIndex].text.data());
+                        nameIndex = j - 1;
+                    }
+                    if (nameIndex + 1 >= tokens.size() || !is(tokens[nameIndex + 1], "(") || notFunctions.count(tokens[nameIndex].text)) {
+                        continue;
+                    }
+                    // Declarations start a statement, follow a type or are qualified (A::b)
+                    std::string qualifier;
+                    size_t first = i;
+                    while (first >= 2 && is(tokens[first - 1], "::") && tokens[first - 2].identifier) {
+                        qualifier = std::string(tokens[first - 2].text) + (qualifier.empty() ? "" : "::" + qualifier);
+                        first -= 2;
+                    }
+                    if (first > 0) {
+                        const token& before = tokens[first - 1];
+                        bool startsDeclaration = before.identifier || is(before, "*") || is(before, "&") || is(before, ">") ||
+                            is(before, ";") || is(before, "}") || is(before, "{") || is(before, ":");
+                        if (!startsDeclaration || is(before, "return") || is(before, "else")) continue;
+                    }
+                    size_t close = matching(tokens, nameIndex + 1, '(', ')');
+                    size_t j = close + 1;
+                    // const, noexcept(...), override, -> type, attributes...
+                    while (j < tokens.size() && !is(tokens[j], "{") && !is(tokens[j], ";") && !is(tokens[j], ":") &&
+                           !is(tokens[j], "=") && !is(tokens[j], "}")) {
+                        if (is(tokens[j], "(")) j = matching(tokens, j, '(', ')');
+                        else if (is(tokens[j], ",")) break;
+                        ++j;
+                    }
+                    if (j >= tokens.size() || is(tokens[j], ",") || is(tokens[j], "}")) continue;
+                    bool definition = is(tokens[j], "{") || is(tokens[j], ":");
+                    bool pure = is(tokens[j], "=");
+                    if (!definition && !pure && !is(tokens[j], ";")) continue;
+                    if (is(tokens[j], ":")) {
+                        // Constructor initializer list
+                        while (j < tokens.size() && !is(tokens[j], "{") && !is(tokens[j], ";")) {
+                            if (is(tokens[j], "(")) j = matching(tokens, j, '(', ')');
+                            ++j;
+                        }
+                        if (j >= tokens.size() || !is(tokens[j], "{")) continue;
+                    }
+                    std::string fullContainer = container;
+                    if (!qualifier.empty()) fullContainer += (fullContainer.empty() ? "" : "::") + qualifier;
+                    bool method = inType || !qualifier.empty();
+                    std::string kind = method ? "method" : "function";
+                    if (!definition) kind += " declaration";
+                    std::string shownName = is(t, "~") ? "~" + std::string(tokens[nameIndex].text) : std::string(name);
+                    emit(shownName, kind, fullContainer, t.line);
+                    if (is(tokens[j], "{")) {
+                        pending = {scope::body, ""};
+                        hasPending = true;
+                    }
+                    i = j - 1;
+                }
+                continue;
+            }
+
+            if (lang == language::javascript) {
+                if ((is(t, "class") || is(t, "interface") || is(t, "enum")) && i + 1 < tokens.size() && tokens[i + 1].identifier) {
+                    size_t j = i + 2;
+                    while (j < tokens.size() && !is(tokens[j], "{") && !is(tokens[j], ";")) ++j;
+                    if (j < tokens.size() && is(tokens[j], "{")) {
+                        emit(tokens[i + 1].text, std::string(t.text), container, tokens[i + 1].line);
+                        pending = {is(t, "enum") ? scope::body : scope::type, std::string(tokens[i + 1].text)};
+                        hasPending = true;
+                        i = j - 1;
+                    }
+                    continue;
+                }
+                if (is(t, "type") && i + 2 < tokens.size() && tokens[i + 1].identifier && (is(tokens[i + 2], "=") || is(tokens[i + 2], "<"))) {
+                    emit(tokens[i + 1].text, "type", container, tokens[i + 1].line);
+                    continue;
+                }
+                if (is(t, "namespace") || is(t, "module")) {
+                    if (i + 2 < tokens.size() && tokens[i + 1].identifier && is(tokens[i + 2], "{")) {
+                        emit(tokens[i + 1].text, "namespace", container, tokens[i + 1].line);
+                        pending = {scope::ns, std::string(tokens[i + 1].text)};
+                        hasPending = true;
+                        i += 1;
+                    }
+                    continue;
+                }
+                if (is(t, "function")) {
+                    size_t j = i + 1;
+                    if (j < tokens.size() && is(tokens[j], "*")) ++j;
+                    if (j + 1 < tokens.size() && tokens[j].identifier) {
+                        emit(tokens[j].text, "function", container, tokens[j].line);
+                        pending = {scope::body, ""};
+                        hasPending = true;
+                        i = j;
+                    }
+                    continue;
+                }
+                if ((is(t, "const") || is(t, "let") || is(t, "var")) && i + 2 < tokens.size() && tokens[i + 1].identifier && is(tokens[i + 2], "=")) {
+                    // const f = function..., const f = async (...) => ..., const f = x => ...
+                    size_t j = i + 3;
+                    if (j < tokens.size() && is(tokens[j], "async")) ++j;
+                    bool function = false;
+                    if (j < tokens.size() && is(tokens[j], "function")) function = true;
+                    else if (j < tokens.size() && is(tokens[j], "(")) {
+                        size_t close = matching(tokens, j, '(', ')');
+                        function = close + 1 < tokens.size() && (is(tokens[close + 1], "=>") || is(tokens[close + 1], ":"));
+                    } else if (j + 1 < tokens.size() && tokens[j].identifier && is(tokens[j + 1], "=>")) function = true;
+                    else if (j < tokens.size() && is(tokens[j], "class")) {
+                        emit(tokens[i + 1].text, "class", container, tokens[i + 1].line);
+                        continue;
+                    }
+                    if (function) emit(tokens[i + 1].text, "function", container, tokens[i + 1].line);
+                    continue;
+                }
+                if (inType && t.identifier && i + 1 < tokens.size() && !notFunctions.count(t.text) &&
+                    (is(tokens[i + 1], "(") || is(tokens[i + 1], "<") ||
+                     (is(tokens[i + 1], "=") && i + 2 < tokens.size() && (is(tokens[i + 2], "(") || is(tokens[i + 2], "async"))))) {
+                    // Methods, including modifiers before them, and arrow function fields
+                    const token* before = i > 0 ? &tokens[i - 1] : nullptr;
+                    static const std::set<std::string_view> modifiers = {"static", "async", "get", "set", "public", "private",
+                        "protected", "readonly", "abstract", "override", "*"};
+                    if (before && !is(*before, ";") && !is(*before, "{") && !is(*before, "}") && !modifiers.count(before->text)) continue;
+                    size_t open = is(tokens[i + 1], "<") ? matching(tokens, i + 1, '<', '>') + 1 : i + 1;
+                    if (is(tokens[i + 1], "=")) open = is(tokens[i + 2], "async") ? i + 3 : i + 2;
+                    if (open >= tokens.size() || !is(tokens[open], "(")) continue;
+                    size_t close = matching(tokens, open, '(', ')');
+                    size_t j = close + 1;
+                    while (j < tokens.size() && !is(tokens[j], "{") && !is(tokens[j], ";") && !is(tokens[j], "}")) ++j;
+                    emit(t.text, "method", container, t.line);
+                    if (j < tokens.size() && is(tokens[j], "{")) {
+                        pending = {scope::body, ""};
+                        hasPending = true;
+                    }
+                    i = j - 1;
+                }
+                continue;
+            }
+
+            if (lang == language::go) {
+                if (is(t, "func")) {
+                    size_t j = i + 1;
+                    std::string receiver;
+                    if (j < tokens.size() && is(tokens[j], "(")) {
+                        size_t close = matching(tokens, j, '(', ')');
+                        // (r *Type) or (r Type[T]), the type is the last identifier before any '['
+                        for (size_t k = j + 1; k < close; ++k) {
+                            if (is(tokens[k], "[")) break;
+                            if (tokens[k].identifier) receiver = tokens[k].text;
+                        }
+                        j = close + 1;
+                    }
+                    if (j < tokens.size() && tokens[j].identifier) {
+                        emit(tokens[j].text, receiver.empty() ? "function" : "method", receiver, tokens[j].line);
+                        pending = {scope::body, ""};
+                        hasPending = true;
+                    }
+                    continue;
+                }
+                if (is(t, "type") && i + 1 < tokens.size()) {
+                    auto emitType = [&](size_t k) -> size_t {
+                        if (k + 1 >= tokens.size() || !tokens[k].identifier) return k;
+                        size_t kindIndex = k + 1;
+                        if (is(tokens[kindIndex], "[")) kindIndex = matching(tokens, kindIndex, '[', ']') + 1;
+                        if (kindIndex < tokens.size() && is(tokens[kindIndex], "=")) ++kindIndex;
+                        std::string kind = "type";
+                        if (kindIndex < tokens.size() && (is(tokens[kindIndex], "struct") || is(tokens[kindIndex], "interface"))) {
+                            kind = tokens[kindIndex].text;
+                            if (kindIndex + 1 < tokens.size() && is(tokens[kindIndex + 1], "{")) {
+                                emit(tokens[k].text, kind, "", tokens[k].line);
+                                return matching(tokens, kindIndex + 1, '{', '}');
+                            }
+                        }
+                        emit(tokens[k].text, kind, "", tokens[k].line);
+                        return kindIndex;
+                    };
+                    if (is(tokens[i + 1], "(")) {
+                        // type ( A struct {...}; B int ) - one type per line
+                        size_t close = matching(tokens, i + 1, '(', ')');
+                        unsigned int lastLine = 0;
+                        for (size_t k = i + 2; k < close; ++k) {
+                            if (tokens[k].line != lastLine && tokens[k].identifier) {
+                                lastLine = tokens[k].line;
+                                k = emitType(k);
+                                if (k < tokens.size()) lastLine = tokens[k].line;
+                            }
+                        }
+                        i = close;
+                    } else {
+                        i = emitType(i + 1);
+                    }
+                }
+                continue;
+            }
+        }
+    }
+
+    // Python has no braces, scopes follow the indentation
+    void parsePython() {
+        struct block { size_t indent; std::string name; bool isClass; };
+        std::vector<block> blocks;
+        unsigned int line = 0;
+        size_t position = 0;
+        std::string_view tripleQuote;
+        while (position < source.size()) {
+            size_t end = source.find('\n', position);
+            if (end == std::string_view::npos) end = source.size();
+            std::string_view text = source.substr(position, end - position);
+            position = end + 1;
+            ++line;
+
+            if (!tripleQuote.empty()) {
+                if (text.find(tripleQuote) != std::string_view::npos) tripleQuote = {};
+                continue;
+            }
+            size_t indent = text.find_first_not_of(" \t");
+            if (indent == std::string_view::npos || text[indent] == '#') continue;
+            std::string_view code = text.substr(indent);
+            for (std::string_view quote : {std::string_view("\"\"\""), std::string_view("'''")}) {
+                size_t open = code.find(quote);
+                if (open != std::string_view::npos && code.find(quote, open + 3) == std::string_view::npos) {
+                    tripleQuote = quote;
+                }
+            }
+            while (!blocks.empty() && blocks.back().indent >= indent) blocks.pop_back();
+
+            bool isClass = code.substr(0, 6) == "class ";
+            size_t nameStart = 0;
+            if (isClass) nameStart = 6;
+            else if (code.substr(0, 4) == "def ") nameStart = 4;
+            else if (code.substr(0, 10) == "async def ") nameStart = 10;
+            else continue;
+            size_t nameEnd = nameStart;
+            while (nameEnd < code.size() && isIdentChar(code[nameEnd])) ++nameEnd;
+            std::string name(code.substr(nameStart, nameEnd - nameStart));
+            if (name.empty()) continue;
+
+            std::string container;
+            for (const auto& current : blocks) {
+                container += (container.empty() ? "" : "::") + current.name;
+            }
+            std::string kind = isClass ? "class" : (!blocks.empty() && blocks.back().isClass ? "method" : "function");
+            emit(name, kind, container, line);
+            blocks.push_back({indent, name, isClass});
+        }
+    }
+
+    static language languageOf(const std::string& path) {
+        std::string extension = std::filesystem::path(path).extension().string();
+        static const std::set<std::string> c = {".c", ".h", ".cc", ".cpp", ".cxx", ".hpp", ".hh", ".hxx", ".ipp", ".inl", ".tpp"};
+        static const std::set<std::string> javascript = {".js", ".jsx", ".mjs", ".cjs", ".ts", ".tsx", ".mts", ".cts"};
+        if (c.count(extension)) return language::c;
+        if (javascript.count(extension)) return language::javascript;
+        if (extension == ".py" || extension == ".pyi") return language::python;
+        if (extension == ".go") return language::go;
+        return language::none;
+    }
+
+public:
+    symbolExtractor(std::string_view text, const std::string& relativePath, std::vector<symbolEntry>& symbols)
+        : source(text), file(relativePath), out(symbols) {}
+
+    static bool supported(const std::string& path) {
+        return languageOf(path) != language::none;
+    }
+
+    void extract() {
+        language lang = languageOf(file);
+        if (lang == language::none) return;
+        if (lang == language::python) {
+            parsePython();
+        } else {
+            parseBraces(lang);
+        }
+    }
+};
+
+// Symbols of all supported source files below a project root. Built in the background at
+// startup, queries wait for it. Afterwards files written by tools (fileEvents) are re-read
+// before the next query, and a query more than sweepInterval after the last check first
+// compares file times to pick up outside edits.
+class symbolIndex {
+private:
+    static constexpr auto sweepInterval = std::chrono::seconds(10);
+    static constexpr size_t maxFileSize = 2 << 20;
+
+    // Names, containers and kinds repeat a lot, a large tree has millions of symbols
+    class stringTable {
+    private:
+        std::unordered_map<std::string, uint32_t> ids;
+        std::vector<const std::string*> strings; // keys of ids, which never move
+
+    public:
+        uint32_t intern(const std::string& text) {
+            auto [it, added] = ids.try_emplace(text, static_cast<uint32_t>(strings.size()));
+            if (added) strings.push_back(&it->first);
+            return it->second;
+        }
+
+        std::optional<uint32_t> find(const std::string& text) const {
+            auto it = ids.find(text);
+            return it == ids.end() ? std::nullopt : std::optional<uint32_t>(it->second);
+        }
+
+        const std::string& operator[](uint32_t id) const {
+            return *strings[id];
+        }
+
+        size_t size() const {
+            return strings.size();
+        }
+    };
+
+    struct storedSymbol {
+        uint32_t name;
+        uint32_t container;
+        uint32_t line;
+        uint32_t kind;
+    };
+
+    struct fileRecord {
+        std::string path; // relative to the root
+        int64_t mtime = 0;
+        uint64_t size = 0;
+        bool present = false;
+        std::vector<storedSymbol> symbols;
+    };
+
+    std::string root;
+    fileWalker walker;
+    std::mutex indexMutex;
+    stringTable names;
+    stringTable containers;                       // "" is id 0
+    std::vector<uint32_t> containerParents;       // container id -> name id of its innermost part
+    stringTable kinds;
+    std::unordered_map<std::string, uint32_t> fileIds;
+    std::vector<fileRecord> files;                // by file id, removed files stay with present == false
+    std::vector<std::vector<uint32_t>> filesByName;   // name id -> files defining it
+    std::vector<std::vector<uint32_t>> filesByParent; // name id -> files with members of it
+    std::set<std::string> pending;
+    std::mutex pendingMutex;
+    std::chrono::steady_clock::time_point lastSweep;
+    std::shared_future<void> built;
+    std::atomic<bool> stopping{false};
+    size_t eventSubscription = 0;
+
+    static int64_t mtimeOf(const struct stat& info) {
+        return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    }
+
+    static std::string parentOf(const std::string& container) {
+        size_t separator = container.rfind("::");
+        return separator == std::string::npos ? container : container.substr(separator + 2);
+    }
+
+    uint32_t nameId(const std::string& name) {
+        uint32_t id = names.intern(name);
+        if (filesByName.size() <= id) {
+            filesByName.resize(id + 1);
+            filesByParent.resize(id + 1);
+        }
+        return id;
+    }
+
+    uint32_t containerId(const std::string& container) {
+        uint32_t id = containers.intern(container);
+        if (containerParents.size() <= id) {
+            containerParents.push_back(nameId(parentOf(container)));
+        }
+        return id;
+    }
+
+    symbolEntry expand(const fileRecord& file, const storedSymbol& symbol) const {
+        return {names[symbol.name], kinds[symbol.kind], containers[symbol.container], file.path, symbol.line, {}};
+    }
+
+    static void addTo(std::vector<uint32_t>& list, uint32_t fileId) {
+        // All symbols of a file are added together, so a repeat is always the last entry
+        if (list.empty() || list.back() != fileId) list.push_back(fileId);
+    }
+
+    static void removeFrom(std::vector<uint32_t>& list, uint32_t fileId) {
+        auto it = std::find(list.begin(), list.end(), fileId);
+        if (it != list.end()) list.erase(it);
+    }
+
+    static std::optional<std::pair<fileRecord, std::vector<symbolEntry>>> readFile(const std::string& absolutePath,
+                                                                                  const std::string& relativePath) {
+        struct stat info;
+        if (stat(absolutePath.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) return std::nullopt;
+        fileRecord record;
+        record.path = relativePath;
+        record.mtime = mtimeOf(info);
+        record.size = static_cast<uint64_t>(info.st_size);
+        record.present = true;
+        std::vector<symbolEntry> symbols;
+        mappedFile contents;
+        if (record.size <= maxFileSize && contents.open(absolutePath, maxFileSize)) {
+            symbolExtractor(contents.view(), relativePath, symbols).extract();
+        }
+        return std::make_pair(std::move(record), std::move(symbols));
+    }
+
+    const fileRecord* findFile(const std::string& relativePath) const {
+        auto it = fileIds.find(relativePath);
+        return it == fileIds.end() || !files[it->second].present ? nullptr : &files[it->second];
+    }
+
+    void removeFile(uint32_t fileId) {
+        fileRecord& record = files[fileId];
+        for (const auto& symbol : record.symbols) {
+            removeFrom(filesByName[symbol.name], fileId);
+            if (symbol.container != 0) removeFrom(filesByParent[containerParents[symbol.container]], fileId);
+        }
+        record.symbols.clear();
+        record.symbols.shrink_to_fit();
+        record.present = false;
+    }
+
+    void addFile(fileRecord&& record, std::vector<symbolEntry>&& symbols) {
+        auto [it, added] = fileIds.try_emplace(record.path, static_cast<uint32_t>(files.size()));
+        uint32_t fileId = it->second;
+        if (added) {
+            files.emplace_back();
+        } else {
+            removeFile(fileId);
+        }
+        record.symbols.reserve(symbols.size());
+        for (const auto& symbol : symbols) {
+            storedSymbol stored{nameId(symbol.name), containerId(symbol.container), symbol.line, kinds.intern(symbol.kind)};
+            addTo(filesByName[stored.name], fileId);
+            if (stored.container != 0) addTo(filesByParent[containerParents[stored.container]], fileId);
+            record.symbols.push_back(stored);
+        }
+        files[fileId] = std::move(record);
+    }
+
+    // Re-reads new and changed files below absolutePath, forgets the ones that are gone
+    void refresh(const std::string& absolutePath) {
+        std::string prefix = absolutePath == root ? "" : absolutePath.substr(root.size() + 1);
+        std::mutex foundMutex;
+        std::set<std::string> seen;
+        walker.walk(absolutePath, [&](const walkEntry& entry) {
+            if (stopping) return false;
+            // A file path is visited alone, under its own name
+            std::string relativePath = entry.absolutePath == absolutePath ? prefix : fileWalker::join(prefix, entry.relativePath);
+            if (!symbolExtractor::supported(relativePath)) return true;
+            struct stat info;
+            if (stat(entry.absolutePath.c_str(), &info) != 0) return true;
+            {
+                std::lock_guard<std::mutex> lock(foundMutex);
+                seen.insert(relativePath);
+                const fileRecord* known = findFile(relativePath);
+                if (known && known->mtime == mtimeOf(info) && known->size == static_cast<uint64_t>(info.st_size)) return true;
+            }
+            auto result = readFile(entry.absolutePath, relativePath);
+            if (result) {
+                // Extraction runs on all walker threads, the tables are updated one file at a time
+                std::lock_guard<std::mutex> lock(foundMutex);
+                addFile(std::move(result->first), std::move(result->second));
+            }
+            return true;
+        });
+        if (stopping) return;
+
+        for (uint32_t fileId = 0; fileId < files.size(); ++fileId) {
+            const std::string& path = files[fileId].path;
+            bool below = prefix.empty() || path == prefix || path.compare(0, prefix.size() + 1, prefix + "/") == 0;
+            if (files[fileId].present && below && !seen.count(path)) removeFile(fileId);
+        }
+    }
+
+    // Called with indexMutex held, after the initial build
+    void catchUp() {
+        std::set<std::string> paths;
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            paths.swap(pending);
+        }
+        if (std::chrono::steady_clock::now() - lastSweep > sweepInterval) {
+            paths = {root};
+            lastSweep = std::chrono::steady_clock::now();
+        }
+        for (const auto& path : paths) {
+            if (path != root && (path.size() <= root.size() || path.compare(0, root.size() + 1, root + "/") != 0)) continue;
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0 || walker.excluded(root, path)) {
+                // Removed (or now ignored): forget the file or everything below the directory,
+                // all of the index when the root itself is gone
+                std::string relativePath = path == root ? "" : path.substr(root.size() + 1);
+                for (uint32_t fileId = 0; fileId < files.size(); ++fileId) {
+                    const std::string& known = files[fileId].path;
+                    if (files[fileId].present && (relativePath.empty() || known == relativePath ||
+                        known.compare(0, relativePath.size() + 1, relativePath + "/") == 0)) removeFile(fileId);
+                }
+                continue;
+            }
+            refresh(path);
+        }
+    }
+
+    std::vector<symbolEntry> collect(const std::vector<uint32_t>& fileList, const std::function<bool(const storedSymbol&)>& wanted) const {
+        std::vector<symbolEntry> found;
+        for (uint32_t fileId : fileList) {
+            for (const auto& symbol : files[fileId].symbols) {
+                if (wanted(symbol)) found.push_back(expand(files[fileId], symbol));
+            }
+        }
+        return found;
+    }
+
+    bool containerMatches(uint32_t container, const std::string& wanted) const {
+        const std::string& name = containers[container];
+        return name == wanted || (name.size() > wanted.size() + 2 && name.ends_with("::" + wanted));
+    }
+
+public:
+    explicit symbolIndex(const std::string& projectRoot) : root(fileWalker::absolute(projectRoot)) {
+        containerId("");
+        eventSubscription = fileEvents::instance().subscribe([this](const std::string& path) {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pending.insert(path);
+        });
+        built = std::async(std::launch::async, [this]() {
+            std::lock_guard<std::mutex> lock(indexMutex);
+            auto started = std::chrono::steady_clock::now();
+            refresh(root);
+            lastSweep = std::chrono::steady_clock::now();
+            if (stopping) return;
+            size_t count = 0;
+            for (const auto& file : files) count += file.symbols.size();
+            spdlog::info("Symbol index: {} symbols in {} files, built in {} ms", count, files.size(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(lastSweep - started).count());
+        }).share();
+    }
+
+    symbolIndex(const symbolIndex&) = delete;
+    symbolIndex& operator=(const symbolIndex&) = delete;
+
+    ~symbolIndex() {
+        stopping = true;
+        fileEvents::instance().unsubscribe(eventSubscription);
+        built.wait();
+    }
+
+    // Definitions named name; "A::b" or "A.b" only returns b inside A
+    std::vector<symbolEntry> definitions(std::string name) {
+        std::string parent;
+        for (std::string separator : {"::", "."}) {
+            size_t split = name.rfind(separator);
+            if (split != std::string::npos) {
+                parent = name.substr(0, split);
+                name = name.substr(split + separator.size());
+                break;
+            }
+        }
+        built.wait();
+        std::lock_guard<std::mutex> lock(indexMutex);
+        catchUp();
+        auto id = names.find(name);
+        if (!id) return {};
+        return collect(filesByName[*id], [&](const storedSymbol& symbol) {
+            return symbol.name == *id && (parent.empty() || containerMatches(symbol.container, parent));
+        });
+    }
+
+    // Members declared inside the class, struct or namespace
+    std::vector<symbolEntry> members(const std::string& typeName) {
+        built.wait();
+        std::lock_guard<std::mutex> lock(indexMutex);
+        catchUp();
+        auto id = names.find(parentOf(typeName));
+        if (!id) return {};
+        return collect(filesByParent[*id], [&](const storedSymbol& symbol) {
+            return symbol.container != 0 && containerParents[symbol.container] == *id && containerMatches(symbol.container, typeName);
+        });
+    }
+
+    // Everything defined in one file, in line order
+    std::vector<symbolEntry> outline(const std::string& path) {
+        std::string absolutePath = fileWalker::absolute(path);
+        bool inside = absolutePath.size() > root.size() && absolutePath.compare(0, root.size() + 1, root + "/") == 0;
+        std::string relativePath = inside ? absolutePath.substr(root.size() + 1) : absolutePath;
+        built.wait();
+        std::lock_guard<std::mutex> lock(indexMutex);
+        catchUp();
+        const fileRecord* record = findFile(relativePath);
+        if (!record) {
+            // Outside the project or not indexed, read it directly
+            auto result = readFile(absolutePath, relativePath);
+            return result ? result->second : std::vector<symbolEntry>{};
+        }
+        std::vector<symbolEntry> found;
+        for (const auto& symbol : record->symbols) {
+            found.push_back(expand(*record, symbol));
+        }
+        return found;
+    }
+
+    // Defined names containing text, ignoring case, for "did you mean" answers
+    std::vector<std::string> similarNames(const std::string& text, size_t limit) {
+        auto sameLetter = [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); };
+        built.wait();
+        std::lock_guard<std::mutex> lock(indexMutex);
+        catchUp();
+        std::vector<std::string> found;
+        for (uint32_t id = 0; id < names.size(); ++id) {
+            const std::string& name = names[id];
+            if (filesByName[id].empty() || name.size() < text.size()) continue;
+            if (std::search(name.begin(), name.end(), text.begin(), text.end(), sameLetter) != name.end()) found.push_back(name);
+        }
+        std::sort(found.begin(), found.end(), [](const std::string& a, const std::string& b) {
+            return a.size() != b.size() ? a.size() < b.size() : a < b;
+        });
+        if (found.size() > limit) found.resize(limit);
+        return found;
+    }
+
+    // Fills in the source line of each symbol, reading every file once
+    void loadSignatures(std::vector<symbolEntry>& symbols) const {
+        std::unordered_map<std::string, std::vector<symbolEntry*>> byFile;
+        for (auto& symbol : symbols) {
+            byFile[symbol.file].push_back(&symbol);
+        }
+        for (auto& [file, entries] : byFile) {
+            mappedFile contents;
+            if (!contents.open(file.starts_with("/") ? file : fileWalker::join(root, file), maxFileSize)) continue;
+            std::string_view text = contents.view();
+            std::vector<size_t> lineStarts = {0};
+            for (size_t position = text.find('\n'); position != std::string_view::npos; position = text.find('\n', position + 1)) {
+                lineStarts.push_back(position + 1);
+            }
+            for (auto* symbol : entries) {
+                if (symbol->line == 0 || symbol->line > lineStarts.size()) continue;
+                size_t start = lineStarts[symbol->line - 1];
+                size_t end = symbol->line < lineStarts.size() ? lineStarts[symbol->line] - 1 : text.size();
+                std::string line(text.substr(start, end - start));
+                line.erase(0, line.find_first_not_of(" \t"));
+                while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back()))) line.pop_back();
+                if (line.size() > 160) line = line.substr(0, 157) + "...";
+                symbol->signature = line;
+            }
+        }
+    }
+};
\ No newline at end of file
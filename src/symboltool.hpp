@@ -0,0 +1,107 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <algorithm>
+#include "spdlog/spdlog.h"
+#include "tool.hpp"
+#include "symbolindex.hpp"
+
+class symbolTool : public agentTool {
+private:
+    std::shared_ptr<symbolIndex> index; // shared by all clones
+    static constexpr size_t maxResults = 50;
+    static constexpr size_t maxOutline = 300;
+
+    static std::string qualifiedName(const symbolEntry& symbol) {
+        return symbol.container.empty() ? symbol.name : symbol.container + "::" + symbol.name;
+    }
+
+    std::string format(std::vector<symbolEntry> symbols, bool outline) const {
+        std::stable_sort(symbols.begin(), symbols.end(), [](const symbolEntry& a, const symbolEntry& b) {
+            return a.file != b.file ? a.file < b.file : a.line < b.line;
+        });
+        size_t total = symbols.size();
+        symbols.resize(std::min(total, outline ? maxOutline : maxResults));
+        index->loadSignatures(symbols);
+
+        std::string result;
+        for (const auto& symbol : symbols) {
+            if (outline) {
+                // Nesting shown by indentation, the file is already known
+                size_t depth = symbol.container.empty() ? 0 : std::count(symbol.container.begin(), symbol.container.end(), ':') / 2 + 1;
+                result += std::string(depth * 2, ' ') + std::to_string(symbol.line) + ": " + symbol.kind + " " + symbol.name +
+                    "  " + symbol.signature + "\n";
+            } else {
+                result += symbol.file + ":" + std::to_string(symbol.line) + ": " + symbol.kind + " " + qualifiedName(symbol) +
+                    "  " + symbol.signature + "\n";
+            }
+        }
+        if (total > symbols.size()) {
+            result += "[" + std::to_string(total - symbols.size()) + " more not shown]\n";
+        }
+        return result;
+    }
+
+public:
+    explicit symbolTool(std::shared_ptr<symbolIndex> symbols) : agentTool(
+        "Find Symbol",
+        R"(Looks up definitions in C/C++, Python, JS/TS and Go sources from an index, much faster than grep and reading files.
+        Mode "definition" finds where a class, function, method, type or macro is defined (Class::method narrows it down),
+        "members" lists what a class or namespace declares, "outline" lists everything defined in one file, with line numbers)",
+        "query: string - symbol name, class name for members or file path for outline, mode: string - definition, members or outline (optional, defaults to definition)",
+        "symbol index (in process)"
+    ), index(std::move(symbols)) {}
+
+    std::unique_ptr<agentTool> clone() const override {
+        return std::make_unique<symbolTool>(*this);
+    }
+
+    std::vector<std::string> resultDependencies(const nlohmann::json&) const override {
+        return {"."};
+    }
+
+    bool isReadOnly() const override {
+        return true;
+    }
+
+    std::string executeImpl(const std::string& params) override {
+        auto json = nlohmann::json::parse(params, nullptr, false);
+        if (json.is_discarded() || !json.contains("query") || !json["query"].is_string()) {
+            return "Error: query is required";
+        }
+        std::string query = json["query"].get<std::string>();
+        std::string mode = json.value("mode", "definition");
+        if (query.empty()) {
+            return "Error: empty query";
+        }
+
+        std::vector<symbolEntry> symbols;
+        if (mode == "outline") {
+            symbols = index->outline(query);
+            if (symbols.empty()) {
+                return "No definitions found in " + query;
+            }
+        } else if (mode == "members") {
+            symbols = index->members(query);
+        } else if (mode == "definition" || mode.empty()) {
+            symbols = index->definitions(query);
+        } else {
+            return "Error: unknown mode " + mode + ", use definition, members or outline";
+        }
+        spdlog::info("Symbol {} '{}': {} results", mode, query, symbols.size());
+
+        if (symbols.empty()) {
+            std::string name = query.substr(std::min(query.size(), query.find_last_of(":.") + 1));
+            auto similar = index->similarNames(name, 10);
+            std::string result = std::string("No ") + (mode == "members" ? "members of " : "definition of ") + query + " found";
+            if (!similar.empty()) {
+                result += ". Similar names:";
+                for (const auto& candidate : similar) {
+                    result += " " + candidate;
+                }
+            }
+            return result;
+        }
+        return format(std::move(symbols), mode == "outline");
+    }
+};
\ No newline at end of file
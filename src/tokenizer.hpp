@@ -0,0 +1,246 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+// Counts tokens the way byte-level BPE models (GPT, Qwen, Llama 3) see them. Loads the vocab and
+// merges from a HuggingFace tokenizer.json. Without one it falls back to an estimate from the
+// same pre-tokenization, scaled by a factor calibrated against token counts reported by the server.
+class tokenCounter {
+private:
+    std::unordered_map<std::string, int> vocab;
+    std::unordered_map<std::string, int> mergeRanks; // "left right" -> rank
+    std::array<std::string, 256> byteSymbols;
+    std::unordered_map<std::string, unsigned int> pieceCache;
+    std::mutex cacheMutex;
+    double scale = 1.0;
+
+    static constexpr size_t maxPieceBytes = 256; // longer pieces are counted in chunks, merging is quadratic
+    static constexpr size_t maxCacheEntries = 1 << 20;
+
+    static bool isLetter(unsigned char c) { return std::isalpha(c) || c >= 0x80; }
+    static bool isDigit(unsigned char c) { return std::isdigit(c); }
+    static bool isSpace(unsigned char c) { return std::isspace(c); }
+
+    // GPT-2 maps every byte to a printable unicode character, vocab entries are made of those
+    void buildByteSymbols() {
+        std::vector<int> printable;
+        for (int b = '!'; b <= '~'; ++b) printable.push_back(b);
+        for (int b = 0xA1; b <= 0xAC; ++b) printable.push_back(b);
+        for (int b = 0xAE; b <= 0xFF; ++b) printable.push_back(b);
+
+        int extra = 0;
+        for (int b = 0; b < 256; ++b) {
+            int codepoint = b;
+            if (std::find(printable.begin(), printable.end(), b) == printable.end()) {
+                codepoint = 256 + extra++;
+            }
+            std::string utf8;
+            if (codepoint < 0x80) {
+                utf8 += static_cast<char>(codepoint);
+            } else {
+                utf8 += static_cast<char>(0xC0 | (codepoint >> 6));
+                utf8 += static_cast<char>(0x80 | (codepoint & 0x3F));
+            }
+            byteSymbols[b] = utf8;
+        }
+    }
+
+    unsigned int encodePiece(std::string_view piece) const {
+        std::vector<std::string> symbols;
+        symbols.reserve(piece.size());
+        std::string whole;
+        for (unsigned char c : piece) {
+            symbols.push_back(byteSymbols[c]);
+            whole += byteSymbols[c];
+        }
+        if (vocab.count(whole)) {
+            return 1;
+        }
+
+        while (symbols.size() > 1) {
+            int bestRank = -1;
+            size_t bestPos = 0;
+            for (size_t i = 0; i + 1 < symbols.size(); ++i) {
+                auto it = mergeRanks.find(symbols[i] + " " + symbols[i + 1]);
+                if (it != mergeRanks.end() && (bestRank < 0 || it->second < bestRank)) {
+                    bestRank = it->second;
+                    bestPos = i;
+                }
+            }
+            if (bestRank < 0) {
+                break;
+            }
+            symbols[bestPos] += symbols[bestPos + 1];
+            symbols.erase(symbols.begin() + bestPos + 1);
+        }
+        return static_cast<unsigned int>(symbols.size());
+    }
+
+    // Roughly one token per word, long words are split every few characters
+    static unsigned int estimatePiece(std::string_view piece) {
+        return 1 + static_cast<unsigned int>((piece.size() - 1) / 6);
+    }
+
+    unsigned int countPiece(std::string_view piece) {
+        if (vocab.empty()) {
+            return estimatePiece(piece);
+        }
+        if (piece.size() > maxPieceBytes) {
+            unsigned int total = 0;
+            for (size_t pos = 0; pos < piece.size(); pos += maxPieceBytes) {
+                total += countPiece(piece.substr(pos, maxPieceBytes));
+            }
+            return total;
+        }
+
+        std::string key(piece);
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto it = pieceCache.find(key);
+            if (it != pieceCache.end()) {
+                return it->second;
+            }
+        }
+        unsigned int count = encodePiece(piece);
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (pieceCache.size() >= maxCacheEntries) {
+            pieceCache.clear();
+        }
+        pieceCache.emplace(std::move(key), count);
+        return count;
+    }
+
+public:
+    tokenCounter() {
+        buildByteSymbols();
+    }
+
+    bool loadTokenizer(const std::string& path) {
+        try {
+            std::ifstream file(path);
+            if (!file.is_open()) {
+                spdlog::error("Could not open tokenizer file: {}", path);
+                return false;
+            }
+            auto json = nlohmann::json::parse(file);
+            const auto& model = json.at("model");
+            if (model.value("type", "BPE") != "BPE") {
+                spdlog::error("Unsupported tokenizer model type in {}, only BPE is supported", path);
+                return false;
+            }
+
+            vocab.clear();
+            mergeRanks.clear();
+            for (const auto& [token, id] : model.at("vocab").items()) {
+                vocab.emplace(token, id.get<int>());
+            }
+            int rank = 0;
+            for (const auto& merge : model.at("merges")) {
+                // Either "left right" or ["left", "right"] depending on the tokenizers version
+                std::string key = merge.is_array() ? merge[0].get<std::string>() + " " + merge[1].get<std::string>()
+                                                   : merge.get<std::string>();
+                mergeRanks.emplace(std::move(key), rank++);
+            }
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            pieceCache.clear();
+            spdlog::info("Loaded tokenizer {} ({} tokens, {} merges)", path, vocab.size(), mergeRanks.size());
+            return true;
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to load tokenizer {}: {}", path, e.what());
+            vocab.clear();
+            mergeRanks.clear();
+            return false;
+        }
+    }
+
+    bool hasTokenizer() const {
+        return !vocab.empty();
+    }
+
+    // Splits text like the cl100k / Qwen pre-tokenizer: contractions, words with their leading
+    // space, up to three digits, punctuation runs and whitespace.
+    template <typename F>
+    static void splitPieces(std::string_view text, F&& onPiece) {
+        size_t i = 0;
+        const size_t n = text.size();
+        while (i < n) {
+            size_t start = i;
+            unsigned char c = text[i];
+
+            if (c == '\'' && i + 1 < n) {
+                std::string_view rest = text.substr(i + 1, 2);
+                char c1 = std::tolower(static_cast<unsigned char>(rest[0]));
+                char c2 = rest.size() > 1 ? std::tolower(static_cast<unsigned char>(rest[1])) : 0;
+                size_t len = 0;
+                if (c1 == 's' || c1 == 't' || c1 == 'm' || c1 == 'd') len = 2;
+                else if ((c1 == 'r' && c2 == 'e') || (c1 == 'v' && c2 == 'e') || (c1 == 'l' && c2 == 'l')) len = 3;
+                if (len) {
+                    onPiece(text.substr(i, len));
+                    i += len;
+                    continue;
+                }
+            }
+
+            if (isSpace(c)) {
+                size_t end = i;
+                while (end < n && isSpace(text[end])) ++end;
+                // A single space before a word belongs to the word
+                if (end < n && end - i > 1 && text[end - 1] == ' ') --end;
+                if (end < n && end - i == 1 && c == ' ') {
+                    ++i;
+                    c = text[i];
+                } else {
+                    onPiece(text.substr(start, end - start));
+                    i = end;
+                    continue;
+                }
+            }
+
+            if (isLetter(c)) {
+                while (i < n && isLetter(text[i])) ++i;
+            } else if (isDigit(c)) {
+                size_t digits = 0;
+                while (i < n && isDigit(text[i]) && digits < 3) { ++i; ++digits; }
+            } else {
+                while (i < n && !isLetter(text[i]) && !isDigit(text[i]) && !isSpace(text[i])) ++i;
+                while (i < n && (text[i] == '\r' || text[i] == '\n')) ++i;
+            }
+            onPiece(text.substr(start, i - start));
+        }
+    }
+
+    // Raw count, cacheable. Pass sums of raw counts through scaled() to get the final number.
+    unsigned int count(std::string_view text) {
+        unsigned int total = 0;
+        splitPieces(text, [&](std::string_view piece) {
+            total += countPiece(piece);
+        });
+        return total;
+    }
+
+    unsigned int scaled(unsigned int rawCount) const {
+        return hasTokenizer() ? rawCount : static_cast<unsigned int>(rawCount * scale);
+    }
+
+    // Adjusts the estimate with a count reported by the server for text we counted.
+    // Reports far below the estimate usually mean the server reused cached tokens, those are ignored.
+    void calibrate(unsigned int rawCount, unsigned int reported) {
+        if (hasTokenizer() || rawCount == 0) {
+            return;
+        }
+        double ratio = static_cast<double>(reported) / rawCount;
+        if (ratio < 0.7 * scale || ratio > 3.0) {
+            return;
+        }
+        scale = 0.7 * scale + 0.3 * ratio;
+        spdlog::debug("Token estimate scale calibrated to {:.3f}", scale);
+    }
+};
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <memory>
+#include <regex>
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
 #include "stringutils.hpp"
@@ -33,11 +34,85 @@ public:
 
     virtual std::unique_ptr<agentTool> clone() const = 0;
 
+    // Read-only tools don't change anything on disk, so several calls can run concurrently
+    virtual bool isReadOnly() const { return false; }
+
+    // Files and directories the output of a read-only call is computed from, so a repeated
+    // call can be answered from the cache while they are unchanged. Empty means never reuse.
+    virtual std::vector<std::string> resultDependencies(const nlohmann::json&) const { return {}; }
+
     std::string getToolInfo() const {
         return "Tool: " + name + "\nDescription: " + description + 
                "\nArguments: " + arguments + "\nCommand: " + realCommand;
     }
 
+    // Name usable as a function name in native tool calling (letters, digits, '_' and '-' only)
+    std::string getFunctionName() const {
+        std::string functionName = name;
+        for (auto& c : functionName) {
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-') {
+                c = '_';
+            }
+        }
+        return functionName;
+    }
+
+    // JSON schema of the parameters object, derived from the "name: type - description, ..." arguments text
+    virtual nlohmann::json getParametersSchema() const {
+        return parseArgumentsSchema(arguments);
+    }
+
+    // Function definition for the "tools" field of chat APIs
+    nlohmann::json getSchema() const {
+        return {
+            {"type", "function"},
+            {"function", {
+                {"name", getFunctionName()},
+                {"description", description},
+                {"parameters", getParametersSchema()}
+            }}
+        };
+    }
+
+    static nlohmann::json parseArgumentsSchema(const std::string& argumentsText) {
+        nlohmann::json schema = {
+            {"type", "object"},
+            {"properties", nlohmann::json::object()},
+            {"required", nlohmann::json::array()}
+        };
+
+        // Every "name: type" pair starts a new argument, its description runs until the next one
+        static const std::regex argRegex(R"((?:^|[,\s])(\w+):\s*(\w+)[^-,]*-?)");
+        std::vector<std::smatch> matches;
+        for (auto it = std::sregex_iterator(argumentsText.begin(), argumentsText.end(), argRegex);
+             it != std::sregex_iterator(); ++it) {
+            matches.push_back(*it);
+        }
+
+        for (size_t i = 0; i < matches.size(); ++i) {
+            const auto& match = matches[i];
+            size_t descStart = match.position(0) + match.length(0);
+            size_t descEnd = i + 1 < matches.size() ? matches[i + 1].position(0) : argumentsText.size();
+            std::string desc = argumentsText.substr(descStart, descEnd - descStart);
+            desc.erase(0, desc.find_first_not_of(" "));
+            desc.erase(desc.find_last_not_of(" ,") + 1);
+
+            std::string argName = match[1];
+            std::string type = match[2];
+            std::string jsonType = "string";
+            if (type == "int" || type == "integer") jsonType = "integer";
+            else if (type == "float" || type == "double" || type == "number") jsonType = "number";
+            else if (type == "bool" || type == "boolean") jsonType = "boolean";
+
+            schema["properties"][argName] = {{"type", jsonType}, {"description", desc}};
+            // Flags default to false, everything else is required unless described as optional
+            if (jsonType != "boolean" && desc.find("optional") == std::string::npos) {
+                schema["required"].push_back(argName);
+            }
+        }
+        return schema;
+    }
+
     std::string getName() const { return name; }
     std::string getDescription() const { return description; }
     std::string getArguments() const { return arguments; }
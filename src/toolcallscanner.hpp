@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "jsonrepair.hpp"
+
+// Watches an answer while it streams in for text tool calls ({"tool_name": ..., "parameters": ...}).
+// Braces are counted outside of JSON strings only, so code in a "content" argument doesn't
+// confuse it, and each object is parsed once, when its closing brace arrives. After a complete
+// call only more calls may follow (separated by whitespace, commas or inside an array); the
+// first other character means the model moved on to prose and the generation can stop.
+class toolCallScanner {
+private:
+    std::string text;
+    size_t scanned = 0;
+    int depth = 0;
+    bool inString = false;
+    bool escaped = false;
+    size_t objectStart = 0;
+    std::vector<nlohmann::json> found;
+    size_t stoppedAt = std::string::npos; // where the text after the calls began
+
+public:
+    // Returns false once the rest of the answer is not needed
+    bool feed(std::string_view piece) {
+        if (stopped()) return false;
+        text.append(piece);
+        for (; scanned < text.size(); ++scanned) {
+            char c = text[scanned];
+            if (inString) {
+                if (escaped) escaped = false;
+                else if (c == '\\') escaped = true;
+                else if (c == '"') inString = false;
+                continue;
+            }
+            if (depth == 0 && !found.empty() && c != '{' && c != ',' && c != '[' && c != ']' &&
+                c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+                stoppedAt = scanned;
+                return false;
+            }
+            if (c == '"') {
+                // Quotes in prose around the calls don't start strings
+                inString = depth > 0;
+            } else if (c == '{') {
+                if (depth++ == 0) objectStart = scanned;
+            } else if (c == '}' && depth > 0 && --depth == 0) {
+                std::string_view slice(text.data() + objectStart, scanned + 1 - objectStart);
+                auto object = nlohmann::json::parse(slice.begin(), slice.end(), nullptr, false);
+                if (object.is_discarded()) {
+                    object = lenientJson::parse(slice).value_or(nlohmann::json());
+                }
+                if (object.is_object() && object.contains("tool_name") && object.contains("parameters")) {
+                    found.push_back(std::move(object));
+                }
+            }
+        }
+        return true;
+    }
+
+    bool stopped() const {
+        return stoppedAt != std::string::npos;
+    }
+
+    const std::vector<nlohmann::json>& calls() const {
+        return found;
+    }
+
+    // The answer as far as it is worth keeping: without the text after the calls when stopped
+    std::string answer() const {
+        if (!stopped()) return text;
+        std::string kept = text.substr(0, stoppedAt);
+        kept.erase(kept.find_last_not_of(" \t\r\n") + 1);
+        return kept;
+    }
+};
\ No newline at end of file
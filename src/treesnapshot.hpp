@@ -0,0 +1,263 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "filewalker.hpp"
+#include "fileevents.hpp"
+
+// Directory structure below a root as the walker sees it (ignored files left out), with
+// file sizes and directory mtimes.
+struct treeNode {
+    std::map<std::string, std::unique_ptr<treeNode>> directories;
+    std::map<std::string, uint64_t> files; // name -> size
+    int64_t mtime = 0;                     // of the directory when it was last listed
+
+    // Totals of everything below, directories included
+    struct totals {
+        size_t files = 0;
+        size_t directories = 0;
+        uint64_t bytes = 0;
+        uint64_t largest = 0;
+    };
+
+    totals sum() const {
+        totals result;
+        result.files = files.size();
+        result.directories = directories.size();
+        for (const auto& [name, size] : files) {
+            result.bytes += size;
+            result.largest = std::max(result.largest, size);
+        }
+        for (const auto& [name, child] : directories) {
+            totals below = child->sum();
+            result.files += below.files;
+            result.directories += below.directories;
+            result.bytes += below.bytes;
+            result.largest = std::max(result.largest, below.largest);
+        }
+        return result;
+    }
+};
+
+// Snapshots of the trees that were asked for, kept up to date instead of walked again.
+// Paths reported through fileEvents are applied before the next use; other changes are
+// found by comparing directory mtimes, and only the directories that changed are listed.
+// A file rewritten in place doesn't touch its directory's mtime, so the files of the
+// directories about to be shown are looked at again for their sizes.
+class treeSnapshots {
+private:
+    static constexpr size_t maxSnapshots = 4;
+
+    struct snapshot {
+        std::string root; // absolute
+        std::unique_ptr<treeNode> tree;
+    };
+
+    fileWalker walker;
+    std::mutex snapshotMutex;
+    std::list<snapshot> snapshots; // most recently used first
+    std::set<std::string> pending;
+    std::mutex pendingMutex;
+    size_t eventSubscription = 0;
+
+    static int64_t mtimeOf(const struct stat& info) {
+        return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    }
+
+    static bool below(const std::string& root, const std::string& path) {
+        return path.size() > root.size() && path.compare(0, root.size(), root) == 0 && path[root.size()] == '/';
+    }
+
+    static std::vector<std::string> components(const std::string& relativePath) {
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (start < relativePath.size()) {
+            size_t end = relativePath.find('/', start);
+            if (end == std::string::npos) end = relativePath.size();
+            if (end > start) parts.push_back(relativePath.substr(start, end - start));
+            start = end + 1;
+        }
+        return parts;
+    }
+
+    static treeNode* directoryAt(treeNode* node, const std::vector<std::string>& parts, size_t count, bool create) {
+        for (size_t i = 0; i < count && node; ++i) {
+            auto it = node->directories.find(parts[i]);
+            if (it == node->directories.end()) {
+                if (!create) return nullptr;
+                it = node->directories.emplace(parts[i], std::make_unique<treeNode>()).first;
+            }
+            node = it->second.get();
+        }
+        return node;
+    }
+
+    // Walks a directory on all walker threads, root is the snapshot root whose rules apply
+    std::unique_ptr<treeNode> scan(const std::string& absoluteDirectory) const {
+        auto tree = std::make_unique<treeNode>();
+        std::mutex treeMutex;
+        walker.walk(absoluteDirectory, [&](const walkEntry& entry) {
+            struct stat info;
+            uint64_t size = stat(entry.absolutePath.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+            auto parts = components(entry.relativePath);
+            if (parts.empty()) return true;
+            std::lock_guard<std::mutex> lock(treeMutex);
+            directoryAt(tree.get(), parts, parts.size() - 1, true)->files[parts.back()] = size;
+            return true;
+        }, [&](const std::string& directory) {
+            struct stat info;
+            int64_t mtime = stat(directory.c_str(), &info) == 0 ? mtimeOf(info) : 0;
+            auto parts = below(absoluteDirectory, directory) ? components(directory.substr(absoluteDirectory.size() + 1)) : std::vector<std::string>{};
+            std::lock_guard<std::mutex> lock(treeMutex);
+            directoryAt(tree.get(), parts, parts.size(), true)->mtime = mtime;
+        });
+        return tree;
+    }
+
+    // Lists one directory again: new entries are checked against the ignore rules and new
+    // subdirectories walked, removed ones dropped, sizes refreshed. Subdirectories that
+    // were already known are checked by their own mtime.
+    void relist(const std::string& root, const std::string& absoluteDirectory, treeNode& node, int64_t mtime) const {
+        DIR* dir = opendir(absoluteDirectory.c_str());
+        if (!dir) return;
+        std::set<std::string> seenDirectories;
+        std::map<std::string, uint64_t> files;
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name == "." || name == ".." || name == ".git") continue;
+            struct stat info;
+            if (fstatat(dirfd(dir), entry->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            bool known = S_ISDIR(info.st_mode) ? node.directories.count(name) > 0 : node.files.count(name) > 0;
+            std::string absolutePath = fileWalker::join(absoluteDirectory, name);
+            if (!S_ISDIR(info.st_mode) && !S_ISREG(info.st_mode)) continue;
+            if (!known && walker.excluded(root, absolutePath)) continue;
+            if (S_ISDIR(info.st_mode)) {
+                seenDirectories.insert(name);
+                if (!known) node.directories[name] = scan(absolutePath);
+            } else {
+                files[name] = static_cast<uint64_t>(info.st_size);
+            }
+        }
+        closedir(dir);
+        std::erase_if(node.directories, [&](const auto& child) { return !seenDirectories.count(child.first); });
+        node.files = std::move(files);
+        node.mtime = mtime;
+    }
+
+    // Sizes of the files of an unchanged directory, written to without adding or removing any
+    static void restat(const std::string& absoluteDirectory, treeNode& node) {
+        int fd = open(absoluteDirectory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return;
+        for (auto& [name, size] : node.files) {
+            struct stat info;
+            if (fstatat(fd, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) == 0) size = static_cast<uint64_t>(info.st_size);
+        }
+        close(fd);
+    }
+
+    // Relists directories whose mtime changed, and restats the files of the top `levels` ones
+    void sweep(const std::string& root, const std::string& absoluteDirectory, treeNode& node, unsigned int levels) const {
+        struct stat info;
+        if (stat(absoluteDirectory.c_str(), &info) != 0) return;
+        if (mtimeOf(info) != node.mtime) relist(root, absoluteDirectory, node, mtimeOf(info));
+        else if (levels > 0) restat(absoluteDirectory, node);
+        for (auto& [name, child] : node.directories) {
+            sweep(root, fileWalker::join(absoluteDirectory, name), *child, levels > 0 ? levels - 1 : 0);
+        }
+    }
+
+    // A path written or removed by a tool
+    void apply(snapshot& current, const std::string& path) const {
+        auto parts = components(path.substr(current.root.size() + 1));
+        if (parts.empty()) return;
+        treeNode* parent = directoryAt(current.tree.get(), parts, parts.size() - 1, false);
+        if (!parent) {
+            // Inside a directory the snapshot doesn't have yet, the mtime sweep adds it
+            return;
+        }
+        const std::string& name = parts.back();
+        struct stat info;
+        if (lstat(path.c_str(), &info) != 0) {
+            parent->directories.erase(name);
+            parent->files.erase(name);
+            return;
+        }
+        if (walker.excluded(current.root, path)) return;
+        if (S_ISDIR(info.st_mode)) {
+            parent->directories[name] = scan(path);
+        } else if (S_ISREG(info.st_mode)) {
+            parent->files[name] = static_cast<uint64_t>(info.st_size);
+        }
+        if (name == ".gitignore") {
+            // What is ignored below may have changed
+            std::string directory = path.substr(0, path.size() - name.size() - 1);
+            auto rescanned = scan(directory);
+            std::swap(*parent, *rescanned);
+        }
+    }
+
+public:
+    treeSnapshots() {
+        eventSubscription = fileEvents::instance().subscribe([this](const std::string& path) {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pending.insert(path);
+        });
+    }
+
+    treeSnapshots(const treeSnapshots&) = delete;
+    treeSnapshots& operator=(const treeSnapshots&) = delete;
+
+    ~treeSnapshots() {
+        fileEvents::instance().unsubscribe(eventSubscription);
+    }
+
+    // Calls render with the up to date tree of a directory, under a lock so the tree can't change
+    // meanwhile. File sizes are exact in the top `levels` directories, the ones render lists.
+    template <typename F>
+    bool with(const std::string& directory, unsigned int levels, F&& render) {
+        std::string absoluteDirectory = fileWalker::absolute(directory);
+        struct stat info;
+        if (stat(absoluteDirectory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) return false;
+
+        std::set<std::string> changed;
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            changed.swap(pending);
+        }
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        for (auto& current : snapshots) {
+            for (const auto& path : changed) {
+                if (below(current.root, path)) apply(current, path);
+            }
+        }
+
+        // A snapshot of the directory or of one above it
+        for (auto it = snapshots.begin(); it != snapshots.end(); ++it) {
+            if (it->root != absoluteDirectory && !below(it->root, absoluteDirectory)) continue;
+            snapshots.splice(snapshots.begin(), snapshots, it);
+            snapshot& current = snapshots.front();
+            std::string relativePath = current.root == absoluteDirectory ? "" : absoluteDirectory.substr(current.root.size() + 1);
+            auto parts = components(relativePath);
+            treeNode* node = directoryAt(current.tree.get(), parts, parts.size(), false);
+            if (!node) break; // ignored or new, walk it on its own
+            sweep(current.root, absoluteDirectory, *node, levels);
+            render(static_cast<const treeNode&>(*node));
+            return true;
+        }
+
+        // Snapshots below the new one are covered by it
+        std::erase_if(snapshots, [&](const snapshot& old) { return below(absoluteDirectory, old.root); });
+        snapshots.push_front({absoluteDirectory, scan(absoluteDirectory)});
+        if (snapshots.size() > maxSnapshots) snapshots.pop_back();
+        render(static_cast<const treeNode&>(*snapshots.front().tree));
+        return true;
+    }
+};
\ No newline at end of file
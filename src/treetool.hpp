@@ -1,30 +1,160 @@
 #include <string>
+#include <memory>
 #include <nlohmann/json.hpp>
 #include "tool.hpp"
-#include "cmdexec.hpp"
+#include "treesnapshot.hpp"
 
 class directoryTreeTool : public agentTool {
+private:
+    static constexpr size_t maxLines = 400;
+    static constexpr size_t maxFilesListed = 30;     // more files in one directory are summarized by extension
+    static constexpr size_t maxDirectoriesListed = 60;
+
+    std::shared_ptr<treeSnapshots> snapshots = std::make_shared<treeSnapshots>(); // shared by all clones
+
+    struct renderOptions {
+        unsigned int depth;
+        uint64_t minSize;
+    };
+
+    static std::string humanSize(uint64_t bytes) {
+        if (bytes < 1024) return std::to_string(bytes) + " B";
+        if (bytes < 1024 * 1024) return fmt::format("{:.1f} KB", bytes / 1024.0);
+        if (bytes < 1024ull * 1024 * 1024) return fmt::format("{:.1f} MB", bytes / (1024.0 * 1024.0));
+        return fmt::format("{:.1f} GB", bytes / (1024.0 * 1024.0 * 1024.0));
+    }
+
+    static std::string summary(const treeNode::totals& totals) {
+        return std::to_string(totals.files) + (totals.files == 1 ? " file, " : " files, ") + humanSize(totals.bytes);
+    }
+
+    // "412 files: 400 *.o, 12 *.d"
+    static std::string byExtension(const std::map<std::string, uint64_t>& files, uint64_t minSize) {
+        std::map<std::string, size_t> counts;
+        size_t total = 0;
+        uint64_t bytes = 0;
+        for (const auto& [name, size] : files) {
+            if (size < minSize) continue;
+            size_t dot = name.rfind('.');
+            counts[dot == std::string::npos || dot == 0 ? "(no extension)" : "*" + name.substr(dot)]++;
+            ++total;
+            bytes += size;
+        }
+        std::vector<std::pair<std::string, size_t>> sorted(counts.begin(), counts.end());
+        std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        std::string result = std::to_string(total) + " files, " + humanSize(bytes) + ":";
+        size_t shown = std::min<size_t>(sorted.size(), 4);
+        size_t other = total;
+        for (size_t i = 0; i < shown; ++i) {
+            result += (i ? ", " : " ") + std::to_string(sorted[i].second) + " " + sorted[i].first;
+            other -= sorted[i].second;
+        }
+        if (other > 0) result += ", " + std::to_string(other) + " other";
+        return result;
+    }
+
+    struct entry {
+        std::string text;
+        const treeNode* expand = nullptr; // directory listed below the entry
+    };
+
+    static void render(const treeNode& node, const std::string& prefix, unsigned int level, const renderOptions& options,
+                       std::vector<std::string>& lines) {
+        std::vector<entry> entries;
+        size_t directoriesShown = 0;
+        for (const auto& [name, child] : node.directories) {
+            auto totals = child->sum();
+            if (options.minSize > 0 && totals.largest < options.minSize) continue;
+            if (++directoriesShown > maxDirectoriesListed) continue;
+            // Dependencies are never worth listing
+            bool expand = level + 1 < options.depth && name != "node_modules";
+            entries.push_back({name + "/  (" + summary(totals) + ")", expand ? child.get() : nullptr});
+        }
+        if (directoriesShown > maxDirectoriesListed) {
+            entries.push_back({std::to_string(directoriesShown - maxDirectoriesListed) + " more directories"});
+        }
+
+        size_t filesShown = 0;
+        for (const auto& [name, size] : node.files) {
+            if (size >= options.minSize) ++filesShown;
+        }
+        if (filesShown > maxFilesListed) {
+            entries.push_back({byExtension(node.files, options.minSize)});
+        } else {
+            for (const auto& [name, size] : node.files) {
+                if (size >= options.minSize) entries.push_back({name + "  (" + humanSize(size) + ")"});
+            }
+        }
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            bool last = i + 1 == entries.size();
+            lines.push_back(prefix + (last ? "└── " : "├── ") + entries[i].text);
+            if (entries[i].expand) {
+                render(*entries[i].expand, prefix + (last ? "    " : "│   "), level + 1, options, lines);
+            }
+        }
+    }
+
 public:
     directoryTreeTool() : agentTool(
         "Directory Tree",
-        "Shows current directory structure as a tree",
-        "path: string - directory path to show (optional, defaults to current dir)",
-        "tree -a  -L 3 -I 'node_modules'"
+        R"(Shows a directory structure as a tree with file sizes and counts, skipping files ignored by git.
+        Large directories are summarized by file type)",
+        "path: string - directory path to show (optional, defaults to current dir), depth: int - levels to show (optional, defaults to 3), min_size: int - only list files of at least this many bytes (optional)",
+        "tree (in process)"
     ) {}
 
     std::unique_ptr<agentTool> clone() const override {
         return std::make_unique<directoryTreeTool>(*this);
     }
 
+    std::vector<std::string> resultDependencies(const nlohmann::json& params) const override {
+        std::string path = params.value("path", ".");
+        return {path.empty() ? "." : path};
+    }
+
+    bool isReadOnly() const override {
+        return true;
+    }
+
     std::string executeImpl(const std::string& params) override {
         nlohmann::json paramJson = nlohmann::json::parse(params);
-        std::string path = ".";
-        
-        if (paramJson.contains("path")) {
-            path = paramJson["path"];
+        std::string path = paramJson.value("path", ".");
+        if (path.empty()) path = ".";
+        renderOptions options{3, 0};
+        if (paramJson.contains("depth") && paramJson["depth"].is_number_integer()) {
+            options.depth = std::max(1, paramJson["depth"].get<int>());
+        }
+        if (paramJson.contains("min_size") && paramJson["min_size"].is_number()) {
+            options.minSize = static_cast<uint64_t>(std::max(0.0, paramJson["min_size"].get<double>()));
         }
 
-        std::string output = CommandExecutor::execute(realCommand, {path});
+        std::string output;
+        bool found = snapshots->with(path, options.depth, [&](const treeNode& tree) {
+            auto totals = tree.sum();
+            std::vector<std::string> lines;
+            unsigned int requestedDepth = options.depth;
+            // Shallower until it fits
+            while (true) {
+                lines.clear();
+                render(tree, "", 0, options, lines);
+                if (lines.size() <= maxLines || options.depth == 1) break;
+                options.depth--;
+            }
+            output = path + "  (" + summary(totals) + ")\n";
+            size_t shown = std::min(lines.size(), maxLines);
+            for (size_t i = 0; i < shown; ++i) {
+                output += lines[i] + "\n";
+            }
+            if (lines.size() > shown) output += "[" + std::to_string(lines.size() - shown) + " more entries not shown]\n";
+            output += std::to_string(totals.directories) + " directories, " + std::to_string(totals.files) + " files";
+            if (options.depth < requestedDepth) {
+                output += " (shown " + std::to_string(options.depth) + " levels deep to fit, ask for a subdirectory to see more)";
+            }
+        });
+        if (!found) {
+            return "Error: " + path + " is not a directory";
+        }
         return output;
     }
 };
\ No newline at end of file
@@ -0,0 +1,627 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <spdlog/spdlog.h>
+#include "filewalker.hpp"
+#include "mappedfile.hpp"
+#include "fileevents.hpp"
+
+// Trigram index over the files of a project, so searches only read files that can match.
+// Every indexed file is listed under each 3-byte sequence it contains; a query for a literal
+// only needs the files listed under all of the literal's trigrams.
+//
+// The index is a single file (<root>/.vibecpp.d/trigram.idx) that is memory-mapped, posting
+// lists are read straight from the mapping. Changes since it was written live in an overlay:
+// files written by tools arrive through fileEvents, outside edits through inotify or, when
+// that isn't available, an mtime sweep before queries. Large overlays are merged back to disk.
+class trigramIndex {
+private:
+    static constexpr uint32_t formatVersion = 1;
+    static constexpr size_t maxIndexedSize = 4 << 20;          // larger files are always searched
+    static constexpr auto sweepInterval = std::chrono::seconds(5); // without inotify
+
+    enum fileKind : uint32_t { textFile = 0, binaryFile = 1, unindexedFile = 2 };
+
+    struct header {
+        char magic[4];
+        uint32_t version;
+        uint32_t fileCount;
+        uint32_t trigramCount;
+        uint64_t postingCount;
+        uint64_t pathBytes;
+    };
+    struct fileRecord {
+        int64_t mtime;
+        uint64_t size;
+        uint64_t pathOffset;
+        uint32_t pathLength;
+        uint32_t kind;
+    };
+    struct trigramRecord {
+        uint32_t trigram;
+        uint32_t count;
+        uint64_t offset; // into the posting array
+    };
+
+    struct fileInfo {
+        int64_t mtime = 0;
+        uint64_t size = 0;
+        uint32_t kind = textFile;
+        std::vector<uint32_t> trigrams; // sorted, unique
+    };
+
+    std::string root; // absolute
+    std::string indexPath;
+    fileWalker walker;
+    std::mutex indexMutex;
+    bool opened = false;
+
+    // Snapshot on disk
+    mappedFile snapshot;
+    std::vector<std::string_view> basePaths; // sorted
+    std::vector<fileRecord> baseFiles;
+    std::vector<bool> baseStale;             // replaced or removed by the overlay
+    std::unordered_map<std::string_view, uint32_t> baseIds;
+    const char* trigramTable = nullptr;
+    uint32_t trigramCount = 0;
+    const char* postings = nullptr;
+
+    // Changes since the snapshot, relative path -> contents (nullopt = removed)
+    std::map<std::string, std::optional<fileInfo>> overlay;
+    std::set<std::string> pending; // absolute paths reported changed, looked at before the next query
+
+    // Outside edits
+    int inotifyFd = -1;
+    int stopFd = -1;
+    std::thread watcher;
+    std::mutex watchMutex;
+    std::unordered_map<int, std::string> watchedDirectories;
+    std::atomic<bool> watching{false};
+    std::chrono::steady_clock::time_point lastSweep{};
+    size_t eventSubscription = 0;
+
+    template <typename T>
+    static T readAt(const char* data, size_t offset) {
+        T value;
+        std::memcpy(&value, data + offset, sizeof(T));
+        return value;
+    }
+
+    static int64_t mtimeOf(const struct stat& info) {
+        return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    }
+
+    std::string relative(const std::string& absolutePath) const {
+        if (absolutePath == root) return {};
+        return absolutePath.substr(root.size() + 1);
+    }
+
+    bool inside(const std::string& absolutePath) const {
+        return absolutePath == root || (absolutePath.size() > root.size() &&
+            absolutePath.compare(0, root.size(), root) == 0 && absolutePath[root.size()] == '/');
+    }
+
+    static std::vector<uint32_t> trigramsOf(std::string_view text) {
+        // One bit per possible trigram, cleared again through the list of set bits
+        thread_local std::vector<uint64_t> seen(1 << 18);
+        std::vector<uint32_t> found;
+        const auto* data = reinterpret_cast<const unsigned char*>(text.data());
+        for (size_t i = 0; i + 2 < text.size(); ++i) {
+            uint32_t trigram = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) | data[i + 2];
+            uint64_t bit = uint64_t(1) << (trigram & 63);
+            if (!(seen[trigram >> 6] & bit)) {
+                seen[trigram >> 6] |= bit;
+                found.push_back(trigram);
+            }
+        }
+        for (uint32_t trigram : found) {
+            seen[trigram >> 6] = 0;
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    static std::optional<fileInfo> readFile(const std::string& absolutePath) {
+        struct stat info;
+        if (stat(absolutePath.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) return std::nullopt;
+        fileInfo file;
+        file.mtime = mtimeOf(info);
+        file.size = static_cast<uint64_t>(info.st_size);
+        if (file.size > maxIndexedSize) {
+            file.kind = unindexedFile;
+            return file;
+        }
+        mappedFile contents;
+        if (!contents.open(absolutePath)) return std::nullopt;
+        auto text = contents.view();
+        // Same rule as the search itself, binary files never match
+        if (std::memchr(text.data(), '\0', std::min<size_t>(text.size(), 8192))) {
+            file.kind = binaryFile;
+            return file;
+        }
+        file.trigrams = trigramsOf(text);
+        return file;
+    }
+
+    bool loadSnapshot() {
+        basePaths.clear();
+        baseFiles.clear();
+        baseStale.clear();
+        baseIds.clear();
+        trigramTable = nullptr;
+        postings = nullptr;
+        trigramCount = 0;
+        if (!snapshot.open(indexPath)) return false;
+
+        auto data = snapshot.view();
+        if (data.size() < sizeof(header)) return false;
+        auto head = readAt<header>(data.data(), 0);
+        if (std::memcmp(head.magic, "VTGI", 4) != 0 || head.version != formatVersion) return false;
+        size_t filesOffset = sizeof(header);
+        size_t tableOffset = filesOffset + head.fileCount * sizeof(fileRecord);
+        size_t postingsOffset = tableOffset + head.trigramCount * sizeof(trigramRecord);
+        size_t pathsOffset = postingsOffset + head.postingCount * sizeof(uint32_t);
+        if (pathsOffset + head.pathBytes != data.size()) return false;
+
+        for (uint32_t i = 0; i < head.fileCount; ++i) {
+            auto record = readAt<fileRecord>(data.data(), filesOffset + i * sizeof(fileRecord));
+            if (record.pathOffset + record.pathLength > head.pathBytes) return false;
+            baseFiles.push_back(record);
+            basePaths.emplace_back(data.data() + pathsOffset + record.pathOffset, record.pathLength);
+            baseIds.emplace(basePaths.back(), i);
+        }
+        baseStale.assign(baseFiles.size(), false);
+        trigramTable = data.data() + tableOffset;
+        trigramCount = head.trigramCount;
+        postings = data.data() + postingsOffset;
+        return true;
+    }
+
+    // Posting list of a trigram in the snapshot, empty when no file contains it
+    std::vector<uint32_t> basePostings(uint32_t trigram) const {
+        size_t low = 0;
+        size_t high = trigramCount;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            auto record = readAt<trigramRecord>(trigramTable, middle * sizeof(trigramRecord));
+            if (record.trigram < trigram) {
+                low = middle + 1;
+            } else if (record.trigram > trigram) {
+                high = middle;
+            } else {
+                std::vector<uint32_t> ids(record.count);
+                std::memcpy(ids.data(), postings + record.offset * sizeof(uint32_t), record.count * sizeof(uint32_t));
+                return ids;
+            }
+        }
+        return {};
+    }
+
+    // What the file at relativePath is now, compared with what the index knows
+    void refreshFile(const std::string& relativePath, const std::string& absolutePath) {
+        struct stat info;
+        bool present = stat(absolutePath.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+        auto known = overlay.find(relativePath);
+        if (known != overlay.end()) {
+            if (present && known->second && known->second->mtime == mtimeOf(info) &&
+                known->second->size == static_cast<uint64_t>(info.st_size)) return;
+        } else if (auto base = baseIds.find(relativePath); base != baseIds.end() && !baseStale[base->second]) {
+            const auto& record = baseFiles[base->second];
+            if (present && record.mtime == mtimeOf(info) && record.size == static_cast<uint64_t>(info.st_size)) return;
+        } else if (!present) {
+            return;
+        }
+        removeKnown(relativePath, false);
+        overlay[relativePath] = present ? readFile(absolutePath) : std::nullopt;
+    }
+
+    // Marks a file, or with recursive everything below a directory, as removed
+    void removeKnown(const std::string& relativePath, bool recursive) {
+        auto removeRange = [this](const std::string& first, auto&& matches) {
+            auto base = std::lower_bound(basePaths.begin(), basePaths.end(), std::string_view(first));
+            for (; base != basePaths.end() && matches(*base); ++base) {
+                size_t id = base - basePaths.begin();
+                if (!baseStale[id]) {
+                    baseStale[id] = true;
+                    overlay.emplace(std::string(*base), std::nullopt);
+                }
+            }
+            for (auto it = overlay.lower_bound(first); it != overlay.end() && matches(it->first); ++it) {
+                it->second.reset();
+            }
+        };
+        removeRange(relativePath, [&relativePath](std::string_view path) { return path == relativePath; });
+        if (recursive) {
+            // "dir-x" sorts between "dir" and "dir/...", so the files below are a range of their own
+            std::string prefix = relativePath.empty() ? "" : relativePath + "/";
+            removeRange(prefix, [&prefix](std::string_view path) { return path.substr(0, prefix.size()) == prefix; });
+        }
+    }
+
+    // Brings everything at or below an absolute path up to date
+    void refreshPath(const std::string& absolutePath) {
+        if (!inside(absolutePath)) return;
+        std::string relativePath = relative(absolutePath);
+        struct stat info;
+        if (stat(absolutePath.c_str(), &info) != 0 || walker.excluded(root, absolutePath)) {
+            if (!relativePath.empty()) removeKnown(relativePath, true);
+            return;
+        }
+        if (!S_ISDIR(info.st_mode)) {
+            refreshFile(relativePath, absolutePath);
+            return;
+        }
+
+        // Files that were known below the directory but are not found again are gone
+        std::set<std::string> seen;
+        std::mutex seenMutex;
+        walker.walk(absolutePath, [&](const walkEntry& entry) {
+            std::lock_guard<std::mutex> lock(seenMutex);
+            seen.insert(fileWalker::join(relativePath, entry.relativePath));
+            return true;
+        }, [this](const std::string& directory) { watchDirectory(directory); });
+
+        std::string prefix = relativePath.empty() ? "" : relativePath + "/";
+        std::vector<std::string> gone;
+        auto base = std::lower_bound(basePaths.begin(), basePaths.end(), std::string_view(prefix));
+        for (; base != basePaths.end() && base->substr(0, prefix.size()) == prefix; ++base) {
+            if (!baseStale[base - basePaths.begin()] && !seen.count(std::string(*base))) gone.emplace_back(*base);
+        }
+        for (auto it = overlay.lower_bound(prefix); it != overlay.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+            if (it->second && !seen.count(it->first)) gone.push_back(it->first);
+        }
+        for (const auto& path : gone) {
+            removeKnown(path, false);
+        }
+
+        // Reading changed files is the expensive part, do that on all cores
+        std::vector<std::string> changed;
+        for (const auto& path : seen) {
+            std::string file = fileWalker::join(root, path);
+            if (stat(file.c_str(), &info) != 0) continue;
+            auto known = overlay.find(path);
+            if (known != overlay.end() && known->second && known->second->mtime == mtimeOf(info) &&
+                known->second->size == static_cast<uint64_t>(info.st_size)) continue;
+            if (known == overlay.end()) {
+                auto id = baseIds.find(path);
+                if (id != baseIds.end() && !baseStale[id->second] && baseFiles[id->second].mtime == mtimeOf(info) &&
+                    baseFiles[id->second].size == static_cast<uint64_t>(info.st_size)) continue;
+            }
+            changed.push_back(path);
+        }
+        std::vector<std::optional<fileInfo>> contents(changed.size());
+        std::atomic<size_t> next{0};
+        auto readChanged = [&]() {
+            for (size_t i = next++; i < changed.size(); i = next++) {
+                contents[i] = readFile(fileWalker::join(root, changed[i]));
+            }
+        };
+        std::vector<std::thread> readers;
+        for (unsigned int i = 1; i < std::min<size_t>(8, std::thread::hardware_concurrency()) && i * 64 < changed.size(); ++i) {
+            readers.emplace_back(readChanged);
+        }
+        readChanged();
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        for (size_t i = 0; i < changed.size(); ++i) {
+            removeKnown(changed[i], false);
+            overlay[changed[i]] = std::move(contents[i]);
+        }
+    }
+
+    void processPending() {
+        std::set<std::string> paths;
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            paths.swap(pending);
+        }
+        // A directory covers everything below it
+        std::string covering;
+        for (const auto& path : paths) {
+            if (!covering.empty() && (path == covering || path.compare(0, covering.size() + 1, covering + "/") == 0)) continue;
+            refreshPath(path);
+            covering = path;
+        }
+    }
+
+    // Writes snapshot and overlay into a new index file and maps that
+    bool save() {
+        std::vector<std::string> paths;
+        std::vector<fileRecord> records;
+        std::vector<int64_t> newIdOfBase(baseFiles.size(), -1);
+        std::vector<const fileInfo*> overlayFiles;
+
+        // Merge the sorted base paths with the sorted overlay, new ids follow path order
+        auto next = overlay.begin();
+        auto addOverlay = [&]() {
+            if (next->second) {
+                fileRecord record{next->second->mtime, next->second->size, 0, 0, next->second->kind};
+                paths.push_back(next->first);
+                records.push_back(record);
+                overlayFiles.push_back(&*next->second);
+            }
+            ++next;
+        };
+        for (size_t id = 0; id < basePaths.size(); ++id) {
+            while (next != overlay.end() && next->first < basePaths[id]) addOverlay();
+            if (next != overlay.end() && next->first == basePaths[id]) {
+                addOverlay();
+                continue;
+            }
+            if (baseStale[id]) continue;
+            newIdOfBase[id] = static_cast<int64_t>(paths.size());
+            paths.emplace_back(basePaths[id]);
+            records.push_back(baseFiles[id]);
+            overlayFiles.push_back(nullptr);
+        }
+        while (next != overlay.end()) addOverlay();
+
+        // (trigram, new id) pairs of the overlay, merged with the base lists trigram by trigram
+        std::vector<std::pair<uint32_t, uint32_t>> added;
+        for (size_t id = 0; id < overlayFiles.size(); ++id) {
+            if (!overlayFiles[id]) continue;
+            for (uint32_t trigram : overlayFiles[id]->trigrams) {
+                added.emplace_back(trigram, static_cast<uint32_t>(id));
+            }
+        }
+        std::sort(added.begin(), added.end());
+
+        std::vector<trigramRecord> table;
+        std::vector<uint32_t> allPostings;
+        size_t baseIndex = 0;
+        size_t addedIndex = 0;
+        std::vector<uint32_t> list;
+        while (baseIndex < trigramCount || addedIndex < added.size()) {
+            uint32_t baseTrigram = baseIndex < trigramCount
+                ? readAt<trigramRecord>(trigramTable, baseIndex * sizeof(trigramRecord)).trigram : UINT32_MAX;
+            uint32_t addedTrigram = addedIndex < added.size() ? added[addedIndex].first : UINT32_MAX;
+            uint32_t trigram = std::min(baseTrigram, addedTrigram);
+            list.clear();
+            if (baseTrigram == trigram && baseIndex < trigramCount) {
+                for (uint32_t id : basePostings(trigram)) {
+                    if (newIdOfBase[id] >= 0) list.push_back(static_cast<uint32_t>(newIdOfBase[id]));
+                }
+                ++baseIndex;
+            }
+            for (; addedIndex < added.size() && added[addedIndex].first == trigram; ++addedIndex) {
+                list.push_back(added[addedIndex].second);
+            }
+            if (list.empty()) continue;
+            std::sort(list.begin(), list.end());
+            table.push_back({trigram, static_cast<uint32_t>(list.size()), allPostings.size()});
+            allPostings.insert(allPostings.end(), list.begin(), list.end());
+        }
+
+        std::string pathBlob;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            records[i].pathOffset = pathBlob.size();
+            records[i].pathLength = static_cast<uint32_t>(paths[i].size());
+            pathBlob += paths[i];
+        }
+        header head{{'V', 'T', 'G', 'I'}, formatVersion, static_cast<uint32_t>(records.size()),
+                    static_cast<uint32_t>(table.size()), allPostings.size(), pathBlob.size()};
+
+        std::error_code ec;
+        std::filesystem::path directory = std::filesystem::path(indexPath).parent_path();
+        std::filesystem::create_directories(directory, ec);
+        // Keeps the index out of git and out of its own walks
+        if (!std::filesystem::exists(directory / ".gitignore", ec)) {
+            std::ofstream(directory / ".gitignore") << "*\n";
+        }
+        std::string temp = indexPath + ".tmp";
+        {
+            std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                spdlog::warn("Could not write search index {}", temp);
+                return false;
+            }
+            file.write(reinterpret_cast<const char*>(&head), sizeof(head));
+            file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(fileRecord));
+            file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(trigramRecord));
+            file.write(reinterpret_cast<const char*>(allPostings.data()), allPostings.size() * sizeof(uint32_t));
+            file.write(pathBlob.data(), pathBlob.size());
+            if (!file.good()) return false;
+        }
+        std::filesystem::rename(temp, indexPath, ec);
+        if (ec) {
+            spdlog::warn("Could not replace search index {}: {}", indexPath, ec.message());
+            return false;
+        }
+        overlay.clear();
+        spdlog::info("Search index written: {} files, {} trigrams", records.size(), table.size());
+        return loadSnapshot();
+    }
+
+    // The overlay is checked file by file on every query, merge it once it gets big
+    bool overlayTooLarge() const {
+        return overlay.size() > std::max<size_t>(256, baseFiles.size() / 20);
+    }
+
+    void watchDirectory(const std::string& directory) {
+        if (inotifyFd < 0) return;
+        int wd = inotify_add_watch(inotifyFd, directory.c_str(),
+            IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR);
+        if (wd < 0) {
+            if (watching.exchange(false)) {
+                spdlog::warn("Cannot watch {} ({}), checking file times before searches instead", directory, std::strerror(errno));
+            }
+            return;
+        }
+        std::lock_guard<std::mutex> lock(watchMutex);
+        watchedDirectories[wd] = directory;
+    }
+
+    void watchLoop() {
+        alignas(struct inotify_event) char buffer[16384];
+        pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+        while (poll(fds, 2, -1) >= 0 && !(fds[1].revents & POLLIN)) {
+            ssize_t length = read(inotifyFd, buffer, sizeof buffer);
+            if (length <= 0) continue;
+            std::lock_guard<std::mutex> lock(watchMutex);
+            for (char* p = buffer; p < buffer + length;) {
+                auto* event = reinterpret_cast<struct inotify_event*>(p);
+                p += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    pending.insert(root); // lost track, check everything
+                    continue;
+                }
+                auto directory = watchedDirectories.find(event->wd);
+                if (directory == watchedDirectories.end()) continue;
+                if (event->mask & IN_IGNORED) {
+                    watchedDirectories.erase(directory);
+                    continue;
+                }
+                pending.insert(event->len ? fileWalker::join(directory->second, event->name) : directory->second);
+            }
+        }
+    }
+
+    void startWatching() {
+        inotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        stopFd = eventfd(0, EFD_CLOEXEC);
+        if (inotifyFd < 0 || stopFd < 0) {
+            spdlog::warn("inotify is not available, checking file times before searches instead");
+            return;
+        }
+        watching = true;
+        watcher = std::thread(&trigramIndex::watchLoop, this);
+    }
+
+    void open() {
+        startWatching();
+        eventSubscription = fileEvents::instance().subscribe([this](const std::string& path) {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            pending.insert(path);
+        });
+        auto started = std::chrono::steady_clock::now();
+        bool loaded = loadSnapshot();
+        // Catches up with changes made while nobody was watching, also adds the inotify watches
+        refreshPath(root);
+        lastSweep = std::chrono::steady_clock::now();
+        if (!loaded || overlayTooLarge()) {
+            save();
+        }
+        spdlog::info("Search index for {} ready in {} ms", root, std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count());
+        opened = true;
+    }
+
+public:
+    explicit trigramIndex(const std::string& projectRoot)
+        : root(fileWalker::absolute(projectRoot)), indexPath(fileWalker::join(root, ".vibecpp.d/trigram.idx")) {}
+
+    trigramIndex(const trigramIndex&) = delete;
+    trigramIndex& operator=(const trigramIndex&) = delete;
+
+    ~trigramIndex() {
+        if (eventSubscription) {
+            fileEvents::instance().unsubscribe(eventSubscription);
+        }
+        if (watcher.joinable()) {
+            uint64_t one = 1;
+            [[maybe_unused]] auto written = write(stopFd, &one, sizeof one);
+            watcher.join();
+        }
+        if (inotifyFd >= 0) close(inotifyFd);
+        if (stopFd >= 0) close(stopFd);
+        // Small overlays are not written back, the next start finds those changes again
+    }
+
+    const std::string& getRoot() const {
+        return root;
+    }
+
+    // Files below searchRoot that may contain all of the literals, in walk order of paths.
+    // nullopt when the index can't narrow the search (no literal of 3 bytes or more, or
+    // searchRoot outside the project or in a part of it that is never indexed: ignored
+    // directories and nested repositories), the caller scans the tree then.
+    std::optional<std::vector<walkEntry>> candidates(const std::string& searchRoot, const std::vector<std::string>& literals) {
+        std::vector<uint32_t> wanted;
+        for (const auto& literal : literals) {
+            auto trigrams = trigramsOf(literal);
+            wanted.insert(wanted.end(), trigrams.begin(), trigrams.end());
+        }
+        std::sort(wanted.begin(), wanted.end());
+        wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+        std::string absoluteSearchRoot = fileWalker::absolute(searchRoot);
+        if (wanted.empty() || !inside(absoluteSearchRoot)) return std::nullopt;
+        // excluded() also covers roots in or below a nested repository
+        if (walker.excluded(root, absoluteSearchRoot)) return std::nullopt;
+
+        std::lock_guard<std::mutex> lock(indexMutex);
+        if (!opened) {
+            open();
+        }
+        if (!watching && std::chrono::steady_clock::now() - lastSweep > sweepInterval) {
+            std::lock_guard<std::mutex> pendingLock(watchMutex);
+            pending.insert(root);
+            lastSweep = std::chrono::steady_clock::now();
+        }
+        processPending();
+
+        // Rarest trigrams first keeps the intersection small
+        std::vector<std::vector<uint32_t>> lists;
+        for (uint32_t trigram : wanted) {
+            lists.push_back(basePostings(trigram));
+        }
+        std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) { return a.size() < b.size(); });
+        std::vector<uint32_t> ids = lists.front();
+        for (size_t i = 1; i < lists.size() && !ids.empty(); ++i) {
+            std::vector<uint32_t> both;
+            std::set_intersection(ids.begin(), ids.end(), lists[i].begin(), lists[i].end(), std::back_inserter(both));
+            ids.swap(both);
+        }
+
+        std::vector<std::string> found;
+        for (uint32_t id : ids) {
+            if (!baseStale[id]) found.emplace_back(basePaths[id]);
+        }
+        for (size_t id = 0; id < baseFiles.size(); ++id) {
+            if (baseFiles[id].kind == unindexedFile && !baseStale[id]) found.emplace_back(basePaths[id]);
+        }
+        for (const auto& [path, file] : overlay) {
+            if (!file || file->kind == binaryFile) continue;
+            if (file->kind == unindexedFile || std::includes(file->trigrams.begin(), file->trigrams.end(), wanted.begin(), wanted.end())) {
+                found.push_back(path);
+            }
+        }
+        std::sort(found.begin(), found.end());
+
+        std::string searchPrefix = relative(absoluteSearchRoot);
+        std::vector<walkEntry> entries;
+        for (const auto& path : found) {
+            if (!searchPrefix.empty() && path != searchPrefix && path.compare(0, searchPrefix.size() + 1, searchPrefix + "/") != 0) {
+                continue;
+            }
+            walkEntry entry;
+            entry.relativePath = path == searchPrefix ? std::filesystem::path(path).filename().string()
+                                                      : path.substr(searchPrefix.empty() ? 0 : searchPrefix.size() + 1);
+            entry.path = path == searchPrefix ? searchRoot : fileWalker::join(searchRoot, entry.relativePath);
+            entry.absolutePath = fileWalker::join(root, path);
+            entries.push_back(std::move(entry));
+        }
+        spdlog::debug("Search index narrowed {} files to {} candidates", baseFiles.size() + overlay.size(), entries.size());
+
+        if (overlayTooLarge()) {
+            save();
+        }
+        return entries;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <algorithm>
+
+// Fixed number of threads pulling tasks from one queue. Threads are started once and live
+// as long as the pool, so submitting work doesn't pay for thread creation.
+class workerPool {
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false;
+
+public:
+    explicit workerPool(size_t threadCount = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        threadCount = std::max<size_t>(1, threadCount);
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            workers.emplace_back([this]() {
+                while (true)
+                {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(queueMutex);
+                        queueCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                        if (stopping && tasks.empty())
+                        {
+                            return;
+                        }
+                        task = std::move(tasks.front());
+                        tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    workerPool(const workerPool&) = delete;
+    workerPool& operator=(const workerPool&) = delete;
+
+    ~workerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+    template <typename F>
+    auto submit(F&& function) -> std::future<decltype(function())>
+    {
+        using resultType = decltype(function());
+        auto task = std::make_shared<std::packaged_task<resultType()>>(std::forward<F>(function));
+        std::future<resultType> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            tasks.emplace([task]() { (*task)(); });
+        }
+        queueCondition.notify_one();
+        return result;
+    }
+};
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <fstream>
 #include <iostream>
 #include "tool.hpp"
+#include "fileevents.hpp"
 
 class writeToFileTool : public agentTool {
 public:
@@ -33,6 +34,7 @@ public:
             
             file << content;
             file.close();
+            fileEvents::instance().changed(filePath);
             
             return "Successfully wrote to file: " + filePath;
         } catch (const std::exception& e) {
@@ -0,0 +1,56 @@
+// Runs every answer in tests/jsonrepair through lenientJson::toolCalls and compares the calls
+// it finds with the ones expected. A case file is the model's answer as it arrived, a line
+// "--- expected ---", and the calls as a JSON array ([] for an answer without one).
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "jsonrepair.hpp"
+
+int main(int argc, char** argv) {
+    std::filesystem::path corpus = argc > 1 ? argv[1] : "tests/jsonrepair";
+    std::vector<std::filesystem::path> cases;
+    for (const auto& entry : std::filesystem::directory_iterator(corpus)) {
+        if (entry.path().extension() == ".txt") cases.push_back(entry.path());
+    }
+    std::sort(cases.begin(), cases.end());
+    if (cases.empty()) {
+        std::cerr << "no cases in " << corpus << "\n";
+        return 1;
+    }
+
+    const std::string separator = "\n--- expected ---\n";
+    int failed = 0;
+    for (const auto& path : cases) {
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string text = buffer.str();
+        size_t split = text.rfind(separator);
+        if (split == std::string::npos) {
+            std::cout << "FAIL " << path.filename().string() << ": no \"--- expected ---\" line\n";
+            ++failed;
+            continue;
+        }
+        std::string answer = text.substr(0, split);
+        nlohmann::json expected = nlohmann::json::parse(text.substr(split + separator.size()), nullptr, false);
+        if (!expected.is_array()) {
+            std::cout << "FAIL " << path.filename().string() << ": expected calls are not a JSON array\n";
+            ++failed;
+            continue;
+        }
+        nlohmann::json found = lenientJson::toolCalls(answer);
+        if (found == expected) {
+            std::cout << "ok   " << path.filename().string() << "\n";
+        } else {
+            std::cout << "FAIL " << path.filename().string() << "\n  expected " << expected.dump()
+                      << "\n  found    " << found.dump() << "\n";
+            ++failed;
+        }
+    }
+    std::cout << cases.size() - failed << "/" << cases.size() << " answers parsed as expected\n";
+    return failed == 0 ? 0 : 1;
+}
\ No newline at end of file